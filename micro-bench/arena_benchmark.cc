@@ -0,0 +1,269 @@
+/** Google Benchmark cases for the native building blocks of an arena: `qb::slab`,
+    `qb::arena`, and the `qb::shape`s which lay out instance attributes.
+
+    These run without any `ArenaAllocatable` types, so they measure the data structures
+    alone, without the interpreter around them. The Python level comparison against
+    plain classes is in `suite.py`.
+
+    Usage: arena_benchmark [--benchmark_format=json] [--benchmark_out=FILE] ...
+ */
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <Python.h>
+#include <benchmark/benchmark.h>
+
+#include "quelling_blade/arena.h"
+#include "quelling_blade/object_ref.h"
+#include "quelling_blade/shape.h"
+
+namespace {
+// about the size of a small `ArenaAllocatable` instance
+constexpr std::size_t object_size = 64;
+
+qb::slab_backing backing_arg(std::int64_t arg) {
+    return arg ? qb::slab_backing::mmap : qb::slab_backing::malloc;
+}
+
+void backing_label(benchmark::State& state, std::int64_t arg) {
+    state.SetLabel(arg ? "mmap" : "malloc");
+}
+
+/** Bump allocate out of a single slab, rewinding it when it is full.
+ */
+void slab_try_allocate(benchmark::State& state) {
+    qb::slab slab{qb::slab_backing::malloc, 1 << 20};
+    std::size_t size = state.range(0);
+    for (auto _ : state) {
+        std::byte* p = slab.try_allocate(size, alignof(void*));
+        if (!p) {
+            slab.reset();
+            p = slab.try_allocate(size, alignof(void*));
+        }
+        benchmark::DoNotOptimize(p);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(slab_try_allocate)->Arg(16)->Arg(64)->Arg(256);
+
+/** Create and destroy a slab, with the slab pool enabled or disabled. With the pool,
+    a destroyed slab is reused by the next one of the same size.
+ */
+void slab_acquire_release(benchmark::State& state) {
+    qb::slab_pool& pool = qb::slab_pool::instance();
+    std::size_t limit = pool.limit();
+    if (!state.range(1)) {
+        pool.set_limit(0);
+    }
+    for (auto _ : state) {
+        qb::slab slab{backing_arg(state.range(0)), 1 << 16};
+        benchmark::DoNotOptimize(slab.data());
+    }
+    pool.set_limit(limit);
+    pool.trim();
+}
+BENCHMARK(slab_acquire_release)
+    ->ArgNames({"mmap", "pooled"})
+    ->ArgsProduct({{0, 1}, {0, 1}});
+
+/** Allocate out of an arena which grows new slabs, resetting it every so often so that
+    the benchmark doesn't run out of memory.
+ */
+void arena_allocate(benchmark::State& state) {
+    qb::arena arena{backing_arg(state.range(0)), 1 << 16, 2.0, 1 << 24};
+    backing_label(state, state.range(0));
+    std::size_t count = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(arena.allocate(object_size, alignof(void*)));
+        if (++count == 1 << 20) {
+            arena.reset();
+            count = 0;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(arena_allocate)->Arg(0)->Arg(1);
+
+/** Allocate from a concurrent arena, either directly or through a
+    `qb::arena::local_allocator`, from a single thread. This is the uncontended cost of
+    each strategy; `concurrent_allocation.cc` measures contention.
+ */
+void arena_allocate_concurrent(benchmark::State& state) {
+    qb::arena arena{qb::slab_backing::malloc, 1 << 16, 2.0, 1 << 24, true};
+    bool local = state.range(0);
+    state.SetLabel(local ? "local" : "shared");
+    std::size_t count = 0;
+    while (state.KeepRunningBatch(1 << 16)) {
+        if (local) {
+            qb::arena::local_allocator allocator(arena);
+            for (std::size_t n = 0; n < 1 << 16; ++n) {
+                benchmark::DoNotOptimize(allocator.allocate(object_size, alignof(void*)));
+            }
+        }
+        else {
+            for (std::size_t n = 0; n < 1 << 16; ++n) {
+                benchmark::DoNotOptimize(arena.allocate(object_size, alignof(void*)));
+            }
+        }
+        if (++count == 16) {
+            arena.reset();
+            count = 0;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(arena_allocate_concurrent)->Arg(0)->Arg(1);
+
+/** Look up pointers in the given number of full slabs, in a random order. The pointers
+    are not in the active slab, so each lookup searches the index of the slabs. Every
+    value stored in an instance is checked against its arena, so this is paid on each
+    `setattr`.
+ */
+void arena_contains(benchmark::State& state) {
+    std::size_t slab_size = 1 << 12;
+    qb::arena arena{qb::slab_backing::malloc, slab_size, 1.0, slab_size};
+    std::vector<std::byte*> pointers;
+    while (true) {
+        std::byte* p = arena.allocate(object_size, alignof(void*));
+        if (arena.slab_count() > static_cast<std::size_t>(state.range(0))) {
+            break;
+        }
+        pointers.push_back(p);
+    }
+    std::mt19937 rng{0};
+    std::shuffle(pointers.begin(), pointers.end(), rng);
+    std::size_t ix = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(arena.contains(pointers[ix]));
+        if (++ix == pointers.size()) {
+            ix = 0;
+        }
+    }
+}
+BENCHMARK(arena_contains)->RangeMultiplier(10)->Range(1, 10000);
+
+/** Add references to distinct objects outside of the arena, and release them all with
+    `reset`.
+ */
+void arena_add_external_reference(benchmark::State& state) {
+    std::vector<qb::owned_ref<>> values;
+    for (long ix = 0; ix < 1 << 12; ++ix) {
+        values.emplace_back(PyLong_FromLong(ix + 1000));
+    }
+    qb::arena arena{qb::slab_backing::malloc, 1 << 16, 2.0, 1 << 24};
+    while (state.KeepRunningBatch(values.size())) {
+        for (const qb::owned_ref<>& value : values) {
+            arena.add_external_reference(value.get());
+        }
+        // the second add of each value only finds it in the set
+        for (const qb::owned_ref<>& value : values) {
+            arena.add_external_reference(value.get());
+        }
+        state.PauseTiming();
+        arena.reset();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * 2);
+}
+BENCHMARK(arena_add_external_reference);
+
+/** A chain of shapes with `count` interned attribute names, like a type whose
+    instances all set the same attributes in the same order.
+ */
+class shape_chain {
+private:
+    std::vector<qb::owned_ref<>> m_names;
+    qb::shape m_root;
+    qb::shape* m_leaf;
+
+public:
+    explicit shape_chain(std::size_t count) : m_leaf(&m_root) {
+        for (std::size_t ix = 0; ix < count; ++ix) {
+            std::string name = "attribute_" + std::to_string(ix);
+            m_names.emplace_back(PyUnicode_InternFromString(name.c_str()));
+            m_leaf = m_leaf->add(m_names.back());
+        }
+    }
+
+    qb::shape& root() {
+        return m_root;
+    }
+
+    qb::shape& leaf() {
+        return *m_leaf;
+    }
+
+    const std::vector<qb::owned_ref<>>& names() const {
+        return m_names;
+    }
+};
+
+/** Look up each attribute of a shape by the interned name, like `getattr`.
+ */
+void shape_lookup_hit(benchmark::State& state) {
+    shape_chain chain(state.range(0));
+    qb::shape& leaf = chain.leaf();
+    while (state.KeepRunningBatch(chain.names().size())) {
+        for (const qb::owned_ref<>& name : chain.names()) {
+            benchmark::DoNotOptimize(leaf.lookup(name));
+        }
+    }
+}
+BENCHMARK(shape_lookup_hit)->Arg(1)->Arg(4)->Arg(8)->Arg(9)->Arg(32);
+
+/** Look up an interned name which isn't in the shape, like reading a method through an
+    instance.
+ */
+void shape_lookup_miss(benchmark::State& state) {
+    shape_chain chain(state.range(0));
+    qb::owned_ref<> name{PyUnicode_InternFromString("method")};
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(chain.leaf().lookup(name));
+    }
+}
+BENCHMARK(shape_lookup_miss)->Arg(1)->Arg(4)->Arg(8)->Arg(9)->Arg(32);
+
+/** Look up the last attribute by a name which is equal to the key but not interned,
+    like `getattr(ob, name)` with a name built at runtime.
+ */
+void shape_lookup_not_interned(benchmark::State& state) {
+    shape_chain chain(state.range(0));
+    std::string text = "attribute_" + std::to_string(state.range(0) - 1);
+    qb::owned_ref<> name{PyUnicode_FromStringAndSize(text.data(), text.size())};
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(chain.leaf().lookup(name));
+    }
+}
+BENCHMARK(shape_lookup_not_interned)->Arg(1)->Arg(4)->Arg(8)->Arg(9)->Arg(32);
+
+/** Follow the cached transitions from the root shape, like a constructor setting the
+    attributes of a new instance.
+ */
+void shape_add_cached(benchmark::State& state) {
+    shape_chain chain(state.range(0));
+    while (state.KeepRunningBatch(chain.names().size())) {
+        qb::shape* shape = &chain.root();
+        for (const qb::owned_ref<>& name : chain.names()) {
+            shape = shape->add(name);
+        }
+        benchmark::DoNotOptimize(shape);
+    }
+}
+BENCHMARK(shape_add_cached)->Arg(1)->Arg(4)->Arg(8)->Arg(32);
+}  // namespace
+
+int main(int argc, char** argv) {
+    // shapes and external references hold Python objects
+    Py_InitializeEx(0);
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return Py_FinalizeEx() < 0 ? 1 : 0;
+}
@@ -0,0 +1,111 @@
+/** Measure allocation throughput when many threads allocate from one arena.
+
+    Each thread makes the same number of allocations, so ideal scaling shows up as total
+    throughput growing linearly with the thread count. Three strategies are compared:
+
+    - locked: a regular arena behind a mutex.
+    - shared: a concurrent arena, where each allocation is a fetch-and-add on the active
+      slab's bump pointer.
+    - local: a concurrent arena, where each thread allocates from chunks claimed with an
+      `arena::local_allocator`.
+
+    Usage: concurrent_allocation [max_threads [allocations_per_thread]]
+ */
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "quelling_blade/arena.h"
+
+namespace {
+// about the size of a small `ArenaAllocatable` instance
+constexpr std::size_t object_size = 64;
+
+template<typename F>
+double run(std::size_t thread_count, std::size_t allocations, F allocate_loop) {
+    std::atomic<std::size_t> ready{0};
+    std::atomic<bool> go{false};
+    std::vector<std::thread> threads;
+    for (std::size_t n = 0; n < thread_count; ++n) {
+        threads.emplace_back([&] {
+            ++ready;
+            while (!go.load(std::memory_order_acquire)) {
+            }
+            allocate_loop(allocations);
+        });
+    }
+    while (ready.load() != thread_count) {
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+    return thread_count * allocations / duration.count();
+}
+
+qb::arena make_arena(bool concurrent) {
+    return qb::arena{qb::slab_backing::malloc, 1 << 16, 2.0, 1 << 26, concurrent};
+}
+
+double locked(std::size_t thread_count, std::size_t allocations) {
+    qb::arena arena = make_arena(false);
+    std::mutex mutex;
+    return run(thread_count, allocations, [&](std::size_t allocations) {
+        for (std::size_t n = 0; n < allocations; ++n) {
+            std::byte* p;
+            {
+                std::lock_guard<std::mutex> guard(mutex);
+                p = arena.allocate(object_size, alignof(void*));
+            }
+            std::memset(p, 0, object_size);
+        }
+    });
+}
+
+double shared(std::size_t thread_count, std::size_t allocations) {
+    qb::arena arena = make_arena(true);
+    return run(thread_count, allocations, [&](std::size_t allocations) {
+        for (std::size_t n = 0; n < allocations; ++n) {
+            std::memset(arena.allocate(object_size, alignof(void*)), 0, object_size);
+        }
+    });
+}
+
+double local(std::size_t thread_count, std::size_t allocations) {
+    qb::arena arena = make_arena(true);
+    return run(thread_count, allocations, [&](std::size_t allocations) {
+        qb::arena::local_allocator allocator(arena);
+        for (std::size_t n = 0; n < allocations; ++n) {
+            std::memset(allocator.allocate(object_size, alignof(void*)), 0, object_size);
+        }
+    });
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::size_t max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    std::size_t allocations = 1 << 21;
+    if (argc > 1) {
+        max_threads = std::strtoull(argv[1], nullptr, 10);
+    }
+    if (argc > 2) {
+        allocations = std::strtoull(argv[2], nullptr, 10);
+    }
+
+    std::printf("%7s  %16s  %16s  %16s\n", "threads", "locked", "shared", "local");
+    for (std::size_t threads = 1; threads <= max_threads; threads *= 2) {
+        std::printf("%7zu  %11.1f M/s  %11.1f M/s  %11.1f M/s\n",
+                    threads,
+                    locked(threads, allocations) / 1e6,
+                    shared(threads, allocations) / 1e6,
+                    local(threads, allocations) / 1e6);
+    }
+}
@@ -0,0 +1,48 @@
+"""Measure the cost of constructing ``ArenaAllocatable`` instances.
+
+Each case is run both in an arena and globally. "no_init" calls a type that
+does not define ``__init__``, "positional" and "keyword" call a Python
+``__init__`` which stores three attributes.
+"""
+import time
+
+from quelling_blade.arena_allocatable import ArenaAllocatable, Arena
+
+
+class Bare(ArenaAllocatable):
+    pass
+
+
+class Node(ArenaAllocatable):
+    def __init__(self, value, left=None, right=None):
+        self.value = value
+        self.left = left
+        self.right = right
+
+
+def no_init(iterations):
+    for _ in range(iterations):
+        Bare()
+
+
+def positional(iterations):
+    for _ in range(iterations):
+        Node(1, None, None)
+
+
+def keyword(iterations):
+    for _ in range(iterations):
+        Node(1, left=None, right=None)
+
+
+def run(case, iterations=1000000):
+    start = time.perf_counter()
+    case(iterations)
+    return (time.perf_counter() - start) / iterations * 1e9
+
+
+for case in (no_init, positional, keyword):
+    global_ns = run(case)
+    with Arena([Bare, Node], 2 ** 26):
+        arena_ns = run(case)
+    print(f'{case.__name__:>10}: global {global_ns:5.1f} ns, arena {arena_ns:5.1f} ns')
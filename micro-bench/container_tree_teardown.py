@@ -0,0 +1,56 @@
+"""Build and tear down a tree whose nodes keep their children in a container.
+
+The baseline uses ``list`` and ``dict`` without an arena. Regular containers
+can't be used inside of an arena: they hold real references to the nodes, and
+the arena holds a reference to each container, so the nodes would never be
+released. ``ArenaList`` and ``ArenaDict`` are allocated in the arena along with
+the nodes and are released with it in bulk.
+"""
+import contextlib
+import time
+
+from quelling_blade.arena_allocatable import (
+    Arena,
+    ArenaAllocatable,
+    ArenaDict,
+    ArenaList,
+)
+
+
+class Node(ArenaAllocatable):
+    def __init__(self, list_type, dict_type):
+        self.children = list_type()
+        self.edges = dict_type()
+
+
+def f(list_type, dict_type, use_arena, iterations=20, fanout=8, depth=5):
+    start = time.perf_counter()
+    for _ in range(iterations):
+        if use_arena:
+            context = Arena([Node, ArenaList, ArenaDict])
+        else:
+            context = contextlib.nullcontext()
+        with context:
+            root = Node(list_type, dict_type)
+            level = [root]
+            for _ in range(depth):
+                next_level = []
+                for parent in level:
+                    for ix in range(fanout):
+                        child = Node(list_type, dict_type)
+                        parent.children.append(child)
+                        parent.edges[ix] = child
+                        next_level.append(child)
+                level = next_level
+            del level, next_level, parent, child, root
+    return (time.perf_counter() - start) / iterations
+
+
+for list_type, dict_type, use_arena in ((list, dict, False),
+                                        (ArenaList, ArenaDict, False),
+                                        (ArenaList, ArenaDict, True)):
+    duration = f(list_type, dict_type, use_arena)
+    print(
+        f'{list_type.__name__:>9}, {dict_type.__name__:>9}, '
+        f'arena={use_arena!s:>5}: {duration * 1e3:.1f} ms',
+    )
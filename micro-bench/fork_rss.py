@@ -0,0 +1,135 @@
+"""Measure how much memory each forked worker copies when it reads a shared graph.
+
+A tree is built in the parent, then each worker forks, runs a collection, walks the
+whole tree, and reports how much its private memory grew. Pages the worker never writes
+stay shared with the parent, so the growth is the cost of the graph per worker.
+
+Plain objects are copied wholesale: the collection writes every object's GC header and
+the walk writes every reference count. Arena instances are not tracked by the GC and
+don't count the references between them. An arena opened with ``backing='shared'`` and
+sealed with ``Arena.seal`` also stops the walk from writing reference counts on Python
+3.12 and later, where sealed objects are immortal. Values stored outside of the arena,
+like the ints here, are still counted.
+
+Usage: fork_rss.py [nodes [workers]]
+"""
+import gc
+import os
+import sys
+
+from quelling_blade.arena_allocatable import ArenaAllocatable, ArenaList, Arena
+
+
+class Plain:
+    def __init__(self, value):
+        self.value = value
+        self.children = []
+
+
+class Slotted:
+    __slots__ = 'value', 'children'
+
+    def __init__(self, value):
+        self.value = value
+        self.children = []
+
+
+class Node(ArenaAllocatable):
+    def __init__(self, value):
+        self.value = value
+        self.children = ArenaList()
+
+
+def build(cls, nodes, fanout=8):
+    root = cls(0)
+    level = [root]
+    count = 1
+    while count < nodes:
+        next_level = []
+        for parent in level:
+            for _ in range(min(fanout, nodes - count)):
+                child = cls(count)
+                parent.children.append(child)
+                next_level.append(child)
+                count += 1
+        level = next_level
+    return root
+
+
+def walk(root):
+    total = 0
+    stack = [root]
+    while stack:
+        node = stack.pop()
+        total += node.value
+        stack.extend(node.children)
+    return total
+
+
+def private_bytes():
+    out = 0
+    with open('/proc/self/smaps_rollup') as f:
+        for line in f:
+            if line.startswith('Private_Dirty:'):
+                out += int(line.split()[1]) * 1024
+    return out
+
+
+def worker(root, fd):
+    before = private_bytes()
+    gc.collect()
+    walk(root)
+    os.write(fd, str(private_bytes() - before).encode())
+    os._exit(0)
+
+
+def measure(root, workers):
+    # Walk the tree in the parent first, like a server which uses the data before
+    # forking. Otherwise the pages of a sealed arena are only mapped by the worker
+    # which reads them, so they are reported as private even though they are shared
+    # through the page cache.
+    walk(root)
+    gc.collect()
+    growth = []
+    for _ in range(workers):
+        read, write = os.pipe()
+        pid = os.fork()
+        if pid == 0:
+            os.close(read)
+            worker(root, write)
+        os.close(write)
+        with os.fdopen(read) as f:
+            growth.append(int(f.read()))
+        os.waitpid(pid, 0)
+    return sum(growth) / len(growth)
+
+
+def run(name, make, workers):
+    root, arena = make()
+    mib = measure(root, workers) / 2 ** 20
+    print(f'{name:>14}: {mib:7.1f} MiB copied per worker')
+    del root
+    if arena is not None:
+        arena.close()
+
+
+nodes = int(sys.argv[1]) if len(sys.argv) > 1 else 500_000
+workers = int(sys.argv[2]) if len(sys.argv) > 2 else 4
+
+
+def in_arena(backing, seal):
+    def make():
+        arena = Arena([Node, ArenaList], backing=backing)
+        arena.__enter__()
+        root = build(Node, nodes)
+        if seal:
+            arena.seal(root)
+        return root, arena
+    return make
+
+
+print(f'{nodes:,} nodes, Python {sys.version.split()[0]}')
+run('plain', lambda: (build(Plain, nodes), None), workers)
+run('__slots__', lambda: (build(Slotted, nodes), None), workers)
+run('arena', in_arena('mmap', False), workers)
+run('sealed arena', in_arena('shared', True), workers)
@@ -0,0 +1,127 @@
+"""Measure a graph frozen with ``Arena.freeze`` against the arena it was built in.
+
+The graph is built the way a loader would: attributes are added after construction,
+some only to some nodes, lists grow one item at a time, and some dict entries are
+replaced. That leaves spare
+capacity in the value arrays, lists, and dicts, and dead arrays which were outgrown.
+Freezing copies the reachable objects into exactly sized storage, in breadth-first
+order from the root.
+
+The frozen arena has no ``stats()``, so its size is the growth of the resident set
+across the call to ``freeze``, which includes its table of references to objects outside
+of the arena. Each walk reads every node once, either by following the children from the
+root or in a random order.
+"""
+import ctypes
+import os
+import random
+import time
+
+from quelling_blade.arena_allocatable import (
+    ArenaAllocatable,
+    ArenaDict,
+    ArenaList,
+    Arena,
+    set_slab_pool_limit,
+)
+
+
+class Node(ArenaAllocatable):
+    def __init__(self, ix):
+        self.ix = ix
+        self.children = ArenaList()
+        self.by_name = ArenaDict()
+
+
+def build(nodes, fanout=8):
+    rng = random.Random(0)
+    root = Node(0)
+    level = [root]
+    count = 1
+    while count < nodes:
+        next_level = []
+        for parent in level:
+            for _ in range(min(rng.randrange(1, 2 * fanout), nodes - count)):
+                child = Node(count)
+                child.weight = count % 7
+                child.name = f'node-{count}'
+                if count % 3 == 0:
+                    # an optional attribute outgrows the values the type has needed
+                    child.label = child.name.upper()
+                parent.children.append(child)
+                parent.by_name[child.name] = child
+                next_level.append(child)
+                count += 1
+            # replace an entry, which leaves a removed entry in the table
+            if parent.children:
+                first = parent.children[0]
+                del parent.by_name[first.name]
+                parent.by_name[first.name] = first
+        rng.shuffle(next_level)
+        level = next_level
+    return root
+
+
+def all_nodes(root):
+    out = [root]
+    for node in out:
+        out.extend(node.children)
+    return out
+
+
+def walk(root):
+    total = 0
+    stack = [root]
+    while stack:
+        node = stack.pop()
+        total += node.weight if node.ix else 0
+        stack.extend(node.children)
+    return total
+
+
+def random_reads(nodes):
+    total = 0
+    for node in nodes:
+        total += node.ix
+    return total
+
+
+def rss():
+    # return the memory freed by the copy's temporary tables to the system first
+    ctypes.CDLL(None).malloc_trim(0)
+    with open('/proc/self/statm') as f:
+        return int(f.read().split()[1]) * os.sysconf('SC_PAGE_SIZE')
+
+
+def best(f, *args, repeat=5):
+    times = []
+    for _ in range(repeat):
+        start = time.perf_counter()
+        f(*args)
+        times.append(time.perf_counter() - start)
+    return min(times)
+
+
+nodes = 300_000
+print(f'{nodes:,} nodes')
+set_slab_pool_limit(0)
+with Arena([Node, ArenaList, ArenaDict], backing='mmap') as arena:
+    root = build(nodes)
+    stats = arena.stats()
+    before = rss()
+    frozen = arena.freeze(root)
+    copy = rss() - before
+    print(
+        f' built: {stats["capacity"] / 2 ** 20:7.1f} MiB reserved, '
+        f'{stats["used"] / 2 ** 20:7.1f} MiB used',
+    )
+    print(f'frozen: {copy / 2 ** 20:7.1f} MiB resident')
+
+    for name, graph in (('built', root), ('frozen', frozen)):
+        order = all_nodes(graph)
+        random.shuffle(order)
+        walk_ns = best(walk, graph) / nodes * 1e9
+        random_ns = best(random_reads, order) / nodes * 1e9
+        print(f'{name:>6}: walk {walk_ns:5.1f} ns/node, random {random_ns:5.1f} ns/node')
+        del order
+    del root
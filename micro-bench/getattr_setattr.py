@@ -0,0 +1,58 @@
+"""Measure attribute access on ``ArenaAllocatable`` instances.
+
+Each case is run both in an arena and globally. "hit" reads or writes an
+instance attribute, "miss" reads a method which is not stored on the instance,
+and "dynamic" uses an attribute name built at runtime, which is not interned.
+"""
+import time
+
+from quelling_blade.arena_allocatable import ArenaAllocatable, Arena
+
+
+class Node(ArenaAllocatable):
+    def __init__(self):
+        self.a = 1
+        self.b = 2
+        self.c = 3
+        self.d = 4
+        self.e = 5
+        self.f = 6
+        self.value = 7
+
+    def method(self):
+        pass
+
+
+def getattr_hit(ob, iterations):
+    for _ in range(iterations):
+        ob.a; ob.c; ob.f
+
+
+def getattr_miss(ob, iterations):
+    for _ in range(iterations):
+        ob.method; ob.method; ob.method
+
+
+def getattr_dynamic(ob, iterations):
+    name = ''.join(['val', 'ue'])
+    for _ in range(iterations):
+        getattr(ob, name); getattr(ob, name); getattr(ob, name)
+
+
+def setattr_hit(ob, iterations):
+    for _ in range(iterations):
+        ob.a = 1; ob.c = 3; ob.f = 6
+
+
+def run(case, iterations=1000000):
+    ob = Node()
+    start = time.perf_counter()
+    case(ob, iterations)
+    return (time.perf_counter() - start) / (iterations * 3) * 1e9
+
+
+for case in (getattr_hit, getattr_miss, getattr_dynamic, setattr_hit):
+    global_ns = run(case)
+    with Arena(Node):
+        arena_ns = run(case)
+    print(f'{case.__name__:>16}: global {global_ns:5.1f} ns, arena {arena_ns:5.1f} ns')
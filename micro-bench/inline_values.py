@@ -0,0 +1,75 @@
+"""Measure small instances, whose attribute values are stored inline.
+
+Instances of a type which has needed a few attributes are allocated with room
+for that many values right after the instance, so constructing one is a single
+allocation and reading an attribute doesn't chase a pointer to a separate
+array. Each case is run both in an arena and globally, for types with a
+different number of attributes. "scattered" reads an attribute from many
+instances in a random order, where each cache miss on a separate value array
+would be paid on top of the miss on the instance.
+"""
+import random
+import time
+
+from quelling_blade.arena_allocatable import ArenaAllocatable, Arena
+
+
+def make_type(width):
+    names = [f'a{ix}' for ix in range(width)]
+    body = '\n'.join(f'    self.{name} = {ix}' for ix, name in enumerate(names))
+    namespace = {}
+    exec(f'def __init__(self):\n{body or "    pass"}\n', namespace)
+    return type(f'Node{width}', (ArenaAllocatable,), namespace)
+
+
+def construct(cls, iterations):
+    start = time.perf_counter()
+    for _ in range(iterations):
+        cls(); cls(); cls()
+    return time.perf_counter() - start
+
+
+def getattr_hit(cls, iterations):
+    ob = cls()
+    start = time.perf_counter()
+    for _ in range(iterations):
+        ob.a0; ob.a0; ob.a0
+    return time.perf_counter() - start
+
+
+def setattr_hit(cls, iterations):
+    ob = cls()
+    start = time.perf_counter()
+    for _ in range(iterations):
+        ob.a0 = 1; ob.a0 = 1; ob.a0 = 1
+    return time.perf_counter() - start
+
+
+def scattered(cls, iterations):
+    obs = [cls() for _ in range(iterations)]
+    random.shuffle(obs)
+    start = time.perf_counter()
+    for _ in range(3):
+        for ob in obs:
+            ob.a0
+    return time.perf_counter() - start
+
+
+def run(case, cls, iterations=200000):
+    # the attribute count hint only grows when an instance runs out of room, so
+    # it takes a couple of instances to learn the full width
+    cls(); cls()
+    global_ns = case(cls, iterations) / (iterations * 3) * 1e9
+    with Arena(cls):
+        arena_ns = case(cls, iterations) / (iterations * 3) * 1e9
+    return global_ns, arena_ns
+
+
+for width in (2, 4, 6):
+    cls = make_type(width)
+    for case in (construct, getattr_hit, setattr_hit, scattered):
+        global_ns, arena_ns = run(case, cls)
+        print(
+            f'{width} attributes {case.__name__:>11}: '
+            f'global {global_ns:5.1f} ns, arena {arena_ns:5.1f} ns',
+        )
@@ -0,0 +1,37 @@
+"""Measure ``setattr`` throughput inside an arena as the number of slabs grows.
+
+Storing a value that lives outside of the arena requires checking whether the
+value is owned by the arena, so the cost of the membership test shows up
+directly in this benchmark. The throughput should stay flat as the slab count
+increases.
+"""
+import time
+
+from quelling_blade.arena_allocatable import ArenaAllocatable, Arena
+
+
+class Node(ArenaAllocatable):
+    pass
+
+
+def f(slab_count, iterations=200000, slab_size=2 ** 12):
+    with Arena(Node, slab_size, growth_factor=1.0):
+        # each instance is allocated out of the arena, allocate enough of them
+        # to fill ``slab_count`` slabs
+        objects_per_slab = slab_size // Node.__basicsize__
+        filler = [Node() for _ in range(objects_per_slab * slab_count)]
+
+        ob = Node()
+        start = time.perf_counter()
+        for _ in range(iterations):
+            ob.a = 1
+        duration = time.perf_counter() - start
+
+        del filler
+        del ob
+
+    return iterations / duration
+
+
+for slab_count in (1, 10, 100, 1000, 10000):
+    print(f'{slab_count:>6} slabs: {f(slab_count):,.0f} setattr/s')
@@ -0,0 +1,284 @@
+"""A pyperf suite comparing ``ArenaAllocatable`` instances against regular classes.
+
+Every case is run for each of these variants of the same class:
+
+- ``plain``: a regular class, with an instance ``__dict__``
+- ``slots``: a regular class with ``__slots__``
+- ``global``: an ``ArenaAllocatable`` subclass, allocated outside of an arena
+- ``arena``: the same ``ArenaAllocatable`` subclass, allocated in an arena
+
+The cases are:
+
+- ``allocate``: construct an instance which sets four attributes
+- ``getattr_hit``: read an attribute stored on the instance
+- ``getattr_miss``: read a class attribute, which is looked for on the instance first
+- ``setattr_hit``: overwrite an attribute stored on the instance
+- ``setattr_miss``: add an attribute the instance doesn't have and delete it again
+- ``property``: read a ``property``, a data descriptor on the type
+- ``method``: look up a method, a non-data descriptor on the type
+- ``escape``: read an attribute which holds another instance; in an arena this gives
+  the instance a reference to its arena until it is released
+- ``teardown``: release a tree of 1,000 instances, including closing the arena
+
+Results are reported per operation. Pass ``-o results.json`` to write pyperf's JSON
+format, and compare two runs, like two releases, with
+``python -m pyperf compare_to old.json new.json``. Pass case names to only run those
+cases, for example ``suite.py getattr_hit setattr_hit``.
+
+This needs ``pyperf``, which is not a dependency of quelling_blade.
+"""
+import contextlib
+
+import pyperf
+
+from quelling_blade.arena_allocatable import ArenaAllocatable, ArenaList, Arena
+
+
+class Plain:
+    kind = 'node'
+
+    def __init__(self, a=0, b=1, c=2, d=3):
+        self.a = a
+        self.b = b
+        self.c = c
+        self.d = d
+
+    @property
+    def prop(self):
+        return self.a
+
+    def method(self):
+        pass
+
+
+class Slotted:
+    __slots__ = 'a', 'b', 'c', 'd', 'child', 'children', 'extra'
+    kind = 'node'
+
+    def __init__(self, a=0, b=1, c=2, d=3):
+        self.a = a
+        self.b = b
+        self.c = c
+        self.d = d
+
+    @property
+    def prop(self):
+        return self.a
+
+    def method(self):
+        pass
+
+
+class Node(ArenaAllocatable):
+    kind = 'node'
+
+    def __init__(self, a=0, b=1, c=2, d=3):
+        self.a = a
+        self.b = b
+        self.c = c
+        self.d = d
+
+    @property
+    def prop(self):
+        return self.a
+
+    def method(self):
+        pass
+
+
+variants = {
+    'plain': (Plain, list),
+    'slots': (Slotted, list),
+    'global': (Node, ArenaList),
+    'arena': (Node, ArenaList),
+}
+
+
+def scope(variant):
+    """The context to create and use instances of ``variant`` in.
+    """
+    if variant == 'arena':
+        return Arena([Node, ArenaList])
+    return contextlib.nullcontext()
+
+
+# each timed loop body repeats the operation this many times
+unroll = 5
+
+
+def allocate(loops, variant):
+    cls, _ = variants[variant]
+    with scope(variant):
+        start = pyperf.perf_counter()
+        for _ in range(loops):
+            cls(); cls(); cls(); cls(); cls()
+        return pyperf.perf_counter() - start
+
+
+def getattr_hit(loops, variant):
+    cls, _ = variants[variant]
+    with scope(variant):
+        ob = cls()
+        start = pyperf.perf_counter()
+        for _ in range(loops):
+            ob.a; ob.b; ob.c; ob.d; ob.a
+        elapsed = pyperf.perf_counter() - start
+        del ob
+    return elapsed
+
+
+def getattr_miss(loops, variant):
+    cls, _ = variants[variant]
+    with scope(variant):
+        ob = cls()
+        start = pyperf.perf_counter()
+        for _ in range(loops):
+            ob.kind; ob.kind; ob.kind; ob.kind; ob.kind
+        elapsed = pyperf.perf_counter() - start
+        del ob
+    return elapsed
+
+
+def setattr_hit(loops, variant):
+    cls, _ = variants[variant]
+    with scope(variant):
+        ob = cls()
+        start = pyperf.perf_counter()
+        for _ in range(loops):
+            ob.a = 1; ob.b = 2; ob.c = 3; ob.d = 4; ob.a = 5
+        elapsed = pyperf.perf_counter() - start
+        del ob
+    return elapsed
+
+
+def setattr_miss(loops, variant):
+    cls, _ = variants[variant]
+    with scope(variant):
+        ob = cls()
+        start = pyperf.perf_counter()
+        for _ in range(loops):
+            ob.extra = 1; del ob.extra
+            ob.extra = 1; del ob.extra
+            ob.extra = 1; del ob.extra
+            ob.extra = 1; del ob.extra
+            ob.extra = 1; del ob.extra
+        elapsed = pyperf.perf_counter() - start
+        del ob
+    return elapsed
+
+
+def property_(loops, variant):
+    cls, _ = variants[variant]
+    with scope(variant):
+        ob = cls()
+        start = pyperf.perf_counter()
+        for _ in range(loops):
+            ob.prop; ob.prop; ob.prop; ob.prop; ob.prop
+        elapsed = pyperf.perf_counter() - start
+        del ob
+    return elapsed
+
+
+def method(loops, variant):
+    cls, _ = variants[variant]
+    with scope(variant):
+        ob = cls()
+        start = pyperf.perf_counter()
+        for _ in range(loops):
+            ob.method; ob.method; ob.method; ob.method; ob.method
+        elapsed = pyperf.perf_counter() - start
+        del ob
+    return elapsed
+
+
+def escape(loops, variant):
+    cls, _ = variants[variant]
+    with scope(variant):
+        ob = cls()
+        ob.child = cls()
+        start = pyperf.perf_counter()
+        for _ in range(loops):
+            ob.child; ob.child; ob.child; ob.child; ob.child
+        elapsed = pyperf.perf_counter() - start
+        del ob
+    return elapsed
+
+
+def build_tree(cls, list_type, nodes, fanout=8):
+    root = cls()
+    root.children = list_type()
+    level = [root]
+    count = 1
+    while count < nodes:
+        next_level = []
+        for parent in level:
+            for _ in range(min(fanout, nodes - count)):
+                child = cls(count)
+                child.children = list_type()
+                parent.children.append(child)
+                next_level.append(child)
+                count += 1
+        level = next_level
+    return root
+
+
+tree_size = 1000
+
+
+def teardown(loops, variant):
+    cls, list_type = variants[variant]
+    elapsed = 0
+    for _ in range(loops):
+        with scope(variant):
+            root = build_tree(cls, list_type, tree_size)
+            start = pyperf.perf_counter()
+            del root
+        elapsed += pyperf.perf_counter() - start
+    return elapsed
+
+
+cases = {
+    'allocate': (allocate, unroll),
+    'getattr_hit': (getattr_hit, unroll),
+    'getattr_miss': (getattr_miss, unroll),
+    'setattr_hit': (setattr_hit, unroll),
+    'setattr_miss': (setattr_miss, unroll),
+    'property': (property_, unroll),
+    'method': (method, unroll),
+    'escape': (escape, unroll),
+    'teardown': (teardown, tree_size),
+}
+
+
+def add_cmdline_args(cmd, args):
+    cmd.extend(args.cases)
+
+
+def main():
+    runner = pyperf.Runner(add_cmdline_args=add_cmdline_args)
+    runner.metadata['description'] = (
+        'ArenaAllocatable against plain and __slots__ classes'
+    )
+    runner.argparser.add_argument(
+        'cases',
+        nargs='*',
+        help=f'the cases to run, all of them by default: {", ".join(cases)}',
+    )
+    args = runner.parse_args()
+    unknown = [case for case in args.cases if case not in cases]
+    if unknown:
+        runner.argparser.error(f'unknown cases: {", ".join(unknown)}')
+
+    for case in args.cases or cases:
+        func, inner_loops = cases[case]
+        for variant in variants:
+            runner.bench_time_func(
+                f'{case}[{variant}]',
+                func,
+                variant,
+                inner_loops=inner_loops,
+            )
+
+
+if __name__ == '__main__':
+    main()
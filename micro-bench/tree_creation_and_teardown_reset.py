@@ -0,0 +1,23 @@
+"""Like ``tree_creation_and_teardown.py``, but reuse a single arena by calling
+``reset()`` between trees instead of creating a new arena each time. The slabs
+are rewound in place, so after the first tree no memory is requested from the
+system.
+"""
+from quelling_blade.arena_allocatable import ArenaAllocatable, Arena
+
+
+def f():
+    with Arena(ArenaAllocatable, 2 ** 32) as arena:
+        for _ in range(10000):
+            root = ob = ArenaAllocatable()
+            for _ in range(20000):
+                new = ArenaAllocatable()
+                ob.a = new
+                ob = new
+            del new
+            del ob
+            del root  # actually release the tree
+            arena.reset()
+
+
+f()
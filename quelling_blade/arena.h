@@ -0,0 +1,1204 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <shared_mutex>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <Python.h>
+#include <absl/container/flat_hash_set.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace qb {
+/** Where the memory for a slab comes from.
+ */
+enum class slab_backing {
+    // memory from `malloc`
+    malloc,
+    // anonymous private mappings with normal pages
+    mmap,
+    // anonymous private mappings backed by huge pages, either with `MAP_HUGETLB` or with
+    // transparent huge pages if no huge pages are reserved
+    hugepage,
+    // a private mapping of a file from `slab_memory::map_file`, these are never pooled
+    file,
+    // anonymous private mappings like `mmap`, which `arena::seal` moves into sealed
+    // memory files; these are never pooled
+    shared,
+};
+
+namespace slab_memory {
+constexpr std::size_t huge_page_size = 1 << 21;
+
+inline std::size_t page_size() {
+    static std::size_t size = sysconf(_SC_PAGESIZE);
+    return size;
+}
+
+inline std::size_t round_up(std::size_t size, std::size_t multiple) {
+    return (size + multiple - 1) / multiple * multiple;
+}
+
+/** The capacity that `allocate` returns for a request of `capacity` bytes: mappings
+    are rounded up to whole pages, or to whole huge pages.
+ */
+inline std::size_t round_capacity(slab_backing backing, std::size_t capacity) {
+    switch (backing) {
+    case slab_backing::mmap:
+    case slab_backing::shared:
+        return round_up(capacity, page_size());
+    case slab_backing::hugepage:
+        return round_up(capacity, huge_page_size);
+    default:
+        return capacity;
+    }
+}
+
+inline std::byte* map_anonymous(std::size_t size, int flags) {
+    void* p = ::mmap(nullptr,
+                     size,
+                     PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | flags,
+                     -1,
+                     0);
+    if (p == MAP_FAILED) {
+        return nullptr;
+    }
+    return reinterpret_cast<std::byte*>(p);
+}
+
+/** Map `size` bytes aligned to the huge page size so that the kernel may back the
+    region with transparent huge pages.
+ */
+inline std::byte* map_transparent_huge(std::size_t size) {
+    std::byte* p = map_anonymous(size + huge_page_size, 0);
+    if (!p) {
+        return nullptr;
+    }
+    auto addr = reinterpret_cast<std::uintptr_t>(p);
+    std::size_t head = round_up(addr, huge_page_size) - addr;
+    if (head) {
+        ::munmap(p, head);
+    }
+    std::size_t tail = huge_page_size - head;
+    if (tail) {
+        ::munmap(p + head + size, tail);
+    }
+    p += head;
+#ifdef MADV_HUGEPAGE
+    // this is only advice, the region is still usable with normal pages
+    ::madvise(p, size, MADV_HUGEPAGE);
+#endif
+    return p;
+}
+
+/** Map all of a file into memory. Writes go to private copies of the pages, which are
+    only read from the file when they are first touched.
+
+    @return The mapping, or nullptr with `errno` set.
+ */
+inline std::byte* map_file(int fd, std::size_t size) {
+    void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+        return nullptr;
+    }
+    return reinterpret_cast<std::byte*>(p);
+}
+
+/** Move the contents of a mapping into a new sealed memory file, and map the file
+    privately over the same address range. The memory reads the same afterwards, but
+    pages which are never written are shared through the page cache, including with
+    forked processes, and no process can change the file. Writes go to private copies of
+    the pages.
+
+    @param p The start of the mapping, which must be page aligned.
+    @param size The size of the mapping, a multiple of the page size.
+    @param used The number of bytes at the start of the mapping to copy, the rest of the
+           file is zero.
+    @return True on success, false with `errno` set. On failure the mapping is left
+            as it was.
+ */
+inline bool move_to_sealed_file(std::byte* p, std::size_t size, std::size_t used) {
+#if defined(MFD_ALLOW_SEALING) && defined(F_ADD_SEALS)
+    int fd = ::memfd_create("quelling_blade", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        return false;
+    }
+    used = std::min(round_up(used, page_size()), size);
+    bool ok = ::ftruncate(fd, size) == 0;
+    std::size_t written = 0;
+    while (ok && written < used) {
+        ssize_t n = ::pwrite(fd, p + written, used - written, written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        ok = n > 0;
+        written += ok ? n : 0;
+    }
+    ok = ok && ::fcntl(fd,
+                       F_ADD_SEALS,
+                       F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == 0;
+    // the mapping holds its own reference to the file
+    ok = ok && ::mmap(p, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) !=
+                   MAP_FAILED;
+    int error = errno;
+    ::close(fd);
+    errno = error;
+    return ok;
+#else
+    errno = ENOSYS;
+    return false;
+#endif
+}
+
+/** Allocate memory for a slab.
+
+    @param backing Where to get the memory from.
+    @param capacity The minimum capacity of the slab.
+    @return The allocation and its actual capacity.
+ */
+inline std::pair<std::byte*, std::size_t> allocate(slab_backing backing,
+                                                   std::size_t capacity) {
+    std::byte* p = nullptr;
+    capacity = round_capacity(backing, capacity);
+    switch (backing) {
+    case slab_backing::malloc:
+        p = reinterpret_cast<std::byte*>(std::malloc(capacity));
+        break;
+    case slab_backing::mmap:
+    case slab_backing::shared:
+        p = map_anonymous(capacity, 0);
+        break;
+    case slab_backing::hugepage:
+#ifdef MAP_HUGETLB
+        p = map_anonymous(capacity, MAP_HUGETLB);
+#endif
+        if (!p) {
+            // no explicit huge pages are available, fall back to transparent huge pages
+            p = map_transparent_huge(capacity);
+        }
+        break;
+    case slab_backing::file:
+        // file slabs are only made with `map_file`
+        break;
+    }
+    if (!p) {
+        throw std::bad_alloc{};
+    }
+    return {p, capacity};
+}
+
+/** Free memory returned by `allocate`.
+ */
+inline void free(slab_backing backing, std::byte* p, std::size_t capacity) {
+    if (backing == slab_backing::malloc) {
+        std::free(p);
+    }
+    else {
+        ::munmap(p, capacity);
+    }
+}
+
+/** Return the physical memory for the whole pages in an allocation to the OS.
+
+    @param lazy Let the kernel reclaim the pages when it needs the memory instead of
+           right away, where supported. Lazily freed pages still count towards the
+           process's resident set until they are reclaimed.
+ */
+inline void release_pages(std::byte* p, std::size_t capacity, bool lazy = true) {
+    std::uintptr_t size = page_size();
+    std::uintptr_t begin = reinterpret_cast<std::uintptr_t>(p);
+    std::uintptr_t end = begin + capacity;
+    // only whole pages which are inside of the allocation may be released
+    begin = (begin + size - 1) & ~(size - 1);
+    end &= ~(size - 1);
+    if (begin < end) {
+        int advice = MADV_DONTNEED;
+#ifdef MADV_FREE
+        if (lazy) {
+            advice = MADV_FREE;
+        }
+#endif
+        ::madvise(reinterpret_cast<void*>(begin), end - begin, advice);
+    }
+}
+}  // namespace slab_memory
+
+/** A process-wide cache of memory from slabs that have been released. New slabs reuse
+    memory from the pool before asking the system for more, which keeps malloc, free, and
+    page faults off of the path of creating and destroying arenas.
+ */
+class slab_pool {
+private:
+    struct entry {
+        std::byte* data;
+        // has the memory been returned to the OS with `madvise`?
+        bool trimmed;
+    };
+
+    using key = std::pair<slab_backing, std::size_t>;
+
+    std::mutex m_mutex;
+    // (backing, capacity) -> pooled allocations
+    std::multimap<key, entry> m_entries;
+    // the total capacity of the pooled allocations
+    std::size_t m_size = 0;
+    // the maximum total capacity of the pooled allocations
+    std::size_t m_limit = 1 << 26;
+
+    slab_pool() = default;
+
+    /** Evict entries until the pool holds at most `limit` bytes. `m_mutex` must be held.
+     */
+    void evict(std::size_t limit) {
+        while (m_size > limit) {
+            // Evict the largest entries first. The entries are ordered by backing, then
+            // by capacity, so the largest one is at the back of some backing's range.
+            auto it = std::prev(m_entries.end());
+            auto back = it;
+            while (true) {
+                back = m_entries.lower_bound(key{back->first.first, 0});
+                if (back == m_entries.begin()) {
+                    break;
+                }
+                --back;
+                if (back->first.second > it->first.second) {
+                    it = back;
+                }
+            }
+            auto [backing, capacity] = it->first;
+            m_size -= capacity;
+            slab_memory::free(backing, it->second.data, capacity);
+            m_entries.erase(it);
+        }
+    }
+
+public:
+    slab_pool(const slab_pool&) = delete;
+
+    /** The process-wide pool. This is never destroyed so that arenas which are freed
+        during interpreter shutdown may still release their slabs.
+     */
+    static slab_pool& instance() {
+        static slab_pool* pool = new slab_pool;
+        return *pool;
+    }
+
+    /** Get an allocation of at least `capacity` bytes.
+
+        @param backing Where the memory should come from.
+        @param capacity The minimum capacity of the allocation.
+        @return The allocation and its actual capacity.
+     */
+    std::pair<std::byte*, std::size_t> acquire(slab_backing backing,
+                                               std::size_t capacity) {
+        // Pooled mappings have whole (huge) page capacities, so compare them with the
+        // capacity that a new mapping would have. Otherwise, a request for 1 MiB could
+        // never reuse a pooled 2 MiB huge page slab.
+        capacity = slab_memory::round_capacity(backing, capacity);
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            // don't hand out allocations more than twice as large as requested
+            auto it = m_entries.lower_bound(key{backing, capacity});
+            if (it != m_entries.end() && it->first.first == backing &&
+                it->first.second / 2 <= capacity) {
+                std::pair<std::byte*, std::size_t> out{it->second.data,
+                                                       it->first.second};
+                m_size -= it->first.second;
+                m_entries.erase(it);
+                return out;
+            }
+        }
+
+        return slab_memory::allocate(backing, capacity);
+    }
+
+    /** Return an allocation to the pool. If the pool is full, the memory is freed.
+
+        @param backing The backing passed to `acquire`.
+        @param data The allocation returned by `acquire`.
+        @param capacity The capacity returned by `acquire`.
+     */
+    void release(slab_backing backing, std::byte* data, std::size_t capacity) {
+        if (backing == slab_backing::file || backing == slab_backing::shared) {
+            slab_memory::free(backing, data, capacity);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            if (m_size + capacity <= m_limit) {
+                m_entries.emplace(key{backing, capacity}, entry{data, false});
+                m_size += capacity;
+                return;
+            }
+        }
+        slab_memory::free(backing, data, capacity);
+    }
+
+    std::size_t limit() {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        return m_limit;
+    }
+
+    /** Set the maximum number of bytes to hold in the pool. If the pool currently holds
+        more than `limit` bytes, allocations are freed until it fits.
+     */
+    void set_limit(std::size_t limit) {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_limit = limit;
+        evict(limit);
+    }
+
+    /** Return the physical memory of the pooled allocations to the OS without giving up
+        the address space. The allocations remain in the pool and may be reused, but will
+        page fault again when touched.
+
+        The pool never trims itself. It can't tell when the process goes idle without a
+        background thread that would wake the process up, so callers trim explicitly with
+        `quelling_blade.trim_slab_pool()`.
+     */
+    void trim() {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        for (auto& [k, e] : m_entries) {
+            if (!e.trimmed) {
+                slab_memory::release_pages(e.data, k.second);
+                e.trimmed = true;
+            }
+        }
+    }
+};
+
+class slab {
+private:
+    struct pool_deleter {
+        slab_backing backing;
+        std::size_t capacity;
+
+        void operator()(std::byte* p) {
+            slab_pool::instance().release(backing, p, capacity);
+        }
+    };
+
+    std::unique_ptr<std::byte, pool_deleter> m_data;
+    // The number of bytes used. This is only modified with atomic operations when the
+    // slab belongs to a concurrent arena, where it may run past the capacity once the
+    // slab is full.
+    std::atomic<std::size_t> m_size;
+    std::size_t m_cap;
+
+    static std::unique_ptr<std::byte, pool_deleter> allocate_slab(slab_backing backing,
+                                                                  std::size_t cap) {
+        auto [p, actual_cap] = slab_pool::instance().acquire(backing, cap);
+        return std::unique_ptr<std::byte, pool_deleter>{p,
+                                                        pool_deleter{backing,
+                                                                     actual_cap}};
+    }
+
+public:
+    /** The unit that concurrent allocations are rounded up to. Every object in an arena
+        is pointer aligned, so this wastes nothing for Python objects.
+     */
+    static constexpr std::size_t granule = alignof(void*);
+
+    slab(slab_backing backing, std::size_t cap)
+        : m_data(allocate_slab(backing, cap)),
+          m_size(0),
+          m_cap(m_data.get_deleter().capacity) {}
+
+    /** Take ownership of memory which was allocated and filled outside of the pool, like
+        a mapped file. The slab starts full, and the memory is freed, not pooled, when
+        the slab is destroyed.
+     */
+    slab(slab_backing backing, std::byte* data, std::size_t cap)
+        : m_data(data, pool_deleter{backing, cap}), m_size(cap), m_cap(cap) {}
+
+    slab(const slab&) = delete;
+
+    /** Move a slab out of an arena. This must not race with allocations from `other`.
+     */
+    slab(slab&& other) noexcept
+        : m_data(std::move(other.m_data)),
+          m_size(other.m_size.load(std::memory_order_relaxed)),
+          m_cap(other.m_cap) {}
+
+    std::size_t capacity() const {
+        return m_cap;
+    }
+
+    slab_backing backing() const {
+        return m_data.get_deleter().backing;
+    }
+
+    std::byte* data() const {
+        return m_data.get();
+    }
+
+    bool contains(const std::byte* p) const {
+        return std::greater_equal<const std::byte*>{}(p, data()) &&
+               std::less<const std::byte*>{}(p, data() + capacity());
+    }
+
+    /** The number of bytes allocated out of the slab, including alignment padding.
+     */
+    std::size_t used() const {
+        return std::min(m_size.load(std::memory_order_relaxed), m_cap);
+    }
+
+    /** Return the physical memory for every page of the slab which does not overlap one
+        of the allocations in `[first, last)` to the OS right away.
+
+        @param first The first `[begin, end)` range of the allocations to keep, sorted by
+               `begin`.
+        @param last The end of the ranges.
+     */
+    template<typename It>
+    void release_pages_except(It first, It last) {
+        std::byte* unused = data();
+        for (; first != last; ++first) {
+            if (!contains(first->first)) {
+                continue;
+            }
+            slab_memory::release_pages(unused, first->first - unused, false);
+            unused = std::max(unused, const_cast<std::byte*>(first->second));
+        }
+        slab_memory::release_pages(unused, data() + capacity() - unused, false);
+    }
+
+    /** Mark all of the memory in the slab as unused.
+     */
+    void reset() {
+        m_size.store(0, std::memory_order_relaxed);
+    }
+
+    std::byte* try_allocate(std::size_t size, std::size_t align) {
+        std::size_t used = m_size.load(std::memory_order_relaxed);
+        std::size_t align_padding = (align - (used % align)) % align;
+        if (used + align_padding + size > capacity()) {
+            return nullptr;
+        }
+        m_size.store(used + align_padding + size, std::memory_order_relaxed);
+        return m_data.get() + used + align_padding;
+    }
+
+    /** A version of `try_allocate` which may be called from many threads at once.
+
+        Allocations which need at most `granule` alignment claim their memory with a
+        single fetch-and-add. The size is rounded up to a multiple of `granule` so that
+        the bump pointer stays aligned for the next allocation. A fetch-and-add which
+        overflows the slab leaves the bump pointer past the end, so every later
+        allocation from this slab fails as well. Larger alignments use a compare and swap
+        loop.
+     */
+    std::byte* try_allocate_concurrent(std::size_t size, std::size_t align) {
+        size = slab_memory::round_up(size, granule);
+        if (align <= granule) {
+            std::size_t start = m_size.fetch_add(size, std::memory_order_relaxed);
+            if (start + size > capacity()) {
+                return nullptr;
+            }
+            return m_data.get() + start;
+        }
+
+        std::size_t used = m_size.load(std::memory_order_relaxed);
+        std::size_t start;
+        do {
+            start = slab_memory::round_up(used, align);
+            if (start + size > capacity()) {
+                return nullptr;
+            }
+        } while (!m_size.compare_exchange_weak(used,
+                                               start + size,
+                                               std::memory_order_relaxed));
+        return m_data.get() + start;
+    }
+};
+
+class arena : public std::enable_shared_from_this<arena> {
+public:
+    /** A `[begin, end)` address range in the arena.
+     */
+    using slab_range = std::pair<const std::byte*, const std::byte*>;
+
+    template<typename T>
+    class allocator {
+    private:
+        arena* m_arena;
+
+    public:
+        using value_type = T;
+
+        explicit allocator(arena* arena) : m_arena(arena) {}
+
+        template<typename U>
+        allocator(const allocator<U>& cpfrom) : m_arena(cpfrom.get_arena()) {}
+
+        T* allocate(std::size_t count) {
+            if (!m_arena) {
+                // CPython's allocator pools small blocks by size class; the GIL must be
+                // held
+                void* out = (count > PY_SSIZE_T_MAX / sizeof(T)) ?
+                                nullptr :
+                                PyMem_Malloc(count * sizeof(T));
+                if (!out) {
+                    throw std::bad_alloc{};
+                }
+                return static_cast<T*>(out);
+            }
+            return reinterpret_cast<T*>(m_arena->allocate(count * sizeof(T), alignof(T)));
+        }
+
+        void deallocate(T* ptr, std::size_t) {
+            if (!m_arena) {
+                PyMem_Free(ptr);
+            }
+        }
+
+        arena* get_arena() const {
+            return m_arena;
+        }
+
+        template<typename U>
+        bool operator==(const allocator<U>& other) const {
+            return m_arena == other.get_arena();
+        }
+
+        template<typename U>
+        bool operator!=(const allocator<U>& other) const {
+            return !(*this == other);
+        }
+    };
+
+private:
+    /** A set of strong references to the Python objects which are owned by objects in
+        the arena. Each distinct object is referenced once no matter how many times it is
+        added, so the memory and teardown cost scale with the number of distinct objects
+        instead of the number of attribute stores.
+
+        The table is allocated out of the arena itself.
+     */
+    class external_reference_set {
+    private:
+        using set_type = absl::flat_hash_set<PyObject*,
+                                             absl::Hash<PyObject*>,
+                                             std::equal_to<PyObject*>,
+                                             allocator<PyObject*>>;
+
+        set_type m_set;
+        // The most recently added object. Storing the same object repeatedly is common,
+        // e.g. an attribute name in a loop, and can skip the hash table entirely.
+        PyObject* m_last = nullptr;
+
+    public:
+        explicit external_reference_set(arena* arena)
+            : m_set(0,
+                    set_type::hasher{},
+                    set_type::key_equal{},
+                    allocator<PyObject*>{arena}) {}
+
+        external_reference_set(const external_reference_set&) = delete;
+
+        ~external_reference_set() {
+            for (PyObject* ob : m_set) {
+                Py_DECREF(ob);
+            }
+        }
+
+        void add(PyObject* ob) {
+            if (ob == m_last) {
+                return;
+            }
+            if (m_set.insert(ob).second) {
+                Py_INCREF(ob);
+            }
+            m_last = ob;
+        }
+
+        std::size_t size() const {
+            return m_set.size();
+        }
+
+        int traverse(visitproc visit, void* arg) const {
+            for (PyObject* ob : m_set) {
+                Py_VISIT(ob);
+            }
+            return 0;
+        }
+
+        /** Remove all of the references from the set without releasing them. The set
+            drops its table without deallocating it, so this must be called before the
+            arena's memory is reused.
+
+            @return The references that were in the set, which the caller now owns.
+         */
+        std::vector<PyObject*> take() {
+            std::vector<PyObject*> out(m_set.begin(), m_set.end());
+            m_set = set_type(0,
+                             m_set.hash_function(),
+                             m_set.key_eq(),
+                             m_set.get_allocator());
+            m_last = nullptr;
+            return out;
+        }
+    };
+
+    slab_backing m_backing;
+    double m_growth_factor;
+    std::size_t m_max_slab_size;
+    bool m_concurrent;
+    // objects in a frozen arena may not be modified, see `freeze`
+    bool m_frozen = false;
+    // The active slab, `&m_slabs[m_active]`. This is published with release ordering so
+    // that threads which observe a new slab also observe its construction.
+    std::atomic<slab*> m_current;
+    // The address ranges of all of the slabs, sorted by start address. This allows
+    // `contains` to be answered with a binary search instead of a scan over every slab.
+    std::vector<slab_range> m_slab_index;
+    // The regular slabs owned by this arena, in the order they were added. All new
+    // allocations are made from the active slab unless they are too large to fit in a
+    // regular slab. The active slab is the last slab unless the arena has been reset.
+    // Slabs are never moved, so other threads may keep allocating from the active slab
+    // while a new one is added.
+    std::deque<slab> m_slabs;
+    std::size_t m_active = 0;
+    // Slabs which each hold a single allocation which was too large for a regular slab.
+    std::deque<slab> m_oversize_slabs;
+    // In a concurrent arena, this is held exclusively to add slabs and shared to read
+    // the slab index.
+    mutable std::shared_mutex m_mutex;
+    mutable std::mutex m_external_references_mutex;
+    // Counters for `stats`. The allocation counters are only maintained in arenas which
+    // are not concurrent, where they can be updated without atomics.
+    std::size_t m_allocations = 0;
+    std::size_t m_requested_bytes = 0;
+    // Like a slab's size, this is only modified with atomic operations in a concurrent
+    // arena, where native code may count objects from several threads.
+    std::atomic<std::size_t> m_objects{0};
+    // Python objects allocated in the arena which have been referenced from outside of
+    // it, only recorded once `track_roots` is called
+    bool m_track_roots = false;
+    std::vector<PyObject*> m_roots;
+    // Python objects allocated in the arena which may still have weak references,
+    // see `add_weakly_referenced`.
+    absl::flat_hash_set<PyObject*> m_weakly_referenced;
+    // Python objects allocated in the arena which have weak references, and which the
+    // arena holds a reference to so that the weak references keep resolving, see `hold`
+    bool m_holding = false;
+    absl::flat_hash_set<PyObject*> m_held;
+    external_reference_set m_external_references;
+
+    static void index_slab(std::vector<slab_range>& index, const slab& s) {
+        slab_range range{s.data(), s.data() + s.capacity()};
+        auto it = std::upper_bound(index.begin(),
+                                   index.end(),
+                                   range,
+                                   [](const slab_range& a, const slab_range& b) {
+                                       return std::less<const std::byte*>{}(a.first,
+                                                                            b.first);
+                                   });
+        index.insert(it, range);
+    }
+
+    static std::vector<slab_range> initialize_slab_index(const std::deque<slab>& slabs) {
+        std::vector<slab_range> out;
+        for (const slab& s : slabs) {
+            index_slab(out, s);
+        }
+        return out;
+    }
+
+    void add_slab(std::size_t capacity) {
+        m_slabs.emplace_back(m_backing, capacity);
+        index_slab(m_slab_index, m_slabs.back());
+        m_active = m_slabs.size() - 1;
+        m_current.store(&m_slabs.back(), std::memory_order_release);
+    }
+
+    /** Add a slab which holds exactly one allocation of `size` bytes. The active slab
+        does not change. In a concurrent arena, `m_mutex` must be held exclusively.
+     */
+    std::byte* allocate_oversize(std::size_t size, std::size_t align) {
+        m_oversize_slabs.emplace_back(m_backing, size);
+        index_slab(m_slab_index, m_oversize_slabs.back());
+        std::byte* out = m_oversize_slabs.back().try_allocate(size, align);
+        assert(out);
+        return out;
+    }
+
+    /** The capacity of the next regular slab to add.
+     */
+    std::size_t next_slab_capacity() const {
+        std::size_t capacity = m_slabs.back().capacity();
+        if (capacity >= m_max_slab_size) {
+            return capacity;
+        }
+        double grown = capacity * m_growth_factor;
+        if (grown >= static_cast<double>(m_max_slab_size)) {
+            return m_max_slab_size;
+        }
+        return std::max(capacity, static_cast<std::size_t>(grown));
+    }
+
+    /** Move on from the active slab after it failed to hold an allocation of `size`
+        bytes. After a reset, this steps through the slabs which were already allocated
+        before adding new ones. In a concurrent arena, `m_mutex` must be held exclusively.
+
+        @return false if the allocation is too large for a new regular slab.
+     */
+    bool advance(std::size_t size) {
+        if (m_active + 1 < m_slabs.size()) {
+            ++m_active;
+            m_current.store(&m_slabs[m_active], std::memory_order_release);
+            return true;
+        }
+        std::size_t capacity = next_slab_capacity();
+        if (size > capacity) {
+            return false;
+        }
+        add_slab(capacity);
+        return true;
+    }
+
+    std::byte* allocate_concurrent(std::size_t size, std::size_t align) {
+        while (true) {
+            slab* current = m_current.load(std::memory_order_acquire);
+            if (std::byte* out = current->try_allocate_concurrent(size, align)) {
+                return out;
+            }
+            std::unique_lock<std::shared_mutex> lock(m_mutex);
+            // another thread may have moved past the full slab while we were waiting
+            // for the lock, in which case we just retry on the new active slab
+            if (m_current.load(std::memory_order_relaxed) == current && !advance(size)) {
+                return allocate_oversize(size, align);
+            }
+        }
+    }
+
+    bool index_contains(const std::byte* p) const {
+        // find the last slab which starts at or before `p`
+        auto it = std::upper_bound(m_slab_index.begin(),
+                                   m_slab_index.end(),
+                                   p,
+                                   [](const std::byte* p, const slab_range& range) {
+                                       return std::less<const std::byte*>{}(p,
+                                                                            range.first);
+                                   });
+        if (it == m_slab_index.begin()) {
+            return false;
+        }
+        --it;
+        return std::less<const std::byte*>{}(p, it->second);
+    }
+
+    bool index_contains_concurrent(const std::byte* p) const {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        return index_contains(p);
+    }
+
+    void add_external_reference_concurrent(PyObject* ob) {
+        std::lock_guard<std::mutex> guard(m_external_references_mutex);
+        m_external_references.add(ob);
+    }
+
+public:
+    /** A summary of the memory used by an arena.
+     */
+    struct statistics {
+        // the number of regular slabs
+        std::size_t slabs = 0;
+        // the number of slabs holding a single allocation which was too large for a
+        // regular slab
+        std::size_t oversize_slabs = 0;
+        // the total capacity of all of the slabs, in bytes
+        std::size_t capacity = 0;
+        // the number of bytes allocated out of the slabs, including alignment padding
+        std::size_t used = 0;
+        // the number of bytes requested by calls to `allocate`, zero in a concurrent
+        // arena
+        std::size_t requested = 0;
+        // the number of calls to `allocate`, zero in a concurrent arena
+        std::size_t allocations = 0;
+        // the number of objects reported with `count_objects`
+        std::size_t objects = 0;
+        // the number of distinct external references
+        std::size_t external_references = 0;
+    };
+
+    /** A bump allocator which carves chunks out of a concurrent arena for the use of a
+        single thread. The shared bump pointer is only touched once per chunk instead of
+        once per allocation, so threads allocating from the same arena do not contend on
+        it.
+
+        A local allocator must not be used by more than one thread at a time and must
+        not outlive its arena. The unused tail of each chunk is wasted.
+     */
+    class local_allocator {
+    private:
+        arena* m_arena;
+        std::size_t m_chunk_size;
+        std::byte* m_next = nullptr;
+        std::byte* m_end = nullptr;
+
+        std::byte* refill(std::size_t size, std::size_t align) {
+            if (size + align > m_chunk_size / 4) {
+                // don't throw away most of a chunk for a large allocation
+                return m_arena->allocate(size, align);
+            }
+            m_next = m_arena->allocate(m_chunk_size, slab::granule);
+            m_end = m_next + m_chunk_size;
+            return allocate(size, align);
+        }
+
+    public:
+        explicit local_allocator(arena& arena, std::size_t chunk_size = 1 << 14)
+            : m_arena(&arena), m_chunk_size(chunk_size) {}
+
+        local_allocator(const local_allocator&) = delete;
+
+        std::byte* allocate(std::size_t size, std::size_t align) {
+            auto next = reinterpret_cast<std::uintptr_t>(m_next);
+            std::uintptr_t start = (next + align - 1) & ~(align - 1);
+            if (start + size > reinterpret_cast<std::uintptr_t>(m_end)) {
+                return refill(size, align);
+            }
+            m_next = reinterpret_cast<std::byte*>(start + size);
+            return reinterpret_cast<std::byte*>(start);
+        }
+    };
+
+    arena(arena&&) = delete;
+
+    /** Construct an arena.
+
+        @param backing Where the memory for the slabs comes from.
+        @param slab_size The capacity of the first slab.
+        @param growth_factor The factor to grow each new slab's capacity by.
+        @param max_slab_size The maximum capacity of a regular slab. Allocations larger
+               than the next slab are given their own dedicated slab.
+        @param concurrent Allow `allocate`, `contains`, and `add_external_reference` to
+               be called from multiple threads at once.
+     */
+    arena(slab_backing backing,
+          std::size_t slab_size,
+          double growth_factor,
+          std::size_t max_slab_size,
+          bool concurrent = false)
+        : m_backing(backing),
+          m_growth_factor(growth_factor),
+          m_max_slab_size(std::max(slab_size, max_slab_size)),
+          m_concurrent(concurrent),
+          m_current(nullptr),
+          m_external_references(this) {
+        add_slab(slab_size);
+    }
+
+    ~arena() {
+        clear_weak_references();
+    }
+
+    bool concurrent() const {
+        return m_concurrent;
+    }
+
+    slab_backing backing() const {
+        return m_backing;
+    }
+
+    /** Mark the objects in the arena as immutable. The arena only records this, the
+        objects check it before they are modified.
+     */
+    void freeze() {
+        m_frozen = true;
+    }
+
+    bool frozen() const {
+        return m_frozen;
+    }
+
+    bool contains(const std::byte* p) const {
+        // fast path: most lookups are for objects in the active slab
+        if (m_current.load(std::memory_order_acquire)->contains(p)) {
+            return true;
+        }
+        if (m_concurrent) {
+            return index_contains_concurrent(p);
+        }
+        return index_contains(p);
+    }
+
+    std::byte* allocate(std::size_t size, std::size_t align) {
+        if (m_concurrent) {
+            return allocate_concurrent(size, align);
+        }
+        ++m_allocations;
+        m_requested_bytes += size;
+        while (true) {
+            slab* current = m_current.load(std::memory_order_relaxed);
+            if (std::byte* out = current->try_allocate(size, align)) {
+                return out;
+            }
+            if (!advance(size)) {
+                return allocate_oversize(size, align);
+            }
+        }
+    }
+
+    /** Clear the weak references into the arena, release the external references, and
+        rewind the slabs so that the memory can be reused by new allocations. Regular
+        slabs are kept, oversize slabs are returned to the slab pool.
+
+        The caller must ensure that none of the objects allocated in the arena are
+        reachable. This is not thread-safe, even in a concurrent arena.
+     */
+    void reset() {
+        clear_weak_references();
+        std::vector<PyObject*> references = m_external_references.take();
+        m_oversize_slabs.clear();
+        for (slab& s : m_slabs) {
+            s.reset();
+        }
+        m_active = 0;
+        m_current.store(&m_slabs.front(), std::memory_order_relaxed);
+        m_slab_index = initialize_slab_index(m_slabs);
+        m_allocations = 0;
+        m_requested_bytes = 0;
+        m_objects.store(0, std::memory_order_relaxed);
+        m_roots.clear();
+
+        // release the references last: this may run arbitrary code which allocates new
+        // objects in the arena
+        for (PyObject* ob : references) {
+            Py_DECREF(ob);
+        }
+    }
+
+    /** Record that `count` objects were allocated in the arena. The arena only keeps
+        the count for `stats`; it doesn't know where the objects start.
+     */
+    void count_objects(std::size_t count) {
+        if (m_concurrent) {
+            m_objects.fetch_add(count, std::memory_order_relaxed);
+        }
+        else {
+            m_objects.store(m_objects.load(std::memory_order_relaxed) + count,
+                            std::memory_order_relaxed);
+        }
+    }
+
+    /** Call `visit` on each of the external references, like a `tp_traverse` function.
+     */
+    int traverse_external_references(visitproc visit, void* arg) const {
+        if (m_concurrent) {
+            std::lock_guard<std::mutex> guard(m_external_references_mutex);
+            return m_external_references.traverse(visit, arg);
+        }
+        return m_external_references.traverse(visit, arg);
+    }
+
+    /** Start recording the objects passed to `add_root`.
+     */
+    void track_roots() {
+        m_track_roots = true;
+    }
+
+    bool tracks_roots() const {
+        return m_track_roots;
+    }
+
+    /** Record an object allocated in the arena which is referenced from outside of it.
+        This does nothing unless `track_roots` was called.
+     */
+    void add_root(PyObject* ob) {
+        if (m_track_roots) {
+            m_roots.push_back(ob);
+        }
+    }
+
+    const std::vector<PyObject*>& roots() const {
+        return m_roots;
+    }
+
+    /** Record that `ob`, a Python object allocated in the arena, still has weak
+        references after its last reference from outside of the arena was released. The
+        weak references are cleared when the arena is destroyed or reset. The GIL must be
+        held.
+     */
+    void add_weakly_referenced(PyObject* ob) {
+        m_weakly_referenced.insert(ob);
+    }
+
+    /** Start holding a reference to the weakly referenced objects, see `hold`. The
+        owner of the arena does this while the arena is open and can take new objects.
+     */
+    void start_holding() {
+        m_holding = true;
+    }
+
+    bool holding() const {
+        return m_holding;
+    }
+
+    /** Record that the arena holds a reference to `ob`, a Python object allocated in the
+        arena which has weak references, in place of the last reference from outside of
+        the arena. The caller counts the reference in the object. The GIL must be held.
+     */
+    void hold(PyObject* ob) {
+        m_held.insert(ob);
+    }
+
+    const absl::flat_hash_set<PyObject*>& held() const {
+        return m_held;
+    }
+
+    /** Take the objects recorded with `hold`, whose references the caller must release.
+
+        @param stop Stop holding new objects as well.
+     */
+    absl::flat_hash_set<PyObject*> take_held(bool stop) {
+        if (stop) {
+            m_holding = false;
+        }
+        absl::flat_hash_set<PyObject*> out = std::move(m_held);
+        m_held.clear();
+        return out;
+    }
+
+    /** Clear the weak references to the objects recorded with `add_weakly_referenced`,
+        calling their callbacks. Objects which have been referenced from outside of the
+        arena again are skipped. The GIL must be held.
+
+        Weak references only resolve to objects with a non-zero reference count, so the
+        callbacks cannot reach any of the other objects being cleared.
+     */
+    void clear_weak_references() {
+        while (!m_weakly_referenced.empty()) {
+            // a callback may release another object with weak references, which is
+            // recorded in the new set
+            absl::flat_hash_set<PyObject*> objects = std::move(m_weakly_referenced);
+            m_weakly_referenced.clear();
+            for (PyObject* ob : objects) {
+                if (Py_REFCNT(ob) == 0) {
+                    PyObject_ClearWeakRefs(ob);
+                }
+            }
+        }
+    }
+
+    /** Add a slab which was filled outside of the arena, like a mapped file, as an
+        oversize slab. Nothing more is allocated out of it, and it is released with the
+        rest of the arena, but the objects in it are part of the arena. This is not
+        thread-safe, even in a concurrent arena.
+     */
+    void adopt(slab&& s) {
+        m_oversize_slabs.push_back(std::move(s));
+        index_slab(m_slab_index, m_oversize_slabs.back());
+    }
+
+    /** Move the memory of every slab with `slab_backing::shared` into a sealed memory
+        file with `slab_memory::move_to_sealed_file`. Objects stay at the same addresses.
+        Memory allocated afterwards is private until the arena is sealed again. This is
+        not thread-safe, even in a concurrent arena.
+
+        @throw std::system_error if a slab could not be moved. The slabs which were
+               already moved stay sealed.
+     */
+    void seal() {
+        for (std::deque<slab>* slabs : {&m_slabs, &m_oversize_slabs}) {
+            for (slab& s : *slabs) {
+                if (s.backing() == slab_backing::shared &&
+                    !slab_memory::move_to_sealed_file(s.data(), s.capacity(), s.used())) {
+                    throw std::system_error(errno,
+                                            std::generic_category(),
+                                            "failed to seal arena memory");
+                }
+            }
+        }
+    }
+
+    std::size_t slab_count() const {
+        return m_slabs.size() + m_oversize_slabs.size();
+    }
+
+    /** Move the slabs which contain any of the allocations in `keep` out of the arena.
+        This keeps a few allocations alive without the rest of the arena. The arena must
+        not be used afterwards, except to destroy it.
+
+        @param keep The `[begin, end)` ranges of the allocations to keep, sorted by
+               `begin`.
+        @param out The vector to move the slabs into. This must already have the
+               capacity for `slab_count()` more slabs so that this cannot throw.
+     */
+    void pin(const std::vector<slab_range>& keep, std::vector<slab>& out) {
+        for (std::deque<slab>* slabs : {&m_slabs, &m_oversize_slabs}) {
+            for (slab& s : *slabs) {
+                auto before = [](const slab_range& range, const std::byte* p) {
+                    return std::less<const std::byte*>{}(range.first, p);
+                };
+                auto it = std::lower_bound(keep.begin(), keep.end(), s.data(), before);
+                if (it != keep.end() && s.contains(it->first)) {
+                    out.push_back(std::move(s));
+                }
+            }
+        }
+    }
+
+    /** Summarize the memory used by the arena since it was constructed or last reset.
+        This is linear in the number of slabs.
+
+        In a concurrent arena, the figures are read one at a time while other threads
+        may keep allocating, so they are each exact but not necessarily consistent with
+        each other.
+     */
+    statistics stats() const {
+        std::shared_lock<std::shared_mutex> lock(m_mutex, std::defer_lock);
+        if (m_concurrent) {
+            lock.lock();
+        }
+        statistics out;
+        out.slabs = m_slabs.size();
+        out.oversize_slabs = m_oversize_slabs.size();
+        for (const std::deque<slab>* slabs : {&m_slabs, &m_oversize_slabs}) {
+            for (const slab& s : *slabs) {
+                out.capacity += s.capacity();
+                out.used += s.used();
+            }
+        }
+        out.requested = m_requested_bytes;
+        out.allocations = m_allocations;
+        out.objects = m_objects.load(std::memory_order_relaxed);
+        if (m_concurrent) {
+            std::lock_guard<std::mutex> guard(m_external_references_mutex);
+            out.external_references = m_external_references.size();
+        }
+        else {
+            out.external_references = m_external_references.size();
+        }
+        return out;
+    }
+
+    void add_external_reference(PyObject* ob) {
+        if (m_concurrent) {
+            add_external_reference_concurrent(ob);
+        }
+        else {
+            m_external_references.add(ob);
+        }
+    }
+};
+}  // namespace qb
@@ -1,437 +1,160 @@
-#include <deque>
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
 #include <functional>
+#include <limits>
 #include <memory>
-#include <sstream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 #include <Python.h>
 #include <absl/container/flat_hash_map.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
-namespace qb {
-template<typename T>
-class owned_ref;
-
-/** A type that explicitly indicates that a Python object is a borrowed
-    reference. This is implicitly convertible from a regular `PyObject*` or a
-    `owned_ref`. This type may be used as a Python object parameter like:
-
-    \code
-    int f(borrowed_ref a, borrowed_ref b);
-    \endcode
-
-    This allows calling this function with either `owned_ref` or
-    `PyObject*`.
-
-    @note A `borrowed_ref` may still hold a value of `nullptr`.
- */
-template<typename T = PyObject>
-class borrowed_ref {
-private:
-    T* m_ref;
-
-public:
-    constexpr borrowed_ref() : m_ref(nullptr) {}
-    constexpr borrowed_ref(std::nullptr_t) : m_ref(nullptr) {}
-    constexpr borrowed_ref(T* ref) : m_ref(ref) {}
-    constexpr borrowed_ref(const owned_ref<T>& ref) : m_ref(ref.get()) {}
-
-    constexpr T* get() const {
-        return m_ref;
-    }
-
-    explicit constexpr operator T*() const {
-        return m_ref;
-    }
-
-    // use an enable_if to resolve the ambiguous dispatch when T is PyObject
-    template<typename U = T,
-             typename = std::enable_if_t<!std::is_same<U, PyObject>::value>>
-    explicit operator PyObject*() const {
-        return reinterpret_cast<PyObject*>(m_ref);
-    }
-
-    T& operator*() const {
-        return *m_ref;
-    }
-
-    T* operator->() const {
-        return m_ref;
-    }
-
-    explicit operator bool() const {
-        return m_ref;
-    }
+#include "quelling_blade/arena.h"
+#include "quelling_blade/object_ref.h"
+#include "quelling_blade/shape.h"
 
-    bool operator==(borrowed_ref<> other) const {
-        return m_ref == other.get();
-    }
+namespace qb {
+/** A cache of `_PyType_Lookup` results for an `ArenaAllocatable` type.
 
-    bool operator!=(borrowed_ref<> other) const {
-        return m_ref != other.get();
-    }
-};
+    Every attribute access must check the type for a descriptor before looking at the
+    instance, which means walking the dicts of the MRO. Entries are keyed on the
+    attribute name and the type's version tag, which CPython changes whenever the type or
+    any of its bases are modified, so a stale entry is never used.
 
-/** An RAII wrapper for ensuring an object is cleaned up in a given scope.
+    Only exact, interned `str` keys are cached. The cache owns a reference to each key so
+    that the address cannot be reused by a different string while the entry exists.
  */
-template<typename T = PyObject>
-class owned_ref {
-private:
-    T* m_ref;
-
-public:
-    /** The type of the underlying pointer.
-     */
-    using element_type = T;
-
-    /** Default construct a scoped ref to a `nullptr`.
-     */
-    constexpr owned_ref() : m_ref(nullptr) {}
-
-    constexpr owned_ref(std::nullptr_t) : m_ref(nullptr) {}
-
-    /** Manage a new reference. `ref` should not be used outside of the
-        `owned_ref`.
-
-        @param ref The reference to manage
-     */
-    constexpr explicit owned_ref(T* ref) : m_ref(ref) {}
-
-    constexpr owned_ref(const owned_ref& cpfrom) : m_ref(cpfrom.m_ref) {
-        Py_XINCREF(m_ref);
-    }
-
-    constexpr owned_ref(owned_ref&& mvfrom) noexcept : m_ref(mvfrom.m_ref) {
-        mvfrom.m_ref = nullptr;
-    }
-
-    constexpr owned_ref& operator=(const owned_ref& cpfrom) {
-        // we need to incref before we decref to support self assignment
-        Py_XINCREF(cpfrom.m_ref);
-        Py_XDECREF(m_ref);
-        m_ref = cpfrom.m_ref;
-        return *this;
-    }
-
-    constexpr owned_ref& operator=(owned_ref&& mvfrom) noexcept {
-        std::swap(m_ref, mvfrom.m_ref);
-        return *this;
-    }
-
-    /** Create a scoped ref that is a new reference to `ref`.
-
-        @param ref The Python object to create a new managed reference to.
-     */
-    constexpr static owned_ref new_reference(borrowed_ref<T> ref) {
-        Py_INCREF(ref.get());
-        return owned_ref{ref.get()};
-    }
-
-    /** Create a scoped ref that is a new reference to `ref` if `ref` is non-null.
-
-        @param ref The Python object to create a new managed reference to. If `ref`
-               is `nullptr`, then the resulting object just holds `nullptr` also.
-     */
-    constexpr static owned_ref xnew_reference(borrowed_ref<T> ref) {
-        Py_XINCREF(ref.get());
-        return owned_ref{ref.get()};
-    }
-
-    /** Decref the managed pointer if it is not `nullptr`.
-     */
-    ~owned_ref() {
-        Py_XDECREF(m_ref);
-    }
-
-    /** Return the underlying pointer and invalidate the `owned_ref`.
-
-        This allows the reference to "escape" the current scope.
-
-        @return The underlying pointer.
-        @see get
-     */
-    T* escape() && {
-        T* ret = m_ref;
-        m_ref = nullptr;
-        return ret;
-    }
-
-    /** Get the underlying managed pointer.
-
-        @return The pointer managed by this `owned_ref`.
-        @see escape
-     */
-    constexpr T* get() const {
-        return m_ref;
-    }
-
-    explicit operator T*() const {
-        return m_ref;
-    }
-
-    // use an enable_if to resolve the ambiguous dispatch when T is PyObject
-    template<typename U = T,
-             typename = std::enable_if_t<!std::is_same<U, PyObject>::value>>
-    explicit operator PyObject*() const {
-        return reinterpret_cast<PyObject*>(m_ref);
-    }
-
-    T& operator*() const {
-        return *m_ref;
-    }
-
-    T* operator->() const {
-        return m_ref;
-    }
-
-    explicit operator bool() const {
-        return m_ref;
-    }
-
-    bool operator==(borrowed_ref<> other) const {
-        return m_ref == other.get();
-    }
-
-    bool operator!=(borrowed_ref<> other) const {
-        return m_ref != other.get();
-    }
-};
-
-class object_map_key {
-private:
-    borrowed_ref<> m_ob;
-
+class descriptor_cache {
 public:
-    object_map_key(borrowed_ref<> ob) : m_ob(owned_ref<>::new_reference(ob)) {}
-    object_map_key(const owned_ref<>& ob) : m_ob(ob) {}
-
-    object_map_key() = default;
-    object_map_key(const object_map_key&) = default;
-    object_map_key(object_map_key&&) = default;
-
-    object_map_key& operator=(const object_map_key&) = default;
-    object_map_key& operator=(object_map_key&&) = default;
-
-    PyObject* get() const {
-        return m_ob.get();
-    }
-
-    explicit operator bool() const noexcept {
-        return static_cast<bool>(m_ob);
-    }
-
-    operator const borrowed_ref<>&() const noexcept {
-        return m_ob;
-    }
-
-    bool operator==(const object_map_key& other) const {
-        if (m_ob == other.m_ob) {
-            return true;
-        }
-        if (!m_ob) {
-            return !static_cast<bool>(other.m_ob);
-        }
-        if (!other.m_ob) {
-            return false;
-        }
-
-        int r = PyObject_RichCompareBool(m_ob.get(), other.get(), Py_EQ);
-        if (r < 0) {
-            throw std::runtime_error{"failed to compare"};
-        }
-
-        return r;
-    }
-
-    bool operator!=(const object_map_key& other) const {
-        if (m_ob != other.m_ob) {
-            return true;
-        }
-
-        if (!m_ob) {
-            return static_cast<bool>(other.m_ob);
-        }
-        if (!other.m_ob) {
-            return true;
-        }
-
-        int r = PyObject_RichCompareBool(m_ob.get(), other.get(), Py_NE);
-        if (r < 0) {
-            throw std::runtime_error{"failed to compare"};
-        }
-
-        return r;
-    }
-};
-}  // namespace qb
-
-namespace std {
-template<>
-struct hash<qb::object_map_key> {
-    auto operator()(const qb::object_map_key& ob) const {
-        // this returns a different type in Python 2 and Python 3
-        using out_type = decltype(PyObject_Hash(ob.get()));
-
-        if (!ob.get()) {
-            return out_type{0};
-        }
-
-        out_type r = PyObject_Hash(ob.get());
-        if (r == -1) {
-            throw std::runtime_error{"python hash failed"};
-        }
-
-        return r;
-    }
-};
-}
-
-namespace qb {
-class slab {
-private:
-    struct free_deleter {
-        void operator()(std::byte* p) {
-            std::free(p);
-        }
+    enum class kind : std::uint8_t {
+        // there is no attribute with this name on the type
+        none,
+        // a descriptor which implements `__set__` (and usually `__get__`)
+        data,
+        // a descriptor which only implements `__get__`, e.g. a function
+        non_data,
+        // a class attribute which is not a descriptor
+        plain,
     };
 
-    std::unique_ptr<std::byte, free_deleter> m_data;
-    std::size_t m_size;
-    std::size_t m_cap;
-
-public:
-    slab(slab&&) = default;
+    struct result {
+        borrowed_ref<> descr;
+        kind descr_kind;
+    };
 
 private:
-    static std::unique_ptr<std::byte, free_deleter> allocate_slab(std::size_t cap) {
-        void* p = malloc(cap);
-        if (!p) {
-            throw std::bad_alloc{};
-        }
-
-        return std::unique_ptr<std::byte, free_deleter>{reinterpret_cast<std::byte*>(p)};
-    }
-
-public:
-    explicit slab(std::size_t cap) : m_data(allocate_slab(cap)), m_size(0), m_cap(cap) {}
-
-    std::size_t capacity() const {
-        return m_cap;
-    }
+    // entries are trivially destructible so that the cache may be a member of the static
+    // `ArenaAllocatable` type object
+    struct entry {
+        PyObject* key;
+        unsigned int version;
+        PyObject* descr;
+        kind descr_kind;
+    };
 
-    bool contains(std::byte* p) const {
-        return std::greater_equal<std::byte*>{}(p, m_data.get()) &&
-               std::less_equal<std::byte*>{}(p, m_data.get() + capacity());
-    }
+    static constexpr std::size_t size = 64;
+    entry m_entries[size];
 
-    std::byte* try_allocate(std::size_t size, std::size_t align) {
-        std::size_t align_padding = (align - (m_size % align)) % align;
-        if (m_size + align_padding + size > capacity()) {
-            return nullptr;
-        }
-        m_size += align_padding;
-        std::byte* out = m_data.get() + m_size;
-        m_size += size;
-        return out;
+    static bool has_valid_version(borrowed_ref<PyTypeObject> type) {
+        return PyType_HasFeature(type.get(), Py_TPFLAGS_VALID_VERSION_TAG) &&
+               type->tp_version_tag != 0;
     }
-};
-
-class arena;
-class arena_allocatable_object;
-
-class arena : public std::enable_shared_from_this<arena> {
-public:
-    template<typename T>
-    class allocator {
-    private:
-        arena* m_arena;
-
-    public:
-        using value_type = T;
-
-        explicit allocator(arena* arena) : m_arena(arena) {}
 
-        template<typename U>
-        allocator(const allocator<U>& cpfrom) : m_arena(cpfrom.get_arena()) {}
-
-        T* allocate(std::size_t count) {
-            if (!m_arena) {
-                return new T[count];
-            }
-            return reinterpret_cast<T*>(m_arena->allocate(count * sizeof(T), alignof(T)));
+    static kind classify(borrowed_ref<> descr) {
+        if (!descr) {
+            return kind::none;
         }
-
-        void deallocate(T* ptr, std::size_t) {
-            if (!m_arena) {
-                delete[] ptr;
-            }
+        if (Py_TYPE(descr)->tp_descr_set) {
+            return kind::data;
         }
-
-        arena* get_arena() const {
-            return m_arena;
+        if (Py_TYPE(descr)->tp_descr_get) {
+            return kind::non_data;
         }
-    };
-
-private:
-    std::vector<slab> m_slabs;
-    std::deque<owned_ref<>, allocator<owned_ref<>>> m_external_references;
-
-    static std::vector<slab> initialize_slabs(std::size_t slab_size) {
-        std::vector<slab> out;
-        out.emplace_back(slab_size);
-        return out;
+        return kind::plain;
     }
 
 public:
-    arena(arena&&) = delete;
+    /** Look up `key` on `type`.
 
-    explicit arena(std::size_t slab_size)
-        : m_slabs(initialize_slabs(slab_size)),
-          m_external_references(allocator<owned_ref<>>{this}) {}
-
-    bool contains(std::byte* p) const {
-        for (const slab& s : m_slabs) {
-            if (s.contains(p)) {
-                return true;
+        @return The attribute on the type, which is a borrowed reference owned by the
+                type's MRO, and what kind of attribute it is.
+     */
+    result lookup(borrowed_ref<PyTypeObject> type, borrowed_ref<> key) {
+        entry* e = nullptr;
+        if (PyUnicode_CheckExact(key.get()) && PyUnicode_CHECK_INTERNED(key.get())) {
+            // objects are at least 16 byte aligned, don't use the low bits
+            e = &m_entries[(reinterpret_cast<std::uintptr_t>(key.get()) >> 4) % size];
+            if (e->key == key.get() && e->version == type->tp_version_tag &&
+                has_valid_version(type)) {
+                return {e->descr, e->descr_kind};
             }
         }
-        return false;
-    }
-
-    std::byte* allocate(std::size_t size, std::size_t align) {
-        std::size_t capacity = m_slabs.back().capacity();
-        if (size > capacity) {
-            std::stringstream ss;
-            ss << "cannot allocate objects larger than the slab size: " << size << " > "
-               << capacity;
-            throw std::runtime_error{ss.str()};
-        }
 
-        std::byte* out = m_slabs.back().try_allocate(size, align);
-        if (!out) {
-            m_slabs.emplace_back(capacity);
-            out = m_slabs.back().try_allocate(size, align);
-            assert(out);
+        borrowed_ref<> descr = _PyType_Lookup(type.get(), key.get());
+        kind descr_kind = classify(descr);
+        // `_PyType_Lookup` assigns a version tag if it can
+        if (e && has_valid_version(type)) {
+            Py_INCREF(key.get());
+            Py_XDECREF(e->key);
+            *e = {key.get(), type->tp_version_tag, descr.get(), descr_kind};
         }
-        return out;
+        return {descr, descr_kind};
     }
 
-    void add_external_reference(borrowed_ref<> ob) {
-        m_external_references.emplace_back(owned_ref<>::new_reference(ob));
+    /** Release the references to the cached keys.
+     */
+    void clear() {
+        for (entry& e : m_entries) {
+            Py_CLEAR(e.key);
+        }
     }
 };
 
 struct arena_allocatable_meta_object : public PyHeapTypeObject {
-    std::vector<std::shared_ptr<arena>> arena_stack;
+    // the number of open `Arena` contexts, in any thread, which allocate instances of
+    // this type; when this is zero instances are allocated globally without searching
+    // for an arena
+    std::size_t active_arena_count;
+    descriptor_cache descriptors;
+    // the empty shape which all new instances start with
+    std::unique_ptr<shape> root_shape;
+    // the largest number of attributes seen on an instance, used to size the value
+    // array of new instances
+    std::uint32_t attribute_count_hint;
 };
 
 namespace arena_allocatable_methods {
-void dealloc(PyObject*);
+PyObject* vectorcall(PyObject*, PyObject* const*, std::size_t, PyObject*);
 }
 
 namespace arena_allocatable_meta_methods{
 PyObject* new_(PyTypeObject* cls, PyObject* args, PyObject* kwargs) {
-    owned_ref out{PyType_Type.tp_new(cls, args, kwargs)};
+    // `weakref` is a class keyword for this metaclass, don't pass it on to
+    // `__init_subclass__`
+    bool weakref = false;
+    owned_ref<> type_kwargs;
+    if (kwargs) {
+        if (!(type_kwargs = owned_ref{PyDict_Copy(kwargs)})) {
+            return nullptr;
+        }
+        if (PyObject* flag = PyDict_GetItemString(type_kwargs.get(), "weakref")) {
+            int truth = PyObject_IsTrue(flag);
+            if (truth < 0 || PyDict_DelItemString(type_kwargs.get(), "weakref")) {
+                return nullptr;
+            }
+            weakref = truth;
+        }
+    }
+    owned_ref out{PyType_Type.tp_new(cls, args, type_kwargs.get())};
     if (!out) {
         return nullptr;
     }
@@ -446,22 +169,65 @@ PyObject* new_(PyTypeObject* cls, PyObject* args, PyObject* kwargs) {
     }
 
     auto* as_type = reinterpret_cast<PyTypeObject*>(out.get());
-    as_type->tp_flags &= ~Py_TPFLAGS_HAVE_GC;
-    as_type->tp_dealloc = arena_allocatable_methods::dealloc;
-
+    // instances have no `__dict__`: remove the descriptor which `type.__new__` added so
+    // that `ob.__dict__` and `dir(ob)` don't read memory which was never allocated
+    as_type->tp_dictoffset = 0;
+#ifdef Py_TPFLAGS_MANAGED_DICT
+    as_type->tp_flags &= ~Py_TPFLAGS_MANAGED_DICT;
+#endif
+    if (PyDict_GetItemString(as_type->tp_dict, "__dict__") &&
+        PyDict_DelItemString(as_type->tp_dict, "__dict__")) {
+        return nullptr;
+    }
+    if (!as_type->tp_base->tp_weaklistoffset) {
+        // `type.__new__` gives every instance a weak reference list; drop it so that
+        // only types which ask for weak references pay for the pointer
+        if (as_type->tp_weaklistoffset > 0 &&
+            static_cast<std::size_t>(as_type->tp_weaklistoffset) ==
+                as_type->tp_basicsize - sizeof(PyObject*)) {
+            as_type->tp_basicsize -= sizeof(PyObject*);
+        }
+        as_type->tp_weaklistoffset = 0;
+#ifdef Py_TPFLAGS_MANAGED_WEAKREF
+        as_type->tp_flags &= ~Py_TPFLAGS_MANAGED_WEAKREF;
+#endif
+        if (weakref) {
+            // instances are not allocated with the GC pre-header, so the list is always
+            // stored after the instance's other fields
+            as_type->tp_weaklistoffset = as_type->tp_basicsize;
+            as_type->tp_basicsize += sizeof(PyObject*);
+        }
+        else if (PyDict_GetItemString(as_type->tp_dict, "__weakref__") &&
+                 PyDict_DelItemString(as_type->tp_dict, "__weakref__")) {
+            return nullptr;
+        }
+    }
+    PyType_Modified(as_type);
+    // use the deallocator of the base, like `ArenaList`'s, instead of `subtype_dealloc`,
+    // and likewise for the GC slots
+    as_type->tp_dealloc = as_type->tp_base->tp_dealloc;
+    as_type->tp_traverse = as_type->tp_base->tp_traverse;
+    as_type->tp_clear = as_type->tp_base->tp_clear;
+    as_type->tp_vectorcall = arena_allocatable_methods::vectorcall;
+
+    auto* typed = reinterpret_cast<arena_allocatable_meta_object*>(out.get());
     try {
-        new (&reinterpret_cast<arena_allocatable_meta_object*>(out.get())->arena_stack)
-            std::vector<std::shared_ptr<arena>>{};
+        typed->active_arena_count = 0;
+        new (&typed->root_shape) std::unique_ptr<shape>{new shape};
+        new (&typed->descriptors) descriptor_cache{};
+        typed->attribute_count_hint = 0;
     }
     catch (const std::exception& e) {
         PyErr_Format(PyExc_RuntimeError, "a C++ error was raised: %s", e.what());
+        return nullptr;
     }
     return std::move(out).escape();
 }
 
 void dealloc(PyObject* untyped_self) {
     auto* typed_self = reinterpret_cast<arena_allocatable_meta_object*>(untyped_self);
-    typed_self->arena_stack.~vector();
+    typed_self->root_shape.~unique_ptr();
+    typed_self->descriptors.clear();
     PyType_Type.tp_dealloc(untyped_self);
 }
 }  // namespace arena_allocatable_meta_methods
@@ -509,46 +275,452 @@ PyTypeObject arena_allocatable_meta_type = {
     arena_allocatable_meta_methods::new_,                      // tp_new
 };
 
+/** The Python source location which allocated each instance in an arena, used to
+    report where escaped instances came from. This is only created for arenas opened
+    with `track_escapes=True`.
+ */
+class allocation_sites {
+private:
+    struct site {
+        // null if the instance was allocated with no Python frame on the stack
+        owned_ref<PyCodeObject> code;
+        int line;
+    };
+
+    std::vector<site> m_sites;
+    // (code, line) -> index into `m_sites`
+    absl::flat_hash_map<std::pair<PyCodeObject*, int>, std::uint32_t> m_site_index;
+    // every instance allocated in the arena and the index of its site
+    std::vector<std::pair<PyObject*, std::uint32_t>> m_instances;
+
+public:
+    /** Record the current Python frame as the allocation site of `ob`.
+     */
+    void record(PyObject* ob) {
+        owned_ref<PyCodeObject> code;
+        int line = -1;
+        if (PyFrameObject* frame = PyEval_GetFrame()) {
+            code = owned_ref{PyFrame_GetCode(frame)};
+            line = PyFrame_GetLineNumber(frame);
+        }
+        auto [it, inserted] =
+            m_site_index.try_emplace({code.get(), line},
+                                     static_cast<std::uint32_t>(m_sites.size()));
+        if (inserted) {
+            m_sites.push_back(site{std::move(code), line});
+        }
+        m_instances.emplace_back(ob, it->second);
+    }
+
+    /** Forget the recorded instances, for when the arena is reset.
+     */
+    void clear() {
+        m_instances.clear();
+    }
+
+    /** Group the instances which are referenced from outside of the arena by the site
+        that allocated them. This must be called while the arena is still alive.
+
+        @return A list of `(filename, lineno, name, count, bytes)` tuples, sorted by
+                `bytes` from largest to smallest, or null with a Python exception raised.
+     */
+    owned_ref<> report() const;
+};
+
 struct arena_context_object {
     PyObject head;
     bool popped;
     std::vector<owned_ref<arena_allocatable_meta_object>> cls;
     std::size_t size;
+    // the arena, released when the context is closed
+    std::shared_ptr<qb::arena> arena;
+    // the weak references to this `Arena`, the stack of open arenas only holds these
+    PyObject* weakreflist;
+    // the arena's statistics when the context was closed
+    qb::arena::statistics closed_stats;
+    bool concurrent;
+    long escaped;
+    // the allocation site of each instance, or null if escapes are not being tracked
+    std::unique_ptr<allocation_sites> sites;
+    // the result of `sites->report()` when the context was closed
+    owned_ref<> closed_escape_sites;
+    // copy the objects reachable from escaped instances out of the arena when it closes
+    bool evacuate;
+    // the number of objects made permanent by `Arena.seal`, each of which holds a
+    // reference to the arena forever
+    std::size_t sealed;
+};
+
+/** Module-wide totals for the arenas which have been closed, see `counters()`.
+ */
+struct cumulative_counters {
+    std::size_t arenas = 0;
+    std::size_t slabs = 0;
+    std::size_t oversize_slabs = 0;
+    std::size_t capacity = 0;
+    // the remaining counters include the work that was undone by `Arena.reset()`
+    std::size_t used = 0;
+    std::size_t padding = 0;
+    std::size_t allocations = 0;
+    std::size_t objects = 0;
+    std::size_t external_references = 0;
+    std::size_t escaped = 0;
+
+    /** Add the statistics for an arena which is being reset or closed. Slabs are kept
+        through a reset, so they are only counted when the arena is closed.
+     */
+    void add(const qb::arena::statistics& stats, bool concurrent, bool closing) {
+        used += stats.used;
+        if (!concurrent) {
+            padding += stats.used - stats.requested;
+            allocations += stats.allocations;
+        }
+        objects += stats.objects;
+        external_references += stats.external_references;
+        if (closing) {
+            ++arenas;
+            slabs += stats.slabs;
+            oversize_slabs += stats.oversize_slabs;
+            capacity += stats.capacity;
+        }
+    }
 };
 
+cumulative_counters counters;
+
+// A `contextvars.ContextVar` holding a tuple of weak references to the `Arena`s opened
+// in the current context, innermost last. Each thread and each asyncio task has its own
+// context, so arenas opened in one are not used by the others. The references are weak
+// so that an `Arena` which is dropped without being closed is deallocated, which closes
+// it.
+PyObject* current_arena_context = nullptr;
+
+namespace evacuation {
+/** The result of `evacuate`.
+ */
+struct result {
+    // the number of objects which were copied out of the arena
+    std::size_t copied;
+    // the number of bytes of pages still used by the escaped instances
+    std::size_t pinned_bytes;
+    // the slabs holding the escaped instances
+    std::shared_ptr<std::vector<slab>> slabs;
+    // the escaped instances' memory, sorted by address
+    std::vector<qb::arena::slab_range> keep;
+    // the evacuated `ArenaDict` instances with keys which were copied, see `rehash`
+    std::vector<owned_ref<>> rehash;
+};
+
+result evacuate(qb::arena& arena);
+
+/** Hash the keys of the evacuated dicts again, for keys which were copied and may hash
+    by identity. This may run arbitrary code, so it must wait until `evacuate` is done.
+
+    @return False with a Python exception raised if a key can't be hashed. The dict
+            keeps the old hashes, so the copied keys which hash by identity can't be
+            found in it.
+ */
+bool rehash(const result& evacuated);
+
+/** Return the pages of the pinned slabs which are not under an escaped instance to the
+    OS. This must wait until the arena is destroyed, which may still use memory in them.
+ */
+void release_unused_pages(const result& evacuated) {
+    for (slab& s : *evacuated.slabs) {
+        s.release_pages_except(evacuated.keep.begin(), evacuated.keep.end());
+    }
+}
+}  // namespace evacuation
+
+namespace snapshot {
+/** Save the objects reachable from `root`, which is allocated in `arena`, to the file
+    at `path`, a `bytes` object.
+
+    @return True on success, false with a Python exception raised.
+ */
+bool save(qb::arena& arena, borrowed_ref<> path, borrowed_ref<> root);
+
+/** Map the snapshot at `path`, a `bytes` object, into a new arena.
+
+    @return A new reference to the root object, or null with a Python exception raised.
+ */
+owned_ref<> load(borrowed_ref<> path);
+}  // namespace snapshot
+
+namespace sealing {
+/** Make the objects reachable from `root`, which is allocated in `arena`, permanent:
+    they are never deallocated and each holds a reference to `arena`.
+
+    @return The number of objects which were made permanent by this call.
+ */
+std::size_t make_permanent(const std::shared_ptr<qb::arena>& arena, PyObject* root);
+}  // namespace sealing
+
+/** Release the references that `arena` holds to its weakly referenced objects, see
+    `qb::arena::hold`. An object which is still referenced from Python keeps its
+    reference to the arena, like any other escaped object. The weak references to the
+    rest stop resolving, and are cleared when the arena is destroyed or reset.
+
+    @param stop Stop holding objects which lose their last reference from Python later.
+ */
+void release_held(const std::shared_ptr<qb::arena>& arena, bool stop);
+
+namespace freezing {
+/** Copy the objects reachable from `root`, which is allocated in `arena`, into a new
+    frozen arena.
+
+    @return A new reference to the copy of `root`, or null with a Python exception
+            raised.
+ */
+owned_ref<> freeze(qb::arena& arena, PyObject* root);
+}  // namespace freezing
+
 namespace arena_context_methods {
 PyObject* new_(PyTypeObject*, PyObject*, PyObject*);
 
-
-PyObject* enter(PyObject* untyped_self, PyObject*) {
-    Py_INCREF(untyped_self);
-    return untyped_self;
+/** The `Arena` that an entry of the stack in `current_arena_context` refers to, or null
+    if it has been deallocated.
+ */
+arena_context_object* resolve_context(PyObject* ref) {
+    PyObject* ob = PyWeakref_GET_OBJECT(ref);
+    return (ob == Py_None) ? nullptr : reinterpret_cast<arena_context_object*>(ob);
 }
 
-int close_impl(borrowed_ref<arena_context_object> self) {
-    if (self->popped || !self->cls.size()) {
-        return 0;
+/** Find the innermost open `Arena` in the current context which allocates instances of
+    `cls`.
+
+    @param out Set to the `Arena`, or left null if `cls` is allocated globally.
+    @return 0 on success, -1 with a Python exception raised.
+ */
+int find_arena_context(borrowed_ref<arena_allocatable_meta_object> cls,
+                       owned_ref<arena_context_object>& out) {
+    PyObject* current;
+    if (PyContextVar_Get(current_arena_context, nullptr, &current)) {
+        return -1;
     }
-    long use_count = self->cls.front()->arena_stack.back().use_count();
-    long alive = use_count - self->cls.size();
-    if (alive) {
-        return PyErr_WarnFormat(PyExc_RuntimeWarning,
-                                1,
-                                "%ld object%s still alive at arena exit",
-                                alive,
-                                (alive != 1) ? "s are" : " is");
+    owned_ref<> current_ref{current};
+    if (!current) {
+        return 0;
     }
-    for (borrowed_ref<arena_allocatable_meta_object> cls : self->cls) {
-        cls->arena_stack.pop_back();
+    auto allocates_cls = [&](const owned_ref<arena_allocatable_meta_object>& ob) {
+        return ob.get() == cls.get();
+    };
+    // closed arenas are skipped, they may be closed out of order
+    for (Py_ssize_t ix = PyTuple_GET_SIZE(current); ix--;) {
+        arena_context_object* typed = resolve_context(PyTuple_GET_ITEM(current, ix));
+        if (typed && !typed->popped &&
+            std::any_of(typed->cls.begin(), typed->cls.end(), allocates_cls)) {
+            out = owned_ref<arena_context_object>::new_reference(typed);
+            return 0;
+        }
     }
-    self->popped = true;
     return 0;
 }
 
-PyObject* close(PyObject* untyped_self, PyObject*) {
-    borrowed_ref self{reinterpret_cast<arena_context_object*>(untyped_self)};
-    if (self->popped) {
-        PyErr_SetString(PyExc_RuntimeError, "arena context was already closed");
+
+PyObject* enter(PyObject* untyped_self, PyObject*) {
+    Py_INCREF(untyped_self);
+    return untyped_self;
+}
+
+/** The number of objects allocated in the arena which are still reachable from Python.
+    Each of these holds a reference to the arena, in addition to the reference from the
+    context itself. So do the objects which the arena holds for their weak references,
+    which are only counted if Python has a reference to them as well.
+ */
+long alive_count(borrowed_ref<arena_context_object> self) {
+    long out = self->arena.use_count() - 1 - self->sealed;
+    for (PyObject* ob : self->arena->held()) {
+        if (Py_REFCNT(ob) == 1) {
+            --out;
+        }
+    }
+    return out;
+}
+
+/** Add the sites which allocated escaped instances to the warning issued when an arena
+    is closed.
+
+    @param message The first line of the warning.
+    @param capacity The number of bytes of slabs pinned by the escaped instances.
+    @param sites The result of `allocation_sites::report()`.
+    @return The new message, or null with a Python exception raised.
+ */
+owned_ref<> escape_site_message(owned_ref<> message,
+                                std::size_t capacity,
+                                borrowed_ref<> sites) {
+    // only the largest sites are shown, `Arena.escape_sites()` has the rest
+    constexpr Py_ssize_t max_sites = 10;
+    owned_ref<> lines{PyList_New(0)};
+    if (!lines) {
+        return nullptr;
+    }
+    owned_ref header{PyUnicode_FromFormat("%U, pinning %zu bytes of arena memory:",
+                                          message.get(),
+                                          capacity)};
+    if (!header || PyList_Append(lines.get(), header.get())) {
+        return nullptr;
+    }
+    Py_ssize_t size = PyList_GET_SIZE(sites.get());
+    for (Py_ssize_t ix = 0; ix < std::min(size, max_sites); ++ix) {
+        PyObject* filename;
+        int line;
+        PyObject* name;
+        Py_ssize_t count;
+        Py_ssize_t bytes;
+        if (!PyArg_ParseTuple(PyList_GET_ITEM(sites.get(), ix),
+                              "OiOnn",
+                              &filename,
+                              &line,
+                              &name,
+                              &count,
+                              &bytes)) {
+            return nullptr;
+        }
+        owned_ref text{PyUnicode_FromFormat("  %zd object%s (%zd bytes) allocated at "
+                                            "%U:%d in %U",
+                                            count,
+                                            (count != 1) ? "s" : "",
+                                            bytes,
+                                            filename,
+                                            line,
+                                            name)};
+        if (!text || PyList_Append(lines.get(), text.get())) {
+            return nullptr;
+        }
+    }
+    if (size > max_sites) {
+        owned_ref text{PyUnicode_FromFormat("  ... and %zd more site%s",
+                                            size - max_sites,
+                                            (size - max_sites != 1) ? "s" : "")};
+        if (!text || PyList_Append(lines.get(), text.get())) {
+            return nullptr;
+        }
+    }
+    owned_ref separator{PyUnicode_FromString("\n")};
+    if (!separator) {
+        return nullptr;
+    }
+    return owned_ref{PyUnicode_Join(separator.get(), lines.get())};
+}
+
+int close_impl(borrowed_ref<arena_context_object> self) {
+    if (self->popped) {
+        return 0;
+    }
+    if (!self->arena) {
+        // `Arena.__new__` failed before the arena was opened, possibly with an exception
+        // set, so there is nothing to report and the context must not be touched
+        for (borrowed_ref<arena_allocatable_meta_object> cls : self->cls) {
+            --cls->active_arena_count;
+        }
+        self->popped = true;
+        return 0;
+    }
+    release_held(self->arena, true);
+    long alive = alive_count(self);
+    for (borrowed_ref<arena_allocatable_meta_object> cls : self->cls) {
+        --cls->active_arena_count;
+    }
+    self->closed_stats = self->arena->stats();
+    self->escaped = alive;
+    counters.add(self->closed_stats, self->concurrent, true);
+    counters.escaped += alive;
+    // keep the arena alive until the escaped instances have been reported
+    std::shared_ptr<qb::arena> arena = std::move(self->arena);
+    self->popped = true;
+
+    // If this is the innermost arena in the current context, make the nearest enclosing
+    // open arena the innermost. Otherwise it was closed out of order or from another
+    // context, and lookups will skip it. An arena which is being deallocated no longer
+    // resolves, so it is popped like a closed one.
+    PyObject* current;
+    if (PyContextVar_Get(current_arena_context, nullptr, &current)) {
+        return -1;
+    }
+    owned_ref<> current_ref{current};
+    if (current) {
+        Py_ssize_t size = PyTuple_GET_SIZE(current);
+        Py_ssize_t open = size;
+        while (open) {
+            arena_context_object* typed = resolve_context(
+                PyTuple_GET_ITEM(current, open - 1));
+            if (typed && !typed->popped) {
+                break;
+            }
+            --open;
+        }
+        if (open != size) {
+            owned_ref stack{PyTuple_GetSlice(current, 0, open)};
+            if (!stack) {
+                return -1;
+            }
+            owned_ref token{PyContextVar_Set(current_arena_context, stack.get())};
+            if (!token) {
+                return -1;
+            }
+        }
+    }
+
+    if (self->sites) {
+        self->closed_escape_sites = self->sites->report();
+        self->sites->clear();
+        if (!self->closed_escape_sites) {
+            return -1;
+        }
+    }
+
+    if (alive) {
+        owned_ref message{PyUnicode_FromFormat("%ld object%s still alive at arena exit",
+                                               alive,
+                                               (alive != 1) ? "s are" : " is")};
+        if (!message) {
+            return -1;
+        }
+        std::size_t pinned_bytes = self->closed_stats.capacity;
+        if (self->evacuate) {
+            try {
+                evacuation::result result = evacuation::evacuate(*arena);
+                pinned_bytes = result.pinned_bytes;
+                if (arena.use_count() == 1) {
+                    arena.reset();
+                    evacuation::release_unused_pages(result);
+                }
+                if (!evacuation::rehash(result)) {
+                    return -1;
+                }
+                message = owned_ref{
+                    PyUnicode_FromFormat("%U; evacuated them and %zu reachable object%s",
+                                         message.get(),
+                                         result.copied,
+                                         (result.copied != 1) ? "s" : "")};
+                if (!message) {
+                    return -1;
+                }
+            }
+            catch (const std::bad_alloc&) {
+                // the escaped instances keep the whole arena alive, like a regular arena
+            }
+        }
+        if (self->closed_escape_sites &&
+            !(message = escape_site_message(std::move(message),
+                                            pinned_bytes,
+                                            self->closed_escape_sites))) {
+            return -1;
+        }
+        const char* text = PyUnicode_AsUTF8(message.get());
+        if (!text) {
+            return -1;
+        }
+        return PyErr_WarnEx(PyExc_RuntimeWarning, text, 1);
+    }
+    return 0;
+}
+
+PyObject* close(PyObject* untyped_self, PyObject*) {
+    borrowed_ref self{reinterpret_cast<arena_context_object*>(untyped_self)};
+    if (self->popped) {
+        PyErr_SetString(PyExc_RuntimeError, "arena context was already closed");
         return nullptr;
     }
     if (close_impl(self)) {
@@ -561,16 +733,323 @@ PyObject* exit(PyObject* untyped_self, PyObject*) {
     return close(untyped_self, nullptr);
 }
 
+/** Build the dict returned by `Arena.stats()` and `counters()`. Counters which are
+    not tracked are None.
+ */
+PyObject* stats_dict(std::size_t slabs,
+                     std::size_t oversize_slabs,
+                     std::size_t capacity,
+                     std::size_t used,
+                     std::optional<std::size_t> padding,
+                     std::optional<std::size_t> allocations,
+                     std::size_t objects,
+                     std::size_t external_references,
+                     std::size_t escaped) {
+    owned_ref out{PyDict_New()};
+    if (!out) {
+        return nullptr;
+    }
+    std::pair<const char*, std::optional<std::size_t>> items[] = {
+        {"slabs", slabs},
+        {"oversize_slabs", oversize_slabs},
+        {"capacity", capacity},
+        {"used", used},
+        {"padding", padding},
+        {"allocations", allocations},
+        {"objects", objects},
+        {"external_references", external_references},
+        {"escaped", escaped},
+    };
+    for (const auto& [key, value] : items) {
+        owned_ref<> ob;
+        if (value) {
+            ob = owned_ref{PyLong_FromSize_t(*value)};
+            if (!ob) {
+                return nullptr;
+            }
+        }
+        else {
+            ob = owned_ref<>::new_reference(Py_None);
+        }
+        if (PyDict_SetItemString(out.get(), key, ob.get())) {
+            return nullptr;
+        }
+    }
+    return std::move(out).escape();
+}
+
+PyObject* stats(PyObject* untyped_self, PyObject*) {
+    borrowed_ref self{reinterpret_cast<arena_context_object*>(untyped_self)};
+    qb::arena::statistics stats;
+    long escaped;
+    if (self->popped) {
+        stats = self->closed_stats;
+        escaped = self->escaped;
+    }
+    else {
+        stats = self->arena->stats();
+        escaped = alive_count(self);
+    }
+    std::optional<std::size_t> padding;
+    std::optional<std::size_t> allocations;
+    if (!self->concurrent) {
+        padding = stats.used - stats.requested;
+        allocations = stats.allocations;
+    }
+    return stats_dict(stats.slabs,
+                      stats.oversize_slabs,
+                      stats.capacity,
+                      stats.used,
+                      padding,
+                      allocations,
+                      stats.objects,
+                      stats.external_references,
+                      escaped);
+}
+
+PyObject* escape_sites(PyObject* untyped_self, PyObject*) {
+    borrowed_ref self{reinterpret_cast<arena_context_object*>(untyped_self)};
+    if (!self->sites) {
+        PyErr_SetString(PyExc_RuntimeError,
+                        "escape sites are only tracked for arenas opened with "
+                        "track_escapes=True");
+        return nullptr;
+    }
+    if (self->popped) {
+        return owned_ref<>::new_reference(self->closed_escape_sites).escape();
+    }
+    return self->sites->report().escape();
+}
+
+PyObject* reset(PyObject* untyped_self, PyObject*) {
+    borrowed_ref self{reinterpret_cast<arena_context_object*>(untyped_self)};
+    if (self->popped) {
+        PyErr_SetString(PyExc_RuntimeError, "arena context was already closed");
+        return nullptr;
+    }
+    if (self->sealed) {
+        // check before releasing anything, the sealed objects are still in use
+        PyErr_SetString(PyExc_RuntimeError, "cannot reset a sealed arena");
+        return nullptr;
+    }
+    long alive = alive_count(self);
+    if (!alive) {
+        // weak reference callbacks may run arbitrary code, including code which keeps
+        // new objects from the arena alive, so count again afterwards
+        release_held(self->arena, false);
+        self->arena->clear_weak_references();
+        alive = alive_count(self);
+    }
+    if (alive) {
+        PyErr_Format(PyExc_RuntimeError,
+                     "cannot reset arena, %ld object%s still alive",
+                     alive,
+                     (alive != 1) ? "s are" : " is");
+        return nullptr;
+    }
+    try {
+        counters.add(self->arena->stats(), self->concurrent, false);
+        if (self->sites) {
+            self->sites->clear();
+        }
+        self->arena->reset();
+    }
+    catch (const std::exception& e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+    Py_RETURN_NONE;
+}
+
+PyObject* save(PyObject* untyped_self, PyObject* args) {
+    borrowed_ref self{reinterpret_cast<arena_context_object*>(untyped_self)};
+    PyObject* path;
+    PyObject* root;
+    if (!PyArg_ParseTuple(args, "O&O:save", PyUnicode_FSConverter, &path, &root)) {
+        return nullptr;
+    }
+    owned_ref<> path_ref{path};
+    if (self->popped) {
+        PyErr_SetString(PyExc_RuntimeError, "arena context was already closed");
+        return nullptr;
+    }
+    if (!self->arena->contains(reinterpret_cast<std::byte*>(root))) {
+        PyErr_Format(PyExc_ValueError, "%R was not allocated in this arena", root);
+        return nullptr;
+    }
+    try {
+        if (!snapshot::save(*self->arena, path_ref, root)) {
+            return nullptr;
+        }
+    }
+    catch (const std::exception& e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+    Py_RETURN_NONE;
+}
+
+PyObject* seal(PyObject* untyped_self, PyObject* root) {
+    borrowed_ref self{reinterpret_cast<arena_context_object*>(untyped_self)};
+    if (self->popped) {
+        PyErr_SetString(PyExc_RuntimeError, "arena context was already closed");
+        return nullptr;
+    }
+    if (self->arena->backing() != slab_backing::shared) {
+        PyErr_SetString(PyExc_ValueError,
+                        "only arenas opened with backing='shared' may be sealed");
+        return nullptr;
+    }
+    if (self->evacuate) {
+        // the sealed objects are meant to stay where they are
+        PyErr_SetString(PyExc_ValueError,
+                        "arenas opened with evacuate=True may not be sealed");
+        return nullptr;
+    }
+    if (!self->arena->contains(reinterpret_cast<std::byte*>(root))) {
+        PyErr_Format(PyExc_ValueError, "%R was not allocated in this arena", root);
+        return nullptr;
+    }
+    try {
+        // the sealed objects are referenced forever, the arena doesn't need to hold them
+        release_held(self->arena, false);
+        self->sealed += sealing::make_permanent(self->arena, root);
+        self->arena->seal();
+    }
+    catch (const std::system_error& e) {
+        errno = e.code().value();
+        PyErr_SetFromErrno(PyExc_OSError);
+        return nullptr;
+    }
+    catch (const std::exception& e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+    Py_RETURN_NONE;
+}
+
+PyObject* freeze(PyObject* untyped_self, PyObject* root) {
+    borrowed_ref self{reinterpret_cast<arena_context_object*>(untyped_self)};
+    if (self->popped) {
+        PyErr_SetString(PyExc_RuntimeError, "arena context was already closed");
+        return nullptr;
+    }
+    if (!self->arena->contains(reinterpret_cast<std::byte*>(root))) {
+        PyErr_Format(PyExc_ValueError, "%R was not allocated in this arena", root);
+        return nullptr;
+    }
+    try {
+        return freezing::freeze(*self->arena, root).escape();
+    }
+    catch (const std::exception& e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+PyObject* load(PyObject*, PyObject* arg) {
+    PyObject* path;
+    if (!PyUnicode_FSConverter(arg, &path)) {
+        return nullptr;
+    }
+    owned_ref<> path_ref{path};
+    try {
+        return snapshot::load(path_ref).escape();
+    }
+    catch (const std::exception& e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
 void dealloc(PyObject* untyped_self) {
     borrowed_ref self{reinterpret_cast<arena_context_object*>(untyped_self)};
+    PyObject_GC_UnTrack(untyped_self);
+    if (self->weakreflist) {
+        PyObject_ClearWeakRefs(untyped_self);
+    }
+    if (close_impl(self)) {
+        PyErr_WriteUnraisable(untyped_self);
+    }
+    self->cls.~vector();
+    self->arena.~shared_ptr();
+    self->sites.~unique_ptr();
+    self->closed_escape_sites.~owned_ref();
+    PyObject_GC_Del(untyped_self);
+}
+
+int traverse(PyObject* untyped_self, visitproc visit, void* arg) {
+    borrowed_ref self{reinterpret_cast<arena_context_object*>(untyped_self)};
+    for (borrowed_ref<arena_allocatable_meta_object> cls : self->cls) {
+        Py_VISIT(cls.get());
+    }
+    Py_VISIT(self->closed_escape_sites.get());
+    // The arena's references belong to this object only if no escaped instance shares
+    // the arena. Otherwise the escaped instances, which the GC can't see, may still
+    // reach them.
+    if (self->arena && !self->sealed && !alive_count(self)) {
+        return self->arena->traverse_external_references(visit, arg);
+    }
+    return 0;
+}
+
+int clear(PyObject* untyped_self) {
+    borrowed_ref self{reinterpret_cast<arena_context_object*>(untyped_self)};
+    // closing the arena releases its references; nothing can use the arena now
     if (close_impl(self)) {
         PyErr_WriteUnraisable(untyped_self);
     }
-    PyObject_Del(untyped_self);
+    self->closed_escape_sites = owned_ref<>{};
+    return 0;
 }
 
 PyMethodDef methods[] = {
     {"close", close, METH_NOARGS, nullptr},
+    {"reset",
+     reset,
+     METH_NOARGS,
+     "Release everything allocated in the arena and reuse its memory. Raises a "
+     "RuntimeError if any objects allocated in the arena are still alive."},
+    {"stats",
+     stats,
+     METH_NOARGS,
+     "Return a dict describing the arena's memory use. After the arena is closed, "
+     "this describes the arena at the time it was closed."},
+    {"escape_sites",
+     escape_sites,
+     METH_NOARGS,
+     "Return a list of (filename, lineno, name, count, bytes) tuples for the sites "
+     "which allocated instances that are referenced from outside of the arena, largest "
+     "first. After the arena is closed, this describes the instances which escaped."},
+    {"save",
+     save,
+     METH_VARARGS,
+     "save(path, root)\n"
+     "Write the objects in the arena which are reachable from root to a snapshot file "
+     "which can be loaded with Arena.load. Objects outside of the arena must be str, "
+     "int, float, bool, or None."},
+    {"load",
+     load,
+     METH_O | METH_STATIC,
+     "load(path)\n"
+     "Map a snapshot written by Arena.save into a new arena and return its root. The "
+     "arena is freed once none of its objects are referenced."},
+    {"seal",
+     seal,
+     METH_O,
+     "seal(root)\n"
+     "Make the objects in the arena which are reachable from root permanent and move the "
+     "arena's memory into sealed memory files, so that forked processes share it until "
+     "they write to it. The arena must have been opened with backing='shared'. The "
+     "sealed objects, and the arena, are never freed."},
+    {"freeze",
+     freeze,
+     METH_O,
+     "freeze(root)\n"
+     "Copy the objects in the arena which are reachable from root into a new, compact "
+     "arena and return the copy of root. The copies cannot be modified. Like an arena "
+     "made by Arena.load, the new arena is freed once none of its objects are "
+     "referenced."},
     {"__enter__", enter, METH_NOARGS, nullptr},
     {"__exit__", exit, METH_VARARGS, nullptr},
     {nullptr},
@@ -599,12 +1078,12 @@ PyTypeObject arena_context_type = {
     0,                                         // tp_getattro
     0,                                         // tp_setattro
     0,                                         // tp_as_buffer
-    Py_TPFLAGS_DEFAULT,                        // tp_flags
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,   // tp_flags
     0,                                         // tp_doc
-    0,                                         // tp_traverse
-    0,                                         // tp_clear
+    arena_context_methods::traverse,           // tp_traverse
+    arena_context_methods::clear,              // tp_clear
     0,                                         // tp_richcompare
-    0,                                         // tp_weaklistoffset
+    offsetof(arena_context_object, weakreflist),  // tp_weaklistoffset
     0,                                         // tp_iter
     0,                                         // tp_iternext
     arena_context_methods::methods,            // tp_methods
@@ -623,15 +1102,73 @@ PyTypeObject arena_context_type = {
 
 namespace arena_context_methods {
 PyObject* new_(PyTypeObject*, PyObject* args, PyObject* kwargs) {
-    static const char* const keywords[] = {"types", "slab_size", nullptr};
+    static const char* const keywords[] = {"types",
+                                           "slab_size",
+                                           "growth_factor",
+                                           "max_slab_size",
+                                           "backing",
+                                           "concurrent",
+                                           "track_escapes",
+                                           "evacuate",
+                                           nullptr};
     PyObject* borrowed_types;
     Py_ssize_t slab_size = 1 << 16;
+    double growth_factor = 2.0;
+    Py_ssize_t max_slab_size = -1;
+    const char* backing_name = "malloc";
+    int concurrent = false;
+    int track_escapes = false;
+    int evacuate = false;
     if (!PyArg_ParseTupleAndKeywords(args,
                                      kwargs,
-                                     "O|n:Arena",
+                                     "O|ndnsppp:Arena",
                                      const_cast<char**>(keywords),
                                      &borrowed_types,
-                                     &slab_size)) {
+                                     &slab_size,
+                                     &growth_factor,
+                                     &max_slab_size,
+                                     &backing_name,
+                                     &concurrent,
+                                     &track_escapes,
+                                     &evacuate)) {
+        return nullptr;
+    }
+    slab_backing backing;
+    if (!std::strcmp(backing_name, "malloc")) {
+        backing = slab_backing::malloc;
+    }
+    else if (!std::strcmp(backing_name, "mmap")) {
+        backing = slab_backing::mmap;
+    }
+    else if (!std::strcmp(backing_name, "hugepage")) {
+        backing = slab_backing::hugepage;
+    }
+    else if (!std::strcmp(backing_name, "shared")) {
+        backing = slab_backing::shared;
+    }
+    else {
+        PyErr_Format(PyExc_ValueError,
+                     "backing must be one of 'malloc', 'mmap', 'hugepage', or 'shared', "
+                     "got '%s'",
+                     backing_name);
+        return nullptr;
+    }
+    if (slab_size <= 0) {
+        PyErr_Format(PyExc_ValueError, "slab_size must be positive, got %zd", slab_size);
+        return nullptr;
+    }
+    if (!(growth_factor >= 1.0)) {
+        PyErr_SetString(PyExc_ValueError, "growth_factor must be at least 1.0");
+        return nullptr;
+    }
+    if (max_slab_size == -1) {
+        max_slab_size = std::max<Py_ssize_t>(slab_size, 1 << 26);
+    }
+    else if (max_slab_size < slab_size) {
+        PyErr_Format(PyExc_ValueError,
+                     "max_slab_size must be at least slab_size: %zd < %zd",
+                     max_slab_size,
+                     slab_size);
         return nullptr;
     }
 
@@ -652,7 +1189,7 @@ PyObject* new_(PyTypeObject*, PyObject* args, PyObject* kwargs) {
         return nullptr;
     }
 
-    owned_ref out{PyObject_New(arena_context_object, &arena_context_type)};
+    owned_ref out{PyObject_GC_New(arena_context_object, &arena_context_type)};
     if (!out) {
         return nullptr;
     }
@@ -662,9 +1199,28 @@ PyObject* new_(PyTypeObject*, PyObject* args, PyObject* kwargs) {
         new (&out.get()->popped) bool{false};
         new (&out.get()->cls) std::vector<owned_ref<arena_allocatable_meta_object>>{};
         new (&out.get()->size) std::size_t{static_cast<std::size_t>(slab_size)};
-
-
-        arena = std::make_shared<qb::arena>(slab_size);
+        new (&out.get()->arena) std::shared_ptr<qb::arena>{};
+        out->weakreflist = nullptr;
+        new (&out.get()->closed_stats) qb::arena::statistics{};
+        new (&out.get()->concurrent) bool{static_cast<bool>(concurrent)};
+        new (&out.get()->escaped) long{0};
+        new (&out.get()->sites) std::unique_ptr<allocation_sites>{};
+        new (&out.get()->closed_escape_sites) owned_ref<>{};
+        new (&out.get()->evacuate) bool{static_cast<bool>(evacuate)};
+        new (&out.get()->sealed) std::size_t{0};
+
+        if (track_escapes) {
+            out->sites = std::make_unique<allocation_sites>();
+        }
+        arena = std::make_shared<qb::arena>(backing,
+                                            slab_size,
+                                            growth_factor,
+                                            max_slab_size,
+                                            concurrent);
+        if (evacuate) {
+            arena->track_roots();
+        }
+        arena->start_holding();
     }
     catch (const std::exception& e) {
         PyErr_SetString(PyExc_RuntimeError, e.what());
@@ -688,7 +1244,6 @@ PyObject* new_(PyTypeObject*, PyObject* args, PyObject* kwargs) {
         borrowed_ref typed_type{
             reinterpret_cast<arena_allocatable_meta_object*>(type.get())};
         try {
-            typed_type->arena_stack.emplace_back(arena);
             out->cls.emplace_back(
                 owned_ref<arena_allocatable_meta_object>::new_reference(typed_type));
         }
@@ -696,113 +1251,698 @@ PyObject* new_(PyTypeObject*, PyObject* args, PyObject* kwargs) {
             PyErr_SetString(PyExc_RuntimeError, e.what());
             return nullptr;
         }
+        ++typed_type->active_arena_count;
     }
     if (PyErr_Occurred()) {
         return nullptr;
     }
 
+    // make this the innermost arena in the current context
+    PyObject* current;
+    if (PyContextVar_Get(current_arena_context, nullptr, &current)) {
+        return nullptr;
+    }
+    owned_ref<> current_ref{current};
+    Py_ssize_t size = current ? PyTuple_GET_SIZE(current) : 0;
+    owned_ref ref{PyWeakref_NewRef(reinterpret_cast<PyObject*>(out.get()), nullptr)};
+    if (!ref) {
+        return nullptr;
+    }
+    owned_ref stack{PyTuple_New(size + 1)};
+    if (!stack) {
+        return nullptr;
+    }
+    for (Py_ssize_t ix = 0; ix < size; ++ix) {
+        PyObject* item = PyTuple_GET_ITEM(current, ix);
+        Py_INCREF(item);
+        PyTuple_SET_ITEM(stack.get(), ix, item);
+    }
+    PyTuple_SET_ITEM(stack.get(), size, std::move(ref).escape());
+    owned_ref token{PyContextVar_Set(current_arena_context, stack.get())};
+    if (!token) {
+        return nullptr;
+    }
+    // until now, `close_impl` only has to undo the counts of active arenas
+    out->arena = std::move(arena);
+
+    PyObject_GC_Track(out.get());
     return reinterpret_cast<PyObject*>(std::move(out).escape());
 }
 }  // namespace arena_context_methods
 
 struct arena_allocatable_object : public PyObject {
-    using members_type =
-        absl::flat_hash_map<object_map_key,
-                            PyObject*,
-                            absl::container_internal::hash_default_hash<object_map_key>,
-                            absl::container_internal::hash_default_eq<object_map_key>,
-                            arena::allocator<std::pair<const object_map_key, PyObject*>>>;
-
     std::shared_ptr<arena> owning_arena;
-    members_type members;
+    // the attribute layout of this instance, owned by the type
+    shape* layout;
+    // the attribute values, indexed by the slot in `layout`
+    PyObject** values;
+    std::uint32_t capacity;
+    // has this instance been recorded with `arena::add_root`?
+    bool rooted;
+    // is this a global instance which was left in place when its arena was evacuated?
+    bool pinned;
+    // was this allocated globally with the header that the cycle collector needs? Only
+    // these instances are tracked by the GC.
+    bool collectable;
+    // the number of values which fit in the same allocation as the instance, right after
+    // the fields of its type
+    std::uint8_t inline_capacity;
 
     arena_allocatable_object(const std::shared_ptr<arena>& arena,
-                             borrowed_ref<PyTypeObject> type)
-        : PyObject({_PyObject_EXTRA_INIT 1, type.get()}),
+                             borrowed_ref<arena_allocatable_meta_object> type)
+        : PyObject({_PyObject_EXTRA_INIT 1, reinterpret_cast<PyTypeObject*>(type.get())}),
           owning_arena(arena),
-          // use a "weak" pointer here to break a ref cycle
-          members(members_type::allocator_type{arena.get()}) {
+          layout(type->root_shape.get()),
+          values(nullptr),
+          capacity(0),
+          rooted(false),
+          pinned(false),
+          collectable(false),
+          inline_capacity(0) {}
+
+    /** Construct an instance in an arena which is only referenced by other objects in
+        the arena, so it starts without any references or an owning arena.
+     */
+    explicit arena_allocatable_object(borrowed_ref<arena_allocatable_meta_object> type)
+        : PyObject({_PyObject_EXTRA_INIT 0, reinterpret_cast<PyTypeObject*>(type.get())}),
+          layout(type->root_shape.get()),
+          values(nullptr),
+          capacity(0),
+          rooted(false),
+          pinned(false),
+          collectable(false),
+          inline_capacity(0) {}
+
+    /** The values stored in the same allocation as the instance.
+     */
+    PyObject** inline_values() {
+        return reinterpret_cast<PyObject**>(reinterpret_cast<std::byte*>(this) +
+                                            Py_TYPE(this)->tp_basicsize);
     }
-};
-
-namespace arena_allocatable_methods {
-PyObject* new_(PyTypeObject* cls, PyObject*, PyObject*) {
-    try {
-        auto& arena_stack =
-            reinterpret_cast<arena_allocatable_meta_object*>(cls)->arena_stack;
-        if (!arena_stack.size()) {
-            Py_INCREF(cls);
-            auto* allocation = PyMem_New(arena_allocatable_object, 1);
-            new(allocation) arena_allocatable_object(std::shared_ptr<arena>{}, cls);
-            return allocation;
-        }
 
-        std::byte* allocation =
-            arena_stack.back()->allocate(cls->tp_basicsize,
-                                         alignof(arena_allocatable_object));
-        new (allocation) arena_allocatable_object(arena_stack.back(), cls);
-        return reinterpret_cast<PyObject*>(allocation);
-    }
-    catch (const std::exception& e) {
-        PyErr_SetString(PyExc_RuntimeError, e.what());
-        return nullptr;
+    /** Store the values inline. The instance must have been allocated with room for
+        `capacity` values after the fields of its type.
+     */
+    void use_inline_values(std::uint32_t capacity) {
+        inline_capacity = capacity;
+        values = capacity ? inline_values() : nullptr;
+        this->capacity = capacity;
     }
-}
 
-int setattr(PyObject* untyped_self, PyObject* key_ptr, PyObject* value) {
-    // search for a descriptor on the type before looking on the instance
-    borrowed_ref<> descr = _PyType_Lookup(Py_TYPE(untyped_self), key_ptr);
-    descrsetfunc descrset = descr ? Py_TYPE(descr)->tp_descr_set : nullptr;
-    if (descrset) {
-        Py_INCREF(descr);
-        int res = descrset(descr.get(), untyped_self, value);
-        Py_DECREF(descr);
-        return res;
+    /** Is `values` a separate allocation which a global instance must free?
+     */
+    bool values_are_separate() {
+        return !inline_capacity || values != inline_values();
     }
 
-    try {
-        borrowed_ref self{static_cast<arena_allocatable_object*>(untyped_self)};
+    /** The size of the instance's allocation, including the inline values.
+     */
+    std::size_t allocation_size() const {
+        return Py_TYPE(this)->tp_basicsize + inline_capacity * sizeof(PyObject*);
+    }
+};
 
-        borrowed_ref key{key_ptr};
-        auto arena = self->owning_arena;
-        if (arena) {
-            if (value) {
-                arena->add_external_reference(key);
-                if (!arena->contains(reinterpret_cast<std::byte*>(value))) {
-                    arena->add_external_reference(value);
-                }
-                self->members.insert_or_assign(key, value);
+// The instances which were left in place when their arena was evacuated, mapped to the
+// owner of the slab memory they live in.
+absl::flat_hash_map<PyObject*, std::shared_ptr<void>> pinned_instances;
+
+owned_ref<> allocation_sites::report() const {
+    struct totals {
+        std::size_t count = 0;
+        std::size_t bytes = 0;
+    };
+    std::vector<totals> by_site(m_sites.size());
+    for (auto [ob, ix] : m_instances) {
+        // instances referenced from outside of the arena are the only ones with a
+        // reference count
+        if (Py_REFCNT(ob) > 0) {
+            auto* instance = static_cast<arena_allocatable_object*>(ob);
+            ++by_site[ix].count;
+            by_site[ix].bytes +=
+                Py_TYPE(ob)->tp_basicsize + instance->capacity * sizeof(PyObject*);
+        }
+    }
+    std::vector<std::uint32_t> order;
+    for (std::uint32_t ix = 0; ix < by_site.size(); ++ix) {
+        if (by_site[ix].count) {
+            order.push_back(ix);
+        }
+    }
+    std::stable_sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b) {
+        return by_site[a].bytes > by_site[b].bytes;
+    });
+
+    owned_ref out{PyList_New(order.size())};
+    if (!out) {
+        return nullptr;
+    }
+    for (std::size_t n = 0; n < order.size(); ++n) {
+        const site& s = m_sites[order[n]];
+        owned_ref<> filename;
+        owned_ref<> name;
+        if (s.code) {
+            filename = owned_ref<>::new_reference(s.code->co_filename);
+            name = owned_ref<>::new_reference(s.code->co_name);
+        }
+        else {
+            filename = owned_ref{PyUnicode_FromString("<unknown>")};
+            if (!filename) {
+                return nullptr;
             }
-            else {
-                if (self->members.erase(key) == 0) {
-                    PyErr_SetObject(PyExc_AttributeError, key.get());
-                    return -1;
-                }
+            name = owned_ref<>::new_reference(filename);
+        }
+        PyObject* item = Py_BuildValue("(OiOnn)",
+                                       filename.get(),
+                                       s.line,
+                                       name.get(),
+                                       static_cast<Py_ssize_t>(by_site[order[n]].count),
+                                       static_cast<Py_ssize_t>(by_site[order[n]].bytes));
+        if (!item) {
+            return nullptr;
+        }
+        PyList_SET_ITEM(out.get(), n, item);
+    }
+    return out;
+}
+
+/** Take ownership of a reference to `value` on behalf of an object which was allocated
+    in `arena`, or which was allocated globally if `arena` is null.
+
+    Global objects hold a strong reference. Objects in an arena do not hold references
+    to each other; objects that live outside of the arena are added to its external
+    references instead. This may throw, in which case no reference was taken.
+ */
+void store_reference(const std::shared_ptr<arena>& arena, borrowed_ref<> value) {
+    if (!arena) {
+        Py_INCREF(value);
+    }
+    else if (!arena->contains(reinterpret_cast<std::byte*>(value.get()))) {
+        arena->add_external_reference(value.get());
+    }
+}
+
+/** Release a reference taken with `store_reference`. `value` may be null.
+ */
+void release_reference(const std::shared_ptr<arena>& arena, PyObject* value) {
+    if (!arena) {
+        Py_XDECREF(value);
+    }
+}
+
+/** Get a new reference to `value`, which is stored in an object allocated in `arena`, or
+    allocated globally if `arena` is null.
+
+    An object in the arena with no references from Python is escaping: give it a
+    reference to the arena so that the arena lives at least as long as the object.
+ */
+PyObject* load_reference(const std::shared_ptr<arena>& arena, PyObject* value) {
+    if (value->ob_refcnt == 0) {
+        assert(arena && arena->contains(reinterpret_cast<std::byte*>(value)));
+        auto* instance = static_cast<arena_allocatable_object*>(value);
+        instance->owning_arena = arena;
+        if (arena->tracks_roots() && !instance->rooted) {
+            instance->rooted = true;
+            arena->add_root(value);
+        }
+    }
+    Py_INCREF(value);
+    return value;
+}
+
+void release_held(const std::shared_ptr<qb::arena>& arena, bool stop) {
+    for (PyObject* ob : arena->take_held(stop)) {
+        if (Py_REFCNT(ob) > 1) {
+            Py_SET_REFCNT(ob, Py_REFCNT(ob) - 1);
+            continue;
+        }
+        Py_SET_REFCNT(ob, 0);
+        try {
+            arena->add_weakly_referenced(ob);
+        }
+        catch (const std::bad_alloc&) {
+            PyObject_ClearWeakRefs(ob);
+        }
+        // the caller's reference keeps the arena alive
+        static_cast<arena_allocatable_object*>(ob)->owning_arena.reset();
+    }
+}
+
+/** Check that `ob`, which is referenced from Python, may be modified. The objects in an
+    arena made by `Arena.freeze` may not be.
+
+    @return True if `ob` may be modified, otherwise false with a TypeError raised.
+ */
+bool check_mutable(PyObject* ob) {
+    const std::shared_ptr<arena>& arena =
+        static_cast<arena_allocatable_object*>(ob)->owning_arena;
+    if (arena && arena->frozen()) {
+        PyErr_Format(PyExc_TypeError,
+                     "frozen %s object cannot be modified",
+                     Py_TYPE(ob)->tp_name);
+        return false;
+    }
+    return true;
+}
+
+namespace arena_allocatable_methods {
+// the largest value array to preallocate for new instances of a type
+constexpr std::uint32_t max_attribute_count_hint = 32;
+// the largest value array to allocate inline with a new instance; instances with more
+// attributes than this are rare, and searching the shape is no longer linear
+constexpr std::uint32_t max_inline_values = 8;
+
+/** Zero the fields which subtypes, like `ArenaList`, add after the common header.
+ */
+void zero_subtype_fields(PyTypeObject* cls, std::byte* allocation) {
+    std::memset(allocation + sizeof(arena_allocatable_object),
+                0,
+                cls->tp_basicsize - sizeof(arena_allocatable_object));
+}
+
+/** Free lists of the memory of deallocated global instances, by size, so that
+    allocating a global instance is usually a pop instead of a trip through the GC
+    allocator. Like CPython's free lists for tuples and lists, the memory keeps its
+    untracked GC header, and allocations from the free lists don't count towards the
+    GC's thresholds.
+
+    Each list holds at most `max_bytes` of instances, so the free lists never hold more
+    than about 2 MiB in all. `clear` frees them.
+ */
+class instance_free_list {
+private:
+    // instances larger than this, including their inline values, are always freed
+    static constexpr std::size_t max_size = 256;
+    // the most bytes of instances of one size to keep
+    static constexpr std::size_t max_bytes = 1 << 16;
+
+    std::array<std::vector<PyObject*>, max_size / alignof(PyObject) + 1> m_lists;
+
+    std::vector<PyObject*>* list(std::size_t size) {
+        if (size > max_size) {
+            return nullptr;
+        }
+        return &m_lists[size / alignof(PyObject)];
+    }
+
+public:
+    /** Take the memory for an instance of `size` bytes from its free list.
+
+        @return The memory, or nullptr if the free list is empty.
+     */
+    PyObject* pop(std::size_t size) {
+        std::vector<PyObject*>* instances = list(size);
+        if (!instances || instances->empty()) {
+            return nullptr;
+        }
+        PyObject* out = instances->back();
+        instances->pop_back();
+        return out;
+    }
+
+    /** Keep the memory of a deallocated instance of `size` bytes for reuse.
+
+        @return Whether the memory was kept. If not, the caller must free it.
+     */
+    bool push(std::size_t size, PyObject* ob) {
+        std::vector<PyObject*>* instances = list(size);
+        if (!instances || instances->size() >= max_bytes / size) {
+            return false;
+        }
+        try {
+            instances->push_back(ob);
+        }
+        catch (const std::bad_alloc&) {
+            return false;
+        }
+        return true;
+    }
+
+    /** Free the memory of every kept instance. The GIL must be held.
+     */
+    void clear() {
+        for (std::vector<PyObject*>& instances : m_lists) {
+            for (PyObject* ob : instances) {
+                PyObject_GC_Del(ob);
             }
+            std::vector<PyObject*>{}.swap(instances);
         }
-        else {
-            if (value) {
-                Py_INCREF(value);  // inc before when overwriting an attr with itself
-                auto [it, inserted] = self->members.try_emplace(key, value);
-                if (inserted) {
-                    Py_INCREF(key.get());
-                }
-                else {
-                    Py_DECREF(it->second);
-                    it->second = value;
-                }
+    }
+};
+
+instance_free_list free_instances;
+
+// The storage is never tracked, but `PyType_Ready` requires GC types to have a traverse
+// function.
+int traverse_collectable_storage(PyObject*, visitproc, void*) {
+    return 0;
+}
+
+// A type which is only used to ask `PyObject_GC_NewVar` for a GC allocation of any number
+// of bytes, which `PyObject_GC_New` can't do for a type with a fixed size. The memory is
+// given its real type before it is used.
+PyTypeObject collectable_storage_type = {
+    // clang-format disable
+    PyVarObject_HEAD_INIT(nullptr, 0)
+    // clang-format enable
+    "quelling_blade.arena_allocatable._CollectableStorage",  // tp_name
+    0,                                                       // tp_basicsize
+    1,                                                       // tp_itemsize
+    0,                                                       // tp_dealloc
+    0,                                                       // tp_print
+    0,                                                       // tp_getattr
+    0,                                                       // tp_setattr
+    0,                                                       // tp_reserved
+    0,                                                       // tp_repr
+    0,                                                       // tp_as_number
+    0,                                                       // tp_as_sequence
+    0,                                                       // tp_as_mapping
+    0,                                                       // tp_hash
+    0,                                                       // tp_call
+    0,                                                       // tp_str
+    0,                                                       // tp_getattro
+    0,                                                       // tp_setattro
+    0,                                                       // tp_as_buffer
+    Py_TPFLAGS_HAVE_GC,                                      // tp_flags
+    0,                                                       // tp_doc
+    traverse_collectable_storage,                            // tp_traverse
+};
+
+/** Allocate the memory for a global instance of `cls` followed by `inline_capacity`
+    inline values, preceded by the header that the cycle collector needs, with only
+    `ob_type` initialized. Unlike `PyObject_GC_New`, this doesn't take a reference to
+    `cls`. Free the memory with `free_collectable`.
+
+    @return The memory, or nullptr with a Python exception raised.
+ */
+std::byte* allocate_collectable(PyTypeObject* cls, std::uint32_t inline_capacity = 0) {
+    std::size_t size = cls->tp_basicsize + inline_capacity * sizeof(PyObject*);
+    PyObject* ob = free_instances.pop(size);
+    if (!ob) {
+        ob = reinterpret_cast<PyObject*>(
+            PyObject_GC_NewVar(PyVarObject, &collectable_storage_type, size));
+        if (!ob) {
+            return nullptr;
+        }
+    }
+    Py_SET_TYPE(ob, cls);
+    return reinterpret_cast<std::byte*>(ob);
+}
+
+/** Free memory from `allocate_collectable` for an instance of `size` bytes, including
+    its inline values, which must not be tracked by the GC.
+ */
+void free_collectable(std::size_t size, void* ob) {
+    // `PyObject_GC_Del` reads the type of the object, and the memory on the free lists
+    // may outlive the instance's type
+    Py_SET_TYPE(static_cast<PyObject*>(ob), &collectable_storage_type);
+    if (!free_instances.push(size, static_cast<PyObject*>(ob))) {
+        PyObject_GC_Del(ob);
+    }
+}
+
+/** Allocate a new instance of `cls` in `arena`, or globally if `arena` is null, with
+    room for `inline_capacity` attribute values in the same allocation. This does not
+    call `__init__`.
+
+    @return A new reference, or nullptr with a Python exception raised.
+ */
+arena_allocatable_object* allocate_instance(PyTypeObject* cls,
+                                            const std::shared_ptr<arena>& arena,
+                                            std::uint32_t inline_capacity) {
+    auto* typed_cls = reinterpret_cast<arena_allocatable_meta_object*>(cls);
+    if (!arena) {
+        std::byte* allocation = allocate_collectable(cls, inline_capacity);
+        if (!allocation) {
+            return nullptr;
+        }
+        Py_INCREF(cls);
+        zero_subtype_fields(cls, allocation);
+        auto* out = new (allocation) arena_allocatable_object(arena, typed_cls);
+        out->use_inline_values(inline_capacity);
+        out->collectable = true;
+        PyObject_GC_Track(out);
+        return out;
+    }
+
+    std::byte* allocation =
+        arena->allocate(cls->tp_basicsize + inline_capacity * sizeof(PyObject*),
+                        alignof(arena_allocatable_object));
+    arena->count_objects(1);
+    // the instance's shape is owned by the type, so the type must outlive the arena
+    arena->add_external_reference(reinterpret_cast<PyObject*>(cls));
+    zero_subtype_fields(cls, allocation);
+    auto* out = new (allocation) arena_allocatable_object(arena, typed_cls);
+    out->use_inline_values(inline_capacity);
+    if (arena->tracks_roots()) {
+        out->rooted = true;
+        arena->add_root(out);
+    }
+    return out;
+}
+
+/** Allocate a new instance of `cls` with inline room for as many attributes as other
+    instances of `cls` have needed, up to `max_inline_values`.
+ */
+arena_allocatable_object* allocate_instance(PyTypeObject* cls,
+                                            const std::shared_ptr<arena>& arena) {
+    auto* typed_cls = reinterpret_cast<arena_allocatable_meta_object*>(cls);
+    std::uint32_t inline_capacity =
+        std::min(typed_cls->attribute_count_hint, max_inline_values);
+    return allocate_instance(cls, arena, inline_capacity);
+}
+
+PyObject* new_(PyTypeObject* cls, PyObject*, PyObject*) {
+    try {
+        auto* typed_cls = reinterpret_cast<arena_allocatable_meta_object*>(cls);
+        if (!typed_cls->active_arena_count) {
+            return allocate_instance(cls, nullptr);
+        }
+        owned_ref<arena_context_object> context;
+        if (arena_context_methods::find_arena_context(typed_cls, context)) {
+            return nullptr;
+        }
+        if (!context) {
+            return allocate_instance(cls, nullptr);
+        }
+        arena_allocatable_object* out = allocate_instance(cls, context->arena);
+        if (context->sites) {
+            context->sites->record(out);
+        }
+        return out;
+    }
+    catch (const std::exception& e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+
+// the interned string "__init__", set when the module is initialized
+PyObject* init_name = nullptr;
+
+/** Convert vectorcall arguments into the args tuple and kwargs dict of a regular call.
+    `kwargs` is left null when there are no keyword arguments.
+
+    @return True on success, false with a Python exception raised.
+ */
+bool unpack_vectorcall_args(PyObject* const* args,
+                            Py_ssize_t nargs,
+                            PyObject* kwnames,
+                            owned_ref<>& tuple,
+                            owned_ref<>& kwargs) {
+    tuple = owned_ref{PyTuple_New(nargs)};
+    if (!tuple) {
+        return false;
+    }
+    for (Py_ssize_t ix = 0; ix < nargs; ++ix) {
+        Py_INCREF(args[ix]);
+        PyTuple_SET_ITEM(tuple.get(), ix, args[ix]);
+    }
+    if (kwnames && PyTuple_GET_SIZE(kwnames)) {
+        kwargs = owned_ref{PyDict_New()};
+        if (!kwargs) {
+            return false;
+        }
+        for (Py_ssize_t ix = 0; ix < PyTuple_GET_SIZE(kwnames); ++ix) {
+            if (PyDict_SetItem(kwargs.get(),
+                               PyTuple_GET_ITEM(kwnames, ix),
+                               args[nargs + ix])) {
+                return false;
             }
-            else {
-                auto search = self->members.find(key);
-                if (search == self->members.end()) {
-                    PyErr_SetObject(PyExc_AttributeError, key.get());
-                    return -1;
-                }
-                Py_DECREF(search->first.get());
-                Py_DECREF(search->second);
-                self->members.erase(search);
+        }
+    }
+    return true;
+}
+
+/** Call an unbound function with `self` followed by the vectorcall arguments.
+ */
+PyObject* call_with_self(borrowed_ref<> function,
+                         borrowed_ref<> self,
+                         PyObject* const* args,
+                         std::size_t nargsf,
+                         PyObject* kwnames) {
+    Py_ssize_t nargs = PyVectorcall_NARGS(nargsf);
+    if (nargsf & PY_VECTORCALL_ARGUMENTS_OFFSET) {
+        // the caller allows us to temporarily overwrite the slot before the arguments
+        PyObject** shifted = const_cast<PyObject**>(args) - 1;
+        PyObject* saved = shifted[0];
+        shifted[0] = self.get();
+        PyObject* out = PyObject_Vectorcall(function.get(), shifted, nargs + 1, kwnames);
+        shifted[0] = saved;
+        return out;
+    }
+
+    Py_ssize_t total = nargs + (kwnames ? PyTuple_GET_SIZE(kwnames) : 0);
+    std::vector<PyObject*> shifted(total + 1);
+    shifted[0] = self.get();
+    std::copy_n(args, total, shifted.begin() + 1);
+    return PyObject_Vectorcall(function.get(), shifted.data(), nargs + 1, kwnames);
+}
+
+/** Construct an instance without building an args tuple or kwargs dict. `__init__`
+    methods written in Python are called with vectorcall, and `object.__init__` is
+    skipped.
+ */
+PyObject* vectorcall(PyObject* callable,
+                     PyObject* const* args,
+                     std::size_t nargsf,
+                     PyObject* kwnames) {
+    auto* cls = reinterpret_cast<PyTypeObject*>(callable);
+    Py_ssize_t nargs = PyVectorcall_NARGS(nargsf);
+    if (cls->tp_new != new_) {
+        // a custom `__new__`, use the regular call path
+        owned_ref<> tuple;
+        owned_ref<> kwargs;
+        if (!unpack_vectorcall_args(args, nargs, kwnames, tuple, kwargs)) {
+            return nullptr;
+        }
+        return PyType_Type.tp_call(callable, tuple.get(), kwargs.get());
+    }
+
+    owned_ref self{new_(cls, nullptr, nullptr)};
+    if (!self) {
+        return nullptr;
+    }
+    if (cls->tp_init == PyBaseObject_Type.tp_init) {
+        // `object.__init__` ignores the arguments when `__new__` is overridden
+        return std::move(self).escape();
+    }
+
+    PyObject* init = _PyType_Lookup(cls, init_name);
+    if (init && PyFunction_Check(init)) {
+        owned_ref init_ref = owned_ref<>::new_reference(init);
+        owned_ref res{call_with_self(init, self, args, nargsf, kwnames)};
+        if (!res) {
+            return nullptr;
+        }
+        if (res.get() != Py_None) {
+            PyErr_Format(PyExc_TypeError,
+                         "__init__() should return None, not '%.200s'",
+                         Py_TYPE(res.get())->tp_name);
+            return nullptr;
+        }
+        return std::move(self).escape();
+    }
+
+    // `__init__` is implemented in C, like `ArenaList`'s
+    owned_ref<> tuple;
+    owned_ref<> kwargs;
+    if (!unpack_vectorcall_args(args, nargs, kwnames, tuple, kwargs) ||
+        cls->tp_init(self.get(), tuple.get(), kwargs.get())) {
+        return nullptr;
+    }
+    return std::move(self).escape();
+}
+
+/** Grow the value array of an instance so that it can hold at least `count` values.
+ */
+void reserve_values(borrowed_ref<arena_allocatable_object> self, std::uint32_t count) {
+    if (count <= self->capacity) {
+        return;
+    }
+    auto* type = reinterpret_cast<arena_allocatable_meta_object*>(Py_TYPE(self.get()));
+    std::uint32_t capacity = std::max({count,
+                                       self->capacity * 2,
+                                       type->attribute_count_hint,
+                                       std::uint32_t{2}});
+    type->attribute_count_hint =
+        std::min(std::max(type->attribute_count_hint, count), max_attribute_count_hint);
+
+    PyObject** values;
+    if (self->owning_arena) {
+        // the old array, or the inline values, are released with the rest of the arena
+        values = reinterpret_cast<PyObject**>(
+            self->owning_arena->allocate(capacity * sizeof(PyObject*),
+                                         alignof(PyObject*)));
+        std::copy_n(self->values, self->layout->size(), values);
+    }
+    else {
+        arena::allocator<PyObject*> allocator{nullptr};
+        values = allocator.allocate(capacity);
+        std::copy_n(self->values, self->layout->size(), values);
+        if (self->values_are_separate()) {
+            allocator.deallocate(self->values, self->capacity);
+        }
+    }
+    self->values = values;
+    self->capacity = capacity;
+}
+
+int setattr(PyObject* untyped_self, PyObject* key_ptr, PyObject* value) {
+    // search for a descriptor on the type before looking on the instance
+    auto* tp = reinterpret_cast<arena_allocatable_meta_object*>(Py_TYPE(untyped_self));
+    auto [descr, descr_kind] = tp->descriptors.lookup(Py_TYPE(untyped_self), key_ptr);
+    if (descr_kind == descriptor_cache::kind::data) {
+        Py_INCREF(descr);
+        int res = Py_TYPE(descr)->tp_descr_set(descr.get(), untyped_self, value);
+        Py_DECREF(descr);
+        return res;
+    }
+    if (!check_mutable(untyped_self)) {
+        return -1;
+    }
+
+    try {
+        borrowed_ref self{static_cast<arena_allocatable_object*>(untyped_self)};
+
+        borrowed_ref key{key_ptr};
+        std::int64_t slot = self->layout->lookup(key);
+        if (!value) {
+            if (slot < 0) {
+                PyErr_SetObject(PyExc_AttributeError, key.get());
+                return -1;
+            }
+            shape* layout = self->layout->remove(slot);
+            PyObject* old = self->values[slot];
+            std::copy(self->values + slot + 1,
+                      self->values + self->layout->size(),
+                      self->values + slot);
+            self->layout = layout;
+            release_reference(self->owning_arena, old);
+            return 0;
+        }
+
+        shape* layout = self->layout;
+        if (slot < 0) {
+            owned_ref<> name = owned_ref<>::new_reference(key);
+            if (PyUnicode_CheckExact(key.get())) {
+                // store interned names in the shape so that lookups can compare by
+                // identity
+                PyObject* name_ptr = std::move(name).escape();
+                PyUnicode_InternInPlace(&name_ptr);
+                name = owned_ref<>{name_ptr};
             }
+            layout = self->layout->add(name);
+            reserve_values(self, layout->size());
+            slot = self->layout->size();
         }
+
+        // take the new reference before releasing the old one in case an attribute is
+        // overwritten with itself
+        store_reference(self->owning_arena, value);
+        PyObject* old = (layout == self->layout) ? self->values[slot] : nullptr;
+        self->values[slot] = value;
+        self->layout = layout;
+        release_reference(self->owning_arena, old);
         return 0;
     }
     catch (const std::exception& e) {
@@ -814,9 +1954,15 @@ int setattr(PyObject* untyped_self, PyObject* key_ptr, PyObject* value) {
 PyObject* getattr(PyObject* untyped_self, PyObject* key) {
     borrowed_ref<PyTypeObject> tp = Py_TYPE(untyped_self);
     // search for a descriptor on the type before looking on the instance
-    borrowed_ref<> descr = _PyType_Lookup(tp.get(), key);
-    descrgetfunc descrget = descr ? Py_TYPE(descr)->tp_descr_get : nullptr;
-    if (descrget && PyDescr_IsData(descr)) {
+    auto [descr, descr_kind] =
+        reinterpret_cast<arena_allocatable_meta_object*>(tp.get())->descriptors.lookup(tp,
+                                                                                    key);
+    descrgetfunc descrget = nullptr;
+    if (descr_kind == descriptor_cache::kind::data ||
+        descr_kind == descriptor_cache::kind::non_data) {
+        descrget = Py_TYPE(descr)->tp_descr_get;
+    }
+    if (descrget && descr_kind == descriptor_cache::kind::data) {
         // data descriptors take precedence over instance data, call the descriptor
         Py_INCREF(descr);
         PyObject* res = descrget(descr.get(), untyped_self, static_cast<PyObject*>(tp));
@@ -827,8 +1973,8 @@ PyObject* getattr(PyObject* untyped_self, PyObject* key) {
     try {
         borrowed_ref self{reinterpret_cast<arena_allocatable_object*>(untyped_self)};
 
-        auto it = self->members.find(borrowed_ref{key});
-        if (it == self->members.end()) {
+        std::int64_t slot = self->layout->lookup(key);
+        if (slot < 0) {
             if (descrget) {
                 // use the descriptor if available
                 Py_INCREF(descr);
@@ -837,18 +1983,15 @@ PyObject* getattr(PyObject* untyped_self, PyObject* key) {
                 Py_DECREF(descr);
                 return res;
             }
+            if (descr) {
+                // a plain class attribute
+                Py_INCREF(descr);
+                return descr.get();
+            }
             PyErr_SetObject(PyExc_AttributeError, key);
             return nullptr;
         }
-        PyObject* out = it->second;
-        if (out->ob_refcnt == 0) {
-            assert(self->owning_arena->contains(reinterpret_cast<std::byte*>(out)));
-            // add a reference to the arena
-            reinterpret_cast<arena_allocatable_object*>(out)->owning_arena =
-                self->owning_arena;
-        }
-        Py_INCREF(out);
-        return out;
+        return load_reference(self->owning_arena, self->values[slot]);
     }
     catch (const std::exception& e) {
         PyErr_SetString(PyExc_RuntimeError, e.what());
@@ -856,24 +1999,122 @@ PyObject* getattr(PyObject* untyped_self, PyObject* key) {
     }
 }
 
+/** Stop the GC from tracking a global instance which is being deallocated.
+ */
+void untrack(PyObject* ob) {
+    if (static_cast<arena_allocatable_object*>(ob)->collectable) {
+        PyObject_GC_UnTrack(ob);
+    }
+}
+
+/** Does `ob` have any weak references? Only types created with `weakref=True` support
+    them.
+ */
+bool has_weak_references(PyObject* ob) {
+    Py_ssize_t offset = Py_TYPE(ob)->tp_weaklistoffset;
+    return offset &&
+           *reinterpret_cast<PyObject**>(reinterpret_cast<std::byte*>(ob) + offset);
+}
+
 void dealloc(PyObject* untyped_self) {
     borrowed_ref self{reinterpret_cast<arena_allocatable_object*>(untyped_self)};
 
     if (self->owning_arena) {
-        // we are in an arena, just drop the ref
+        // we are in an arena, just drop the ref; the instance may still be reached from
+        // the arena, so its weak references stay until the arena is torn down
+        if (has_weak_references(untyped_self)) {
+            try {
+                if (self->owning_arena->holding()) {
+                    // keep the weak references resolving while the arena is open: the
+                    // arena takes over the last reference, and the instance keeps its
+                    // reference to the arena until `release_held`
+                    self->owning_arena->hold(untyped_self);
+                    Py_SET_REFCNT(untyped_self, 1);
+                    return;
+                }
+                self->owning_arena->add_weakly_referenced(untyped_self);
+            }
+            catch (const std::bad_alloc&) {
+                PyObject_ClearWeakRefs(untyped_self);
+            }
+        }
         self->owning_arena.reset();
     }
     else {
         // we have no arena, we need to actually clear out the instance and die
-        for (auto [k, v] : self->members) {
-            Py_DECREF(k.get());
-            Py_DECREF(v);
+        untrack(untyped_self);
+        if (has_weak_references(untyped_self)) {
+            PyObject_ClearWeakRefs(untyped_self);
         }
-        Py_DECREF(Py_TYPE(untyped_self));
+        for (std::uint32_t ix = 0; ix < self->layout->size(); ++ix) {
+            Py_DECREF(self->values[ix]);
+        }
+        if (self->values_are_separate()) {
+            arena::allocator<PyObject*>{nullptr}.deallocate(self->values, self->capacity);
+        }
+        PyTypeObject* type = Py_TYPE(untyped_self);
+        std::size_t size = self->allocation_size();
+        bool pinned = self->pinned;
         self->~arena_allocatable_object();
-        PyMem_Free(self.get());
+        if (pinned) {
+            // the memory belongs to a slab from an evacuated arena
+            pinned_instances.erase(untyped_self);
+        }
+        else {
+            free_collectable(size, untyped_self);
+        }
+        Py_DECREF(type);
+    }
+}
+
+int is_gc(PyObject* self) {
+    return static_cast<arena_allocatable_object*>(self)->collectable;
+}
+
+/** Only called for instances tracked by the GC, see `is_gc`.
+ */
+int traverse(PyObject* untyped_self, visitproc visit, void* arg) {
+    borrowed_ref self{reinterpret_cast<arena_allocatable_object*>(untyped_self)};
+    Py_VISIT(Py_TYPE(untyped_self));
+    for (std::uint32_t ix = 0; ix < self->layout->size(); ++ix) {
+        Py_VISIT(self->values[ix]);
     }
+    return 0;
+}
+
+int clear(PyObject* untyped_self) {
+    borrowed_ref self{reinterpret_cast<arena_allocatable_object*>(untyped_self)};
+    // the instance has no attributes before any references are released, which may run
+    // code that uses the instance; new attributes go in a separate array, so the inline
+    // values are not overwritten while they are released
+    bool separate = self->values_are_separate();
+    PyObject** values = std::exchange(self->values, nullptr);
+    std::uint32_t size = self->layout->size();
+    self->layout = reinterpret_cast<arena_allocatable_meta_object*>(Py_TYPE(untyped_self))
+                       ->root_shape.get();
+    std::uint32_t capacity = std::exchange(self->capacity, 0);
+    for (std::uint32_t ix = 0; ix < size; ++ix) {
+        Py_DECREF(values[ix]);
+    }
+    if (separate) {
+        arena::allocator<PyObject*>{nullptr}.deallocate(values, capacity);
+    }
+    return 0;
 }
+
+PyObject* allocate_many(PyObject*, PyObject*, PyObject*);
+
+PyMethodDef methods[] = {
+    {"allocate_many",
+     reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)()>(allocate_many)),
+     METH_VARARGS | METH_KEYWORDS | METH_CLASS,
+     "allocate_many(count, **columns)\n"
+     "\n"
+     "Allocate ``count`` instances at once and return them in an ``ArenaList``. Each "
+     "keyword argument is a sequence of length ``count`` which gives the value of that "
+     "attribute for each instance. ``__init__`` is not called."},
+    {nullptr},
+};
 }  // namespace arena_allocatable_methods
 
 arena_allocatable_meta_object arena_allocatable_type = {PyHeapTypeObject{{
@@ -898,15 +2139,16 @@ arena_allocatable_meta_object arena_allocatable_type = {PyHeapTypeObject{{
     arena_allocatable_methods::getattr,        // tp_getattro
     arena_allocatable_methods::setattr,        // tp_setattro
     0,                                         // tp_as_buffer
-    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,  // tp_flags
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE |
+        Py_TPFLAGS_HAVE_GC,                    // tp_flags
     0,                                         // tp_doc
-    0,                                         // tp_traverse
-    0,                                         // tp_clear
+    arena_allocatable_methods::traverse,       // tp_traverse
+    arena_allocatable_methods::clear,          // tp_clear
     0,                                         // tp_richcompare
     0,                                         // tp_weaklistoffset
     0,                                         // tp_iter
     0,                                         // tp_iternext
-    0,                                         // tp_methods
+    arena_allocatable_methods::methods,        // tp_methods
     0,                                         // tp_members
     0,                                         // tp_getset
     0,                                         // tp_base
@@ -917,25 +2159,3131 @@ arena_allocatable_meta_object arena_allocatable_type = {PyHeapTypeObject{{
     0,                                         // tp_init
     0,                                         // tp_alloc
     arena_allocatable_methods::new_,           // tp_new
+    0,                                         // tp_free
+    arena_allocatable_methods::is_gc,          // tp_is_gc
 }}};
 
-PyModuleDef module = {PyModuleDef_HEAD_INIT,
-                      "quelling_blade.arena_allocatable",
-                      nullptr,
-                      -1,
+/** Format the repr of a container as `TypeName(<repr of contents>)`.
+ */
+PyObject* container_repr(PyObject* self, owned_ref<> contents) {
+    owned_ref contents_repr{PyObject_Repr(contents.get())};
+    if (!contents_repr) {
+        return nullptr;
+    }
+    const char* name = std::strrchr(Py_TYPE(self)->tp_name, '.');
+    name = name ? name + 1 : Py_TYPE(self)->tp_name;
+    return PyUnicode_FromFormat("%s(%U)", name, contents_repr.get());
+}
+
+/** A list which is allocated in the arena, along with its item array, when it is created
+    inside of an `Arena` context. Items are owned with the same rules as the attributes of
+    `ArenaAllocatable` instances, so the list and its items are released with the arena.
+ */
+struct arena_list_object : public arena_allocatable_object {
+    PyObject** items;
+    Py_ssize_t size;
+    Py_ssize_t item_capacity;
+};
+
+// slices create new lists, and lists compare equal to other lists
+extern arena_allocatable_meta_object arena_list_type;
+
+namespace arena_list_methods {
+borrowed_ref<arena_list_object> cast(PyObject* untyped_self) {
+    return static_cast<arena_list_object*>(untyped_self);
+}
+
+/** Grow the item array so that it can hold at least `count` items.
+ */
+void reserve(borrowed_ref<arena_list_object> self, Py_ssize_t count) {
+    if (count <= self->item_capacity) {
+        return;
+    }
+    Py_ssize_t capacity = std::max({count, self->item_capacity * 2, Py_ssize_t{4}});
+    // in an arena the old array is released with the rest of the arena
+    arena::allocator<PyObject*> allocator{self->owning_arena.get()};
+    PyObject** items = allocator.allocate(capacity);
+    std::copy_n(self->items, self->size, items);
+    allocator.deallocate(self->items, self->item_capacity);
+    self->items = items;
+    self->item_capacity = capacity;
+}
+
+void insert_item(borrowed_ref<arena_list_object> self,
+                 Py_ssize_t index,
+                 borrowed_ref<> value) {
+    reserve(self, self->size + 1);
+    store_reference(self->owning_arena, value);
+    std::copy_backward(self->items + index,
+                       self->items + self->size,
+                       self->items + self->size + 1);
+    self->items[index] = value.get();
+    ++self->size;
+}
+
+/** Remove the item at `index` and return the reference that the list held to it.
+ */
+PyObject* remove_item(borrowed_ref<arena_list_object> self, Py_ssize_t index) {
+    PyObject* out = self->items[index];
+    std::copy(self->items + index + 1, self->items + self->size, self->items + index);
+    --self->size;
+    return out;
+}
+
+void clear_items(borrowed_ref<arena_list_object> self) {
+    PyObject** items = std::exchange(self->items, nullptr);
+    Py_ssize_t size = std::exchange(self->size, 0);
+    Py_ssize_t capacity = std::exchange(self->item_capacity, 0);
+    if (!self->owning_arena) {
+        // the list is empty before any references are released, which may run code that
+        // uses the list
+        for (Py_ssize_t ix = 0; ix < size; ++ix) {
+            Py_DECREF(items[ix]);
+        }
+        arena::allocator<PyObject*>{nullptr}.deallocate(items, capacity);
+    }
+}
+
+bool check_index(borrowed_ref<arena_list_object> self, Py_ssize_t index) {
+    if (index < 0 || index >= self->size) {
+        PyErr_SetString(PyExc_IndexError, "ArenaList index out of range");
+        return false;
+    }
+    return true;
+}
+
+Py_ssize_t length(PyObject* untyped_self) {
+    return cast(untyped_self)->size;
+}
+
+PyObject* item(PyObject* untyped_self, Py_ssize_t index) {
+    borrowed_ref self = cast(untyped_self);
+    if (!check_index(self, index)) {
+        return nullptr;
+    }
+    return load_reference(self->owning_arena, self->items[index]);
+}
+
+int ass_item(PyObject* untyped_self, Py_ssize_t index, PyObject* value) {
+    if (!check_mutable(untyped_self)) {
+        return -1;
+    }
+    borrowed_ref self = cast(untyped_self);
+    if (!check_index(self, index)) {
+        return -1;
+    }
+    if (!value) {
+        release_reference(self->owning_arena, remove_item(self, index));
+        return 0;
+    }
+    try {
+        store_reference(self->owning_arena, value);
+    }
+    catch (const std::exception& e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+    PyObject* old = std::exchange(self->items[index], value);
+    release_reference(self->owning_arena, old);
+    return 0;
+}
+
+/** Convert a subscript which is an integer to an index into the list, counting
+    negative indices from the end.
+
+    @return The index, or -1 with a Python exception raised.
+ */
+Py_ssize_t subscript_index(borrowed_ref<arena_list_object> self, PyObject* key) {
+    Py_ssize_t index = PyNumber_AsSsize_t(key, PyExc_IndexError);
+    if (index == -1 && PyErr_Occurred()) {
+        return -1;
+    }
+    if (index < 0) {
+        index += self->size;
+    }
+    return check_index(self, index) ? index : -1;
+}
+
+/** Unpack a slice of a list of `size` items.
+
+    @return The number of items selected, or -1 with a Python exception raised.
+ */
+Py_ssize_t unpack_slice(PyObject* slice,
+                        Py_ssize_t size,
+                        Py_ssize_t* start,
+                        Py_ssize_t* step) {
+    Py_ssize_t stop;
+    if (PySlice_Unpack(slice, start, &stop, step) < 0) {
+        return -1;
+    }
+    return PySlice_AdjustIndices(size, start, &stop, *step);
+}
+
+bool check_subscript(PyObject* key) {
+    if (!PyIndex_Check(key)) {
+        PyErr_Format(PyExc_TypeError,
+                     "ArenaList indices must be integers or slices, not %.200s",
+                     Py_TYPE(key)->tp_name);
+        return false;
+    }
+    return true;
+}
+
+/** A new `ArenaList`, allocated in the current arena like one created by calling
+    `ArenaList()`, holding the items of `self` selected by a slice.
+ */
+PyObject* get_slice(borrowed_ref<arena_list_object> self,
+                    Py_ssize_t start,
+                    Py_ssize_t step,
+                    Py_ssize_t length) {
+    owned_ref out{PyObject_CallNoArgs(reinterpret_cast<PyObject*>(&arena_list_type))};
+    if (!out) {
+        return nullptr;
+    }
+    borrowed_ref typed_out = cast(out.get());
+    try {
+        reserve(typed_out, length);
+        for (Py_ssize_t ix = 0; ix < length; ++ix) {
+            owned_ref value{
+                load_reference(self->owning_arena, self->items[start + ix * step])};
+            insert_item(typed_out, ix, value);
+        }
+    }
+    catch (const std::exception& e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+    return std::move(out).escape();
+}
+
+PyObject* subscript(PyObject* untyped_self, PyObject* key) {
+    borrowed_ref self = cast(untyped_self);
+    if (PySlice_Check(key)) {
+        Py_ssize_t start;
+        Py_ssize_t step;
+        Py_ssize_t length = unpack_slice(key, self->size, &start, &step);
+        if (length < 0) {
+            return nullptr;
+        }
+        return get_slice(self, start, step, length);
+    }
+    if (!check_subscript(key)) {
+        return nullptr;
+    }
+    Py_ssize_t index = subscript_index(self, key);
+    if (index < 0) {
+        return nullptr;
+    }
+    return load_reference(self->owning_arena, self->items[index]);
+}
+
+/** Replace or remove the items of `self` selected by a slice. `value` is null to remove
+    them.
+ */
+int assign_slice(borrowed_ref<arena_list_object> self,
+                 Py_ssize_t start,
+                 Py_ssize_t step,
+                 Py_ssize_t length,
+                 PyObject* value) {
+    owned_ref<> values;
+    Py_ssize_t count = 0;
+    if (value) {
+        // copy the values first, which also makes assigning a list to itself work
+        values = owned_ref{PySequence_List(value)};
+        if (!values) {
+            return -1;
+        }
+        count = PyList_GET_SIZE(values.get());
+        if (step != 1 && count != length) {
+            PyErr_Format(PyExc_ValueError,
+                         "attempt to assign sequence of size %zd to extended slice of "
+                         "size %zd",
+                         count,
+                         length);
+            return -1;
+        }
+    }
+    if (step != 1 && !length) {
+        return 0;
+    }
+    if (step < 0) {
+        // walk the selected items from the lowest index
+        start += (length - 1) * step;
+        step = -step;
+        if (value) {
+            PyList_Reverse(values.get());
+        }
+    }
+
+    std::vector<PyObject*> old;
+    try {
+        old.reserve(length);
+        if (step == 1) {
+            reserve(self, self->size - length + count);
+        }
+        for (Py_ssize_t ix = 0; ix < count; ++ix) {
+            store_reference(self->owning_arena, PyList_GET_ITEM(values.get(), ix));
+        }
+    }
+    catch (const std::exception& e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+
+    // the list is consistent before the old items are released, which may run code that
+    // uses the list
+    for (Py_ssize_t ix = 0; ix < length; ++ix) {
+        old.push_back(self->items[start + ix * step]);
+    }
+    if (step == 1) {
+        PyObject** tail = self->items + start + length;
+        PyObject** end = self->items + self->size;
+        if (count > length) {
+            std::copy_backward(tail, end, end + count - length);
+        }
+        else {
+            std::copy(tail, end, self->items + start + count);
+        }
+        for (Py_ssize_t ix = 0; ix < count; ++ix) {
+            self->items[start + ix] = PyList_GET_ITEM(values.get(), ix);
+        }
+        self->size += count - length;
+    }
+    else if (value) {
+        for (Py_ssize_t ix = 0; ix < count; ++ix) {
+            self->items[start + ix * step] = PyList_GET_ITEM(values.get(), ix);
+        }
+    }
+    else {
+        // move the items which are kept over the removed ones
+        Py_ssize_t dst = start;
+        for (Py_ssize_t src = start; src < self->size; ++src) {
+            if (src >= start + length * step || (src - start) % step) {
+                self->items[dst++] = self->items[src];
+            }
+        }
+        self->size = dst;
+    }
+
+    for (PyObject* ob : old) {
+        release_reference(self->owning_arena, ob);
+    }
+    return 0;
+}
+
+int ass_subscript(PyObject* untyped_self, PyObject* key, PyObject* value) {
+    if (!check_mutable(untyped_self)) {
+        return -1;
+    }
+    borrowed_ref self = cast(untyped_self);
+    if (PySlice_Check(key)) {
+        Py_ssize_t start;
+        Py_ssize_t step;
+        Py_ssize_t length = unpack_slice(key, self->size, &start, &step);
+        if (length < 0) {
+            return -1;
+        }
+        return assign_slice(self, start, step, length, value);
+    }
+    if (!check_subscript(key)) {
+        return -1;
+    }
+    Py_ssize_t index = subscript_index(self, key);
+    if (index < 0) {
+        return -1;
+    }
+    return ass_item(untyped_self, index, value);
+}
+
+/** A new reference to the item at `index` of an `ArenaList` or a `list`, or null if the
+    index is past the end.
+ */
+PyObject* comparable_item(PyObject* ob, Py_ssize_t index) {
+    if (PyList_Check(ob)) {
+        if (index >= PyList_GET_SIZE(ob)) {
+            return nullptr;
+        }
+        return Py_NewRef(PyList_GET_ITEM(ob, index));
+    }
+    borrowed_ref list = cast(ob);
+    if (index >= list->size) {
+        return nullptr;
+    }
+    return load_reference(list->owning_arena, list->items[index]);
+}
+
+/** Compare with another `ArenaList` or a `list` item by item, like `list`.
+ */
+PyObject* richcompare(PyObject* untyped_self, PyObject* other, int op) {
+    if (!PyObject_TypeCheck(other, &arena_list_type.ht_type) && !PyList_Check(other)) {
+        Py_RETURN_NOTIMPLEMENTED;
+    }
+    if ((op == Py_EQ || op == Py_NE) &&
+        PyObject_Size(untyped_self) != PyObject_Size(other)) {
+        return Py_NewRef((op == Py_EQ) ? Py_False : Py_True);
+    }
+    // the comparisons may change either list, so each item is fetched as it is compared
+    for (Py_ssize_t ix = 0;; ++ix) {
+        owned_ref a{comparable_item(untyped_self, ix)};
+        owned_ref b{comparable_item(other, ix)};
+        if (!a || !b) {
+            Py_ssize_t self_size = PyObject_Size(untyped_self);
+            Py_ssize_t other_size = PyObject_Size(other);
+            Py_RETURN_RICHCOMPARE(self_size, other_size, op);
+        }
+        int res = PyObject_RichCompareBool(a.get(), b.get(), Py_EQ);
+        if (res < 0) {
+            return nullptr;
+        }
+        if (!res) {
+            if (op == Py_EQ) {
+                Py_RETURN_FALSE;
+            }
+            if (op == Py_NE) {
+                Py_RETURN_TRUE;
+            }
+            return PyObject_RichCompare(a.get(), b.get(), op);
+        }
+    }
+}
+
+PyObject* remove(PyObject* untyped_self, PyObject* value) {
+    if (!check_mutable(untyped_self)) {
+        return nullptr;
+    }
+    borrowed_ref self = cast(untyped_self);
+    for (Py_ssize_t ix = 0; ix < self->size; ++ix) {
+        owned_ref item{load_reference(self->owning_arena, self->items[ix])};
+        int res = PyObject_RichCompareBool(item.get(), value, Py_EQ);
+        if (res < 0) {
+            return nullptr;
+        }
+        // the comparison may have changed the list
+        if (res && ix < self->size && self->items[ix] == item.get()) {
+            release_reference(self->owning_arena, remove_item(self, ix));
+            Py_RETURN_NONE;
+        }
+    }
+    PyErr_SetString(PyExc_ValueError, "ArenaList.remove(x): x not in list");
+    return nullptr;
+}
+
+int contains(PyObject* untyped_self, PyObject* value) {
+    borrowed_ref self = cast(untyped_self);
+    // the comparison may change the list, so re-check the size on each iteration
+    for (Py_ssize_t ix = 0; ix < self->size; ++ix) {
+        owned_ref item{load_reference(self->owning_arena, self->items[ix])};
+        int res = PyObject_RichCompareBool(item.get(), value, Py_EQ);
+        if (res) {
+            return res;
+        }
+    }
+    return 0;
+}
+
+PyObject* append(PyObject* untyped_self, PyObject* value) {
+    if (!check_mutable(untyped_self)) {
+        return nullptr;
+    }
+    borrowed_ref self = cast(untyped_self);
+    try {
+        insert_item(self, self->size, value);
+    }
+    catch (const std::exception& e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+    Py_RETURN_NONE;
+}
+
+PyObject* extend(PyObject* untyped_self, PyObject* iterable) {
+    if (!check_mutable(untyped_self)) {
+        return nullptr;
+    }
+    borrowed_ref self = cast(untyped_self);
+    owned_ref<> iterable_ref = owned_ref<>::new_reference(iterable);
+    if (iterable == untyped_self) {
+        // iterate over a copy so that the loop ends
+        iterable_ref = owned_ref{PySequence_List(iterable)};
+        if (!iterable_ref) {
+            return nullptr;
+        }
+    }
+    owned_ref it{PyObject_GetIter(iterable_ref.get())};
+    if (!it) {
+        return nullptr;
+    }
+    while (owned_ref value{PyIter_Next(it.get())}) {
+        try {
+            insert_item(self, self->size, value);
+        }
+        catch (const std::exception& e) {
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+            return nullptr;
+        }
+    }
+    if (PyErr_Occurred()) {
+        return nullptr;
+    }
+    Py_RETURN_NONE;
+}
+
+PyObject* insert(PyObject* untyped_self, PyObject* args) {
+    if (!check_mutable(untyped_self)) {
+        return nullptr;
+    }
+    borrowed_ref self = cast(untyped_self);
+    Py_ssize_t index;
+    PyObject* value;
+    if (!PyArg_ParseTuple(args, "nO:insert", &index, &value)) {
+        return nullptr;
+    }
+    if (index < 0) {
+        index = std::max(index + self->size, Py_ssize_t{0});
+    }
+    index = std::min(index, self->size);
+    try {
+        insert_item(self, index, value);
+    }
+    catch (const std::exception& e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+    Py_RETURN_NONE;
+}
+
+PyObject* pop(PyObject* untyped_self, PyObject* args) {
+    if (!check_mutable(untyped_self)) {
+        return nullptr;
+    }
+    borrowed_ref self = cast(untyped_self);
+    Py_ssize_t index = -1;
+    if (!PyArg_ParseTuple(args, "|n:pop", &index)) {
+        return nullptr;
+    }
+    if (!self->size) {
+        PyErr_SetString(PyExc_IndexError, "pop from empty ArenaList");
+        return nullptr;
+    }
+    if (index < 0) {
+        index += self->size;
+    }
+    if (!check_index(self, index)) {
+        return nullptr;
+    }
+    PyObject* out = load_reference(self->owning_arena, self->items[index]);
+    release_reference(self->owning_arena, remove_item(self, index));
+    return out;
+}
+
+PyObject* clear(PyObject* untyped_self, PyObject*) {
+    if (!check_mutable(untyped_self)) {
+        return nullptr;
+    }
+    clear_items(cast(untyped_self));
+    Py_RETURN_NONE;
+}
+
+PyObject* repr(PyObject* untyped_self) {
+    borrowed_ref self = cast(untyped_self);
+    int res = Py_ReprEnter(untyped_self);
+    if (res) {
+        return (res < 0) ? nullptr : PyUnicode_FromString("ArenaList([...])");
+    }
+    owned_ref contents{PyList_New(self->size)};
+    PyObject* out = nullptr;
+    if (contents) {
+        for (Py_ssize_t ix = 0; ix < self->size; ++ix) {
+            PyList_SET_ITEM(contents.get(),
+                            ix,
+                            load_reference(self->owning_arena, self->items[ix]));
+        }
+        out = container_repr(untyped_self, std::move(contents));
+    }
+    Py_ReprLeave(untyped_self);
+    return out;
+}
+
+int init(PyObject* untyped_self, PyObject* args, PyObject* kwargs) {
+    if (!check_mutable(untyped_self)) {
+        return -1;
+    }
+    static const char* const keywords[] = {"", nullptr};
+    PyObject* iterable = nullptr;
+    if (!PyArg_ParseTupleAndKeywords(args,
+                                     kwargs,
+                                     "|O:ArenaList",
+                                     const_cast<char**>(keywords),
+                                     &iterable)) {
+        return -1;
+    }
+    clear_items(cast(untyped_self));
+    if (iterable) {
+        owned_ref res{extend(untyped_self, iterable)};
+        if (!res) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void dealloc(PyObject* untyped_self) {
+    borrowed_ref self = cast(untyped_self);
+    if (!self->owning_arena) {
+        arena_allocatable_methods::untrack(untyped_self);
+        clear_items(self);
+    }
+    arena_allocatable_methods::dealloc(untyped_self);
+}
+
+int traverse(PyObject* untyped_self, visitproc visit, void* arg) {
+    borrowed_ref self = cast(untyped_self);
+    for (Py_ssize_t ix = 0; ix < self->size; ++ix) {
+        Py_VISIT(self->items[ix]);
+    }
+    return arena_allocatable_methods::traverse(untyped_self, visit, arg);
+}
+
+int clear(PyObject* untyped_self) {
+    clear_items(cast(untyped_self));
+    return arena_allocatable_methods::clear(untyped_self);
+}
+
+PySequenceMethods as_sequence = {
+    length,    // sq_length
+    0,         // sq_concat
+    0,         // sq_repeat
+    item,      // sq_item
+    0,         // was_sq_slice
+    ass_item,  // sq_ass_item
+    0,         // was_sq_ass_slice
+    contains,  // sq_contains
+};
+
+PyMappingMethods as_mapping = {
+    length,         // mp_length
+    subscript,      // mp_subscript
+    ass_subscript,  // mp_ass_subscript
+};
+
+PyMethodDef methods[] = {
+    {"append", append, METH_O, "Append an object to the end of the list."},
+    {"extend", extend, METH_O, "Append each object from an iterable to the list."},
+    {"insert", insert, METH_VARARGS, "Insert an object before the given index."},
+    {"pop",
+     pop,
+     METH_VARARGS,
+     "Remove and return the item at the given index, the last item by default."},
+    {"remove", remove, METH_O, "Remove the first item which is equal to an object."},
+    {"clear", clear, METH_NOARGS, "Remove all of the items from the list."},
+    {nullptr},
+};
+}  // namespace arena_list_methods
+
+arena_allocatable_meta_object arena_list_type = {PyHeapTypeObject{{
+    // clang-format off
+    PyVarObject_HEAD_INIT(&arena_allocatable_meta_type, 0)
+    // clang-format on
+    "quelling_blade.arena_allocatable.ArenaList",
+    sizeof(arena_list_object),
+    0,                                         // tp_itemsize
+    arena_list_methods::dealloc,               // tp_dealloc
+    0,                                         // tp_print
+    0,                                         // tp_getattr
+    0,                                         // tp_setattr
+    0,                                         // tp_reserved
+    arena_list_methods::repr,                  // tp_repr
+    0,                                         // tp_as_number
+    &arena_list_methods::as_sequence,          // tp_as_sequence
+    &arena_list_methods::as_mapping,           // tp_as_mapping
+    PyObject_HashNotImplemented,               // tp_hash
+    0,                                         // tp_call
+    0,                                         // tp_str
+    0,                                         // tp_getattro
+    0,                                         // tp_setattro
+    0,                                         // tp_as_buffer
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE |
+        Py_TPFLAGS_HAVE_GC,                    // tp_flags
+    0,                                         // tp_doc
+    arena_list_methods::traverse,              // tp_traverse
+    arena_list_methods::clear,                 // tp_clear
+    arena_list_methods::richcompare,           // tp_richcompare
+    0,                                         // tp_weaklistoffset
+    0,                                         // tp_iter
+    0,                                         // tp_iternext
+    arena_list_methods::methods,               // tp_methods
+    0,                                         // tp_members
+    0,                                         // tp_getset
+    &arena_allocatable_type.ht_type,           // tp_base
+    0,                                         // tp_dict
+    0,                                         // tp_descr_get
+    0,                                         // tp_descr_set
+    0,                                         // tp_dictoffset
+    arena_list_methods::init,                  // tp_init
+    0,                                         // tp_alloc
+    0,                                         // tp_new
+    0,                                         // tp_free
+    arena_allocatable_methods::is_gc,          // tp_is_gc
+}}};
+
+/** An insertion ordered hash table which is allocated in the arena, along with its
+    tables, when it is created inside of an `Arena` context. Keys and values are owned
+    with the same rules as the attributes of `ArenaAllocatable` instances.
+
+    Like `dict`, the entries are stored densely in insertion order and a separate open
+    addressing table maps hashes to entry indices. Removing an entry only clears its key,
+    the entries are compacted the next time the table grows.
+ */
+struct arena_dict_object : public arena_allocatable_object {
+    struct entry {
+        Py_hash_t hash;
+        // null if the entry was removed
+        PyObject* key;
+        PyObject* value;
+    };
+
+    entry* entries;
+    // indices into `entries`, or `empty_index`; the length is `table_size`
+    std::int32_t* indices;
+    // zero or a power of two
+    std::uint32_t table_size;
+    // the number of entries which have been used, including removed entries
+    std::uint32_t used;
+    // the number of live entries
+    std::uint32_t size;
+    // incremented whenever `entries` is reallocated, used to detect changes made while
+    // comparing keys
+    std::uint32_t version;
+};
+
+// dicts compare equal to other dicts
+extern arena_allocatable_meta_object arena_dict_type;
+
+namespace arena_dict_methods {
+constexpr std::int32_t empty_index = -1;
+constexpr std::uint32_t min_table_size = 8;
+constexpr std::uint32_t max_table_size = std::uint32_t{1} << 31;
+
+// results of `find` which are not entry indices
+constexpr std::int64_t not_found = -1;
+constexpr std::int64_t error = -2;
+
+using entry = arena_dict_object::entry;
+
+borrowed_ref<arena_dict_object> cast(PyObject* untyped_self) {
+    return static_cast<arena_dict_object*>(untyped_self);
+}
+
+/** The number of entries which can be used before a table of `table_size` must grow.
+ */
+std::uint32_t usable(std::uint32_t table_size) {
+    return table_size / 3 * 2;
+}
+
+std::uint32_t free_index_slot(borrowed_ref<arena_dict_object> self, Py_hash_t hash) {
+    std::size_t mask = self->table_size - 1;
+    std::size_t perturb = static_cast<std::size_t>(hash);
+    std::size_t ix = perturb & mask;
+    while (self->indices[ix] != empty_index) {
+        perturb >>= 5;
+        ix = (ix * 5 + perturb + 1) & mask;
+    }
+    return ix;
+}
+
+/** The smallest table size with room for `count` entries.
+ */
+std::uint32_t table_size_for(std::uint32_t count) {
+    std::uint32_t table_size = min_table_size;
+    while (usable(table_size) < count) {
+        if (table_size == max_table_size) {
+            throw std::length_error{"ArenaDict is too large"};
+        }
+        table_size <<= 1;
+    }
+    return table_size;
+}
+
+/** Reallocate the tables with room for at least `count` entries, dropping removed
+    entries.
+ */
+void resize(borrowed_ref<arena_dict_object> self, std::uint32_t count) {
+    std::uint32_t table_size = table_size_for(count);
+    arena* owner = self->owning_arena.get();
+    entry* entries = arena::allocator<entry>{owner}.allocate(usable(table_size));
+    std::int32_t* indices;
+    try {
+        indices = arena::allocator<std::int32_t>{owner}.allocate(table_size);
+    }
+    catch (...) {
+        arena::allocator<entry>{owner}.deallocate(entries, usable(table_size));
+        throw;
+    }
+    std::fill_n(indices, table_size, empty_index);
+
+    entry* old_entries = std::exchange(self->entries, entries);
+    std::int32_t* old_indices = std::exchange(self->indices, indices);
+    std::uint32_t old_table_size = std::exchange(self->table_size, table_size);
+    std::uint32_t old_used = std::exchange(self->used, 0);
+    ++self->version;
+    for (std::uint32_t ix = 0; ix < old_used; ++ix) {
+        if (old_entries[ix].key) {
+            self->indices[free_index_slot(self, old_entries[ix].hash)] = self->used;
+            self->entries[self->used++] = old_entries[ix];
+        }
+    }
+    // in an arena the old tables are released with the rest of the arena
+    arena::allocator<entry>{owner}.deallocate(old_entries, usable(old_table_size));
+    arena::allocator<std::int32_t>{owner}.deallocate(old_indices, old_table_size);
+}
+
+/** Find the index of the entry for `key`.
+
+    @return The entry index, `not_found`, or `error` with a Python exception raised.
+ */
+std::int64_t find(borrowed_ref<arena_dict_object> self,
+                  borrowed_ref<> key,
+                  Py_hash_t hash) {
+restart:
+    if (!self->table_size) {
+        return not_found;
+    }
+    std::size_t mask = self->table_size - 1;
+    std::size_t perturb = static_cast<std::size_t>(hash);
+    std::size_t slot = perturb & mask;
+    while (true) {
+        std::int32_t ix = self->indices[slot];
+        if (ix == empty_index) {
+            return not_found;
+        }
+        PyObject* candidate = self->entries[ix].key;
+        if (candidate == key.get()) {
+            return ix;
+        }
+        if (candidate && self->entries[ix].hash == hash) {
+            std::uint32_t version = self->version;
+            owned_ref candidate_ref{load_reference(self->owning_arena, candidate)};
+            int res = PyObject_RichCompareBool(candidate, key.get(), Py_EQ);
+            if (res < 0) {
+                return error;
+            }
+            if (self->version != version || self->entries[ix].key != candidate) {
+                // the comparison changed the dict, the probe sequence is no longer valid
+                goto restart;
+            }
+            if (res) {
+                return ix;
+            }
+        }
+        perturb >>= 5;
+        slot = (slot * 5 + perturb + 1) & mask;
+    }
+}
+
+/** Add an entry for a key which is not in the dict.
+ */
+void insert_new(borrowed_ref<arena_dict_object> self,
+                borrowed_ref<> key,
+                Py_hash_t hash,
+                borrowed_ref<> value) {
+    if (self->used == usable(self->table_size)) {
+        resize(self, self->size * 3 / 2 + 1);
+    }
+    store_reference(self->owning_arena, key);
+    store_reference(self->owning_arena, value);
+    self->indices[free_index_slot(self, hash)] = self->used;
+    self->entries[self->used++] = {hash, key.get(), value.get()};
+    ++self->size;
+}
+
+void remove_entry(borrowed_ref<arena_dict_object> self, std::uint32_t ix) {
+    PyObject* key = std::exchange(self->entries[ix].key, nullptr);
+    PyObject* value = std::exchange(self->entries[ix].value, nullptr);
+    --self->size;
+    release_reference(self->owning_arena, key);
+    release_reference(self->owning_arena, value);
+}
+
+void clear_entries(borrowed_ref<arena_dict_object> self) {
+    entry* entries = std::exchange(self->entries, nullptr);
+    std::int32_t* indices = std::exchange(self->indices, nullptr);
+    std::uint32_t table_size = std::exchange(self->table_size, 0);
+    std::uint32_t used = std::exchange(self->used, 0);
+    self->size = 0;
+    ++self->version;
+    if (!self->owning_arena) {
+        // the dict is empty before any references are released, which may run code that
+        // uses the dict
+        for (std::uint32_t ix = 0; ix < used; ++ix) {
+            if (entries[ix].key) {
+                Py_DECREF(entries[ix].key);
+                Py_DECREF(entries[ix].value);
+            }
+        }
+        arena::allocator<entry>{nullptr}.deallocate(entries, usable(table_size));
+        arena::allocator<std::int32_t>{nullptr}.deallocate(indices, table_size);
+    }
+}
+
+void set_key_error(borrowed_ref<> key) {
+    // wrap the key in a tuple so that tuple keys are not unpacked into the arguments
+    owned_ref args{PyTuple_Pack(1, key.get())};
+    if (args) {
+        PyErr_SetObject(PyExc_KeyError, args.get());
+    }
+}
+
+/** Find the entry for a key, computing its hash.
+
+    @return The entry index, `not_found`, or `error` with a Python exception raised.
+ */
+std::int64_t find(borrowed_ref<arena_dict_object> self,
+                  borrowed_ref<> key,
+                  Py_hash_t* hash) {
+    *hash = PyObject_Hash(key.get());
+    if (*hash == -1) {
+        return error;
+    }
+    return find(self, key, *hash);
+}
+
+Py_ssize_t length(PyObject* untyped_self) {
+    return cast(untyped_self)->size;
+}
+
+PyObject* subscript(PyObject* untyped_self, PyObject* key) {
+    borrowed_ref self = cast(untyped_self);
+    Py_hash_t hash;
+    std::int64_t ix = find(self, key, &hash);
+    if (ix == error) {
+        return nullptr;
+    }
+    if (ix == not_found) {
+        set_key_error(key);
+        return nullptr;
+    }
+    return load_reference(self->owning_arena, self->entries[ix].value);
+}
+
+int ass_subscript(PyObject* untyped_self, PyObject* key, PyObject* value) {
+    if (!check_mutable(untyped_self)) {
+        return -1;
+    }
+    borrowed_ref self = cast(untyped_self);
+    Py_hash_t hash;
+    std::int64_t ix = find(self, key, &hash);
+    if (ix == error) {
+        return -1;
+    }
+    if (!value) {
+        if (ix == not_found) {
+            set_key_error(key);
+            return -1;
+        }
+        remove_entry(self, ix);
+        return 0;
+    }
+    try {
+        if (ix == not_found) {
+            insert_new(self, key, hash, value);
+            return 0;
+        }
+        store_reference(self->owning_arena, value);
+    }
+    catch (const std::exception& e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return -1;
+    }
+    PyObject* old = std::exchange(self->entries[ix].value, value);
+    release_reference(self->owning_arena, old);
+    return 0;
+}
+
+int contains(PyObject* untyped_self, PyObject* key) {
+    Py_hash_t hash;
+    std::int64_t ix = find(cast(untyped_self), key, &hash);
+    if (ix == error) {
+        return -1;
+    }
+    return ix != not_found;
+}
+
+/** Build a list with one entry for each live entry in the dict.
+ */
+template<typename F>
+PyObject* entry_list(borrowed_ref<arena_dict_object> self, F&& f) {
+    owned_ref out{PyList_New(self->size)};
+    if (!out) {
+        return nullptr;
+    }
+    Py_ssize_t out_ix = 0;
+    for (std::uint32_t ix = 0; ix < self->used; ++ix) {
+        const entry& e = self->entries[ix];
+        if (e.key) {
+            PyObject* item = f(e);
+            if (!item) {
+                return nullptr;
+            }
+            PyList_SET_ITEM(out.get(), out_ix++, item);
+        }
+    }
+    return std::move(out).escape();
+}
+
+PyObject* keys(PyObject* untyped_self, PyObject*) {
+    borrowed_ref self = cast(untyped_self);
+    return entry_list(self, [&](const entry& e) {
+        return load_reference(self->owning_arena, e.key);
+    });
+}
+
+PyObject* values(PyObject* untyped_self, PyObject*) {
+    borrowed_ref self = cast(untyped_self);
+    return entry_list(self, [&](const entry& e) {
+        return load_reference(self->owning_arena, e.value);
+    });
+}
+
+PyObject* items(PyObject* untyped_self, PyObject*) {
+    borrowed_ref self = cast(untyped_self);
+    return entry_list(self, [&](const entry& e) {
+        owned_ref key{load_reference(self->owning_arena, e.key)};
+        owned_ref value{load_reference(self->owning_arena, e.value)};
+        return PyTuple_Pack(2, key.get(), value.get());
+    });
+}
+
+PyObject* iter(PyObject* untyped_self) {
+    owned_ref keys_list{keys(untyped_self, nullptr)};
+    if (!keys_list) {
+        return nullptr;
+    }
+    return PyObject_GetIter(keys_list.get());
+}
+
+PyObject* get(PyObject* untyped_self, PyObject* args) {
+    borrowed_ref self = cast(untyped_self);
+    PyObject* key;
+    PyObject* default_ = Py_None;
+    if (!PyArg_UnpackTuple(args, "get", 1, 2, &key, &default_)) {
+        return nullptr;
+    }
+    Py_hash_t hash;
+    std::int64_t ix = find(self, key, &hash);
+    if (ix == error) {
+        return nullptr;
+    }
+    if (ix == not_found) {
+        Py_INCREF(default_);
+        return default_;
+    }
+    return load_reference(self->owning_arena, self->entries[ix].value);
+}
+
+PyObject* setdefault(PyObject* untyped_self, PyObject* args) {
+    if (!check_mutable(untyped_self)) {
+        return nullptr;
+    }
+    borrowed_ref self = cast(untyped_self);
+    PyObject* key;
+    PyObject* default_ = Py_None;
+    if (!PyArg_UnpackTuple(args, "setdefault", 1, 2, &key, &default_)) {
+        return nullptr;
+    }
+    Py_hash_t hash;
+    std::int64_t ix = find(self, key, &hash);
+    if (ix == error) {
+        return nullptr;
+    }
+    if (ix != not_found) {
+        return load_reference(self->owning_arena, self->entries[ix].value);
+    }
+    try {
+        insert_new(self, key, hash, default_);
+    }
+    catch (const std::exception& e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+    Py_INCREF(default_);
+    return default_;
+}
+
+PyObject* pop(PyObject* untyped_self, PyObject* args) {
+    if (!check_mutable(untyped_self)) {
+        return nullptr;
+    }
+    borrowed_ref self = cast(untyped_self);
+    PyObject* key;
+    PyObject* default_ = nullptr;
+    if (!PyArg_UnpackTuple(args, "pop", 1, 2, &key, &default_)) {
+        return nullptr;
+    }
+    Py_hash_t hash;
+    std::int64_t ix = find(self, key, &hash);
+    if (ix == error) {
+        return nullptr;
+    }
+    if (ix == not_found) {
+        if (!default_) {
+            set_key_error(key);
+            return nullptr;
+        }
+        Py_INCREF(default_);
+        return default_;
+    }
+    PyObject* out = load_reference(self->owning_arena, self->entries[ix].value);
+    remove_entry(self, ix);
+    return out;
+}
+
+PyObject* clear(PyObject* untyped_self, PyObject*) {
+    if (!check_mutable(untyped_self)) {
+        return nullptr;
+    }
+    clear_entries(cast(untyped_self));
+    Py_RETURN_NONE;
+}
+
+/** Insert the items of a mapping, or an iterable of key value pairs, like `dict.update`.
+ */
+int update_from(PyObject* untyped_self, PyObject* other) {
+    int has_keys = PyObject_HasAttrString(other, "keys");
+    if (has_keys) {
+        owned_ref keys_list{PyMapping_Keys(other)};
+        if (!keys_list) {
+            return -1;
+        }
+        for (Py_ssize_t ix = 0; ix < PyList_GET_SIZE(keys_list.get()); ++ix) {
+            PyObject* key = PyList_GET_ITEM(keys_list.get(), ix);
+            owned_ref value{PyObject_GetItem(other, key)};
+            if (!value || ass_subscript(untyped_self, key, value.get())) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    owned_ref it{PyObject_GetIter(other)};
+    if (!it) {
+        return -1;
+    }
+    while (owned_ref item{PyIter_Next(it.get())}) {
+        owned_ref pair{PySequence_Fast(item.get(), "cannot convert ArenaDict update "
+                                                   "sequence element to a sequence")};
+        if (!pair) {
+            return -1;
+        }
+        if (PySequence_Fast_GET_SIZE(pair.get()) != 2) {
+            PyErr_Format(PyExc_ValueError,
+                         "ArenaDict update sequence element has length %zd; 2 is "
+                         "required",
+                         PySequence_Fast_GET_SIZE(pair.get()));
+            return -1;
+        }
+        PyObject** pair_items = PySequence_Fast_ITEMS(pair.get());
+        if (ass_subscript(untyped_self, pair_items[0], pair_items[1])) {
+            return -1;
+        }
+    }
+    return PyErr_Occurred() ? -1 : 0;
+}
+
+int update_impl(const char* name,
+                PyObject* untyped_self,
+                PyObject* args,
+                PyObject* kwargs) {
+    if (!check_mutable(untyped_self)) {
+        return -1;
+    }
+    PyObject* other = nullptr;
+    if (!PyArg_UnpackTuple(args, name, 0, 1, &other)) {
+        return -1;
+    }
+    if (other && update_from(untyped_self, other)) {
+        return -1;
+    }
+    if (kwargs && update_from(untyped_self, kwargs)) {
+        return -1;
+    }
+    return 0;
+}
+
+/** Compare with another `ArenaDict` or a `dict`. Like `dict`, only equality is defined,
+    and the order of the entries doesn't matter.
+ */
+PyObject* richcompare(PyObject* untyped_self, PyObject* other, int op) {
+    if ((op != Py_EQ && op != Py_NE) ||
+        (!PyObject_TypeCheck(other, &arena_dict_type.ht_type) && !PyDict_Check(other))) {
+        Py_RETURN_NOTIMPLEMENTED;
+    }
+    borrowed_ref self = cast(untyped_self);
+    bool equal = PyObject_Size(untyped_self) == PyObject_Size(other);
+    // the comparisons may change the dict, so re-check the entries on each iteration
+    for (std::uint32_t ix = 0; equal && ix < self->used; ++ix) {
+        if (!self->entries[ix].key) {
+            continue;
+        }
+        owned_ref key{load_reference(self->owning_arena, self->entries[ix].key)};
+        owned_ref value{load_reference(self->owning_arena, self->entries[ix].value)};
+        owned_ref other_value{PyObject_GetItem(other, key.get())};
+        if (!other_value) {
+            if (!PyErr_ExceptionMatches(PyExc_KeyError)) {
+                return nullptr;
+            }
+            PyErr_Clear();
+            equal = false;
+            break;
+        }
+        int res = PyObject_RichCompareBool(value.get(), other_value.get(), Py_EQ);
+        if (res < 0) {
+            return nullptr;
+        }
+        equal = res;
+    }
+    return Py_NewRef((equal == (op == Py_EQ)) ? Py_True : Py_False);
+}
+
+PyObject* update(PyObject* untyped_self, PyObject* args, PyObject* kwargs) {
+    if (update_impl("update", untyped_self, args, kwargs)) {
+        return nullptr;
+    }
+    Py_RETURN_NONE;
+}
+
+PyObject* repr(PyObject* untyped_self) {
+    borrowed_ref self = cast(untyped_self);
+    int res = Py_ReprEnter(untyped_self);
+    if (res) {
+        return (res < 0) ? nullptr : PyUnicode_FromString("ArenaDict({...})");
+    }
+    PyObject* out = nullptr;
+    owned_ref contents{PyDict_New()};
+    if (contents) {
+        // inserting into the dict may run code which changes this dict, so re-check
+        // the bounds on each iteration
+        bool ok = true;
+        for (std::uint32_t ix = 0; ok && ix < self->used; ++ix) {
+            if (!self->entries[ix].key) {
+                continue;
+            }
+            owned_ref key{load_reference(self->owning_arena, self->entries[ix].key)};
+            owned_ref value{load_reference(self->owning_arena, self->entries[ix].value)};
+            ok = !PyDict_SetItem(contents.get(), key.get(), value.get());
+        }
+        if (ok) {
+            out = container_repr(untyped_self, std::move(contents));
+        }
+    }
+    Py_ReprLeave(untyped_self);
+    return out;
+}
+
+int init(PyObject* untyped_self, PyObject* args, PyObject* kwargs) {
+    return update_impl("ArenaDict", untyped_self, args, kwargs);
+}
+
+void dealloc(PyObject* untyped_self) {
+    borrowed_ref self = cast(untyped_self);
+    if (!self->owning_arena) {
+        arena_allocatable_methods::untrack(untyped_self);
+        clear_entries(self);
+    }
+    arena_allocatable_methods::dealloc(untyped_self);
+}
+
+int traverse(PyObject* untyped_self, visitproc visit, void* arg) {
+    borrowed_ref self = cast(untyped_self);
+    for (std::uint32_t ix = 0; ix < self->used; ++ix) {
+        if (self->entries[ix].key) {
+            Py_VISIT(self->entries[ix].key);
+            Py_VISIT(self->entries[ix].value);
+        }
+    }
+    return arena_allocatable_methods::traverse(untyped_self, visit, arg);
+}
+
+int clear(PyObject* untyped_self) {
+    clear_entries(cast(untyped_self));
+    return arena_allocatable_methods::clear(untyped_self);
+}
+
+PyMappingMethods as_mapping = {
+    length,         // mp_length
+    subscript,      // mp_subscript
+    ass_subscript,  // mp_ass_subscript
+};
+
+PySequenceMethods as_sequence = {
+    0,         // sq_length
+    0,         // sq_concat
+    0,         // sq_repeat
+    0,         // sq_item
+    0,         // was_sq_slice
+    0,         // sq_ass_item
+    0,         // was_sq_ass_slice
+    contains,  // sq_contains
+};
+
+PyMethodDef methods[] = {
+    {"keys", keys, METH_NOARGS, "Return a list of the keys in insertion order."},
+    {"values", values, METH_NOARGS, "Return a list of the values in insertion order."},
+    {"items",
+     items,
+     METH_NOARGS,
+     "Return a list of the (key, value) pairs in insertion order."},
+    {"get",
+     get,
+     METH_VARARGS,
+     "Return the value for a key if it is in the dict, otherwise the default."},
+    {"setdefault",
+     setdefault,
+     METH_VARARGS,
+     "Insert a key with the default value if it is not in the dict, then return the "
+     "value for the key."},
+    {"pop",
+     pop,
+     METH_VARARGS,
+     "Remove a key and return its value, or the default if the key is not in the dict."},
+    {"update",
+     reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)()>(update)),
+     METH_VARARGS | METH_KEYWORDS,
+     "Insert the items from a mapping or iterable of pairs, and from the keyword "
+     "arguments."},
+    {"clear", clear, METH_NOARGS, "Remove all of the items from the dict."},
+    {nullptr},
+};
+}  // namespace arena_dict_methods
+
+arena_allocatable_meta_object arena_dict_type = {PyHeapTypeObject{{
+    // clang-format off
+    PyVarObject_HEAD_INIT(&arena_allocatable_meta_type, 0)
+    // clang-format on
+    "quelling_blade.arena_allocatable.ArenaDict",
+    sizeof(arena_dict_object),
+    0,                                         // tp_itemsize
+    arena_dict_methods::dealloc,               // tp_dealloc
+    0,                                         // tp_print
+    0,                                         // tp_getattr
+    0,                                         // tp_setattr
+    0,                                         // tp_reserved
+    arena_dict_methods::repr,                  // tp_repr
+    0,                                         // tp_as_number
+    &arena_dict_methods::as_sequence,          // tp_as_sequence
+    &arena_dict_methods::as_mapping,           // tp_as_mapping
+    PyObject_HashNotImplemented,               // tp_hash
+    0,                                         // tp_call
+    0,                                         // tp_str
+    0,                                         // tp_getattro
+    0,                                         // tp_setattro
+    0,                                         // tp_as_buffer
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE |
+        Py_TPFLAGS_HAVE_GC,                    // tp_flags
+    0,                                         // tp_doc
+    arena_dict_methods::traverse,              // tp_traverse
+    arena_dict_methods::clear,                 // tp_clear
+    arena_dict_methods::richcompare,           // tp_richcompare
+    0,                                         // tp_weaklistoffset
+    arena_dict_methods::iter,                  // tp_iter
+    0,                                         // tp_iternext
+    arena_dict_methods::methods,               // tp_methods
+    0,                                         // tp_members
+    0,                                         // tp_getset
+    &arena_allocatable_type.ht_type,           // tp_base
+    0,                                         // tp_dict
+    0,                                         // tp_descr_get
+    0,                                         // tp_descr_set
+    0,                                         // tp_dictoffset
+    arena_dict_methods::init,                  // tp_init
+    0,                                         // tp_alloc
+    0,                                         // tp_new
+    0,                                         // tp_free
+    arena_allocatable_methods::is_gc,          // tp_is_gc
+}}};
+
+namespace evacuation {
+/** The new storage for an object reachable from the escaped instances of an arena.
+ */
+struct plan {
+    arena_allocatable_object* src;
+    // `src` itself for escaped instances, which are converted in place, otherwise a new
+    // global allocation
+    arena_allocatable_object* dst;
+    PyObject** values;
+    // for `ArenaList` instances
+    PyObject** items;
+    // for `ArenaDict` instances
+    arena_dict_object::entry* entries;
+    std::int32_t* indices;
+};
+
+bool is_list(PyObject* ob) {
+    return PyObject_TypeCheck(ob, &arena_list_type.ht_type);
+}
+
+bool is_dict(PyObject* ob) {
+    return PyObject_TypeCheck(ob, &arena_dict_type.ht_type);
+}
+
+/** Call `f` with each object that `ob` holds a reference to.
+ */
+template<typename F>
+void for_each_reference(arena_allocatable_object* ob, F&& f) {
+    for (std::uint32_t ix = 0; ix < ob->layout->size(); ++ix) {
+        f(ob->values[ix]);
+    }
+    if (is_list(ob)) {
+        auto* list = static_cast<arena_list_object*>(ob);
+        std::for_each(list->items, list->items + list->size, f);
+    }
+    else if (is_dict(ob)) {
+        auto* dict = static_cast<arena_dict_object*>(ob);
+        for (std::uint32_t ix = 0; ix < dict->used; ++ix) {
+            if (dict->entries[ix].key) {
+                f(dict->entries[ix].key);
+                f(dict->entries[ix].value);
+            }
+        }
+    }
+}
+
+/** Call `f` with each key of `ob`, if it is an `ArenaDict`.
+ */
+template<typename F>
+void for_each_key(arena_allocatable_object* ob, F&& f) {
+    if (is_dict(ob)) {
+        auto* dict = static_cast<arena_dict_object*>(ob);
+        for (std::uint32_t ix = 0; ix < dict->used; ++ix) {
+            if (dict->entries[ix].key) {
+                f(dict->entries[ix].key);
+            }
+        }
+    }
+}
+
+/** Allocate the global arrays which will replace the arena allocated arrays of
+    `p.src`.
+ */
+void allocate_storage(plan& p) {
+    if (p.src->capacity) {
+        p.values = arena::allocator<PyObject*>{nullptr}.allocate(p.src->capacity);
+    }
+    if (is_list(p.src)) {
+        auto* list = static_cast<arena_list_object*>(p.src);
+        if (list->item_capacity) {
+            p.items = arena::allocator<PyObject*>{nullptr}.allocate(list->item_capacity);
+        }
+    }
+    else if (is_dict(p.src)) {
+        auto* dict = static_cast<arena_dict_object*>(p.src);
+        if (dict->table_size) {
+            std::uint32_t usable = arena_dict_methods::usable(dict->table_size);
+            p.entries =
+                arena::allocator<arena_dict_object::entry>{nullptr}.allocate(usable);
+            p.indices =
+                arena::allocator<std::int32_t>{nullptr}.allocate(dict->table_size);
+        }
+    }
+}
+
+void free_storage(plan& p) {
+    arena::allocator<PyObject*>{nullptr}.deallocate(p.values, 0);
+    arena::allocator<PyObject*>{nullptr}.deallocate(p.items, 0);
+    arena::allocator<arena_dict_object::entry>{nullptr}.deallocate(p.entries, 0);
+    arena::allocator<std::int32_t>{nullptr}.deallocate(p.indices, 0);
+    if (p.dst != p.src) {
+        arena_allocatable_methods::free_collectable(Py_TYPE(p.src)->tp_basicsize, p.dst);
+    }
+}
+
+/** Point `p.dst` at its new arrays, which hold strong references to the evacuated
+    version of each object referenced by `p.src`.
+ */
+template<typename F>
+void install_storage(const plan& p, F&& evacuated) {
+    arena_allocatable_object* src = p.src;
+    arena_allocatable_object* dst = p.dst;
+    std::transform(src->values, src->values + src->layout->size(), p.values, evacuated);
+    dst->values = p.values;
+    if (is_list(src)) {
+        auto* src_list = static_cast<arena_list_object*>(src);
+        std::transform(src_list->items,
+                       src_list->items + src_list->size,
+                       p.items,
+                       evacuated);
+        static_cast<arena_list_object*>(dst)->items = p.items;
+    }
+    else if (is_dict(src)) {
+        auto* src_dict = static_cast<arena_dict_object*>(src);
+        if (src_dict->table_size) {
+            for (std::uint32_t ix = 0; ix < src_dict->used; ++ix) {
+                arena_dict_object::entry e = src_dict->entries[ix];
+                if (e.key) {
+                    e.key = evacuated(e.key);
+                    e.value = evacuated(e.value);
+                }
+                p.entries[ix] = e;
+            }
+            std::copy_n(src_dict->indices, src_dict->table_size, p.indices);
+        }
+        static_cast<arena_dict_object*>(dst)->entries = p.entries;
+        static_cast<arena_dict_object*>(dst)->indices = p.indices;
+    }
+    Py_INCREF(Py_TYPE(dst));
+}
+
+/** Convert the escaped instances of an arena, and every object in the arena reachable
+    from them, to global objects, so that the rest of the arena can be freed.
+
+    Python references to the escaped instances can't be updated, so they stay where they
+    are: the slabs holding them are taken out of the arena and only the pages under them
+    stay resident. The objects they reach which are only referenced from inside of the
+    arena are copied into new global objects, which are tracked by the GC like any other
+    global instance.
+
+    The arena must have been tracking roots. If this throws, nothing was changed.
+ */
+result evacuate(qb::arena& arena) {
+    // allocating the copies may start a collection, which can run finalizers that change
+    // the objects being copied
+    struct gc_disabled {
+        int was_enabled = PyGC_Disable();
+
+        ~gc_disabled() {
+            if (was_enabled) {
+                PyGC_Enable();
+            }
+        }
+    } guard;
+
+    std::vector<plan> plans;
+    // src -> dst for every object being evacuated
+    absl::flat_hash_map<PyObject*, arena_allocatable_object*> moved;
+    std::size_t escaped_count = 0;
+    // the dicts with keys which are copied, whose hashes may change
+    std::vector<PyObject*> rehash;
+    std::vector<owned_ref<>> rehash_refs;
+    // the escaped instances' memory and the pages it is on
+    std::vector<qb::arena::slab_range> keep;
+    std::size_t page_size = slab_memory::page_size();
+    absl::flat_hash_set<std::uintptr_t> pages;
+    auto slabs = std::make_shared<std::vector<slab>>();
+    auto add_plan = [&](PyObject* ob) {
+        if (moved.contains(ob)) {
+            return;
+        }
+        auto* src = static_cast<arena_allocatable_object*>(ob);
+        plans.push_back(plan{src, nullptr, nullptr, nullptr, nullptr, nullptr});
+        if (Py_REFCNT(ob) > 0) {
+            plans.back().dst = src;
+            ++escaped_count;
+        }
+        else {
+            std::byte* dst =
+                arena_allocatable_methods::allocate_collectable(Py_TYPE(ob));
+            if (!dst) {
+                PyErr_Clear();
+                throw std::bad_alloc{};
+            }
+            plans.back().dst = reinterpret_cast<arena_allocatable_object*>(dst);
+        }
+        moved.emplace(ob, plans.back().dst);
+    };
+
+    try {
+        for (PyObject* ob : arena.roots()) {
+            if (Py_REFCNT(ob) > 0) {
+                add_plan(ob);
+            }
+        }
+        for (std::size_t ix = 0; ix < plans.size(); ++ix) {
+            allocate_storage(plans[ix]);
+            for_each_reference(plans[ix].src, [&](PyObject* ob) {
+                if (arena.contains(reinterpret_cast<std::byte*>(ob))) {
+                    add_plan(ob);
+                }
+            });
+        }
+        for (const plan& p : plans) {
+            if (p.dst == p.src) {
+                auto* begin = reinterpret_cast<const std::byte*>(p.src);
+                keep.emplace_back(begin, begin + Py_TYPE(p.src)->tp_basicsize);
+            }
+            bool copied_key = false;
+            for_each_key(p.src, [&](PyObject* key) {
+                auto it = moved.find(key);
+                copied_key |= it != moved.end() && it->second != key;
+            });
+            if (copied_key) {
+                rehash.push_back(p.dst);
+            }
+        }
+        for (const auto& [begin, end] : keep) {
+            auto first = reinterpret_cast<std::uintptr_t>(begin) / page_size;
+            auto last = (reinterpret_cast<std::uintptr_t>(end) - 1) / page_size;
+            for (std::uintptr_t page = first; page <= last; ++page) {
+                pages.insert(page);
+            }
+        }
+        std::sort(keep.begin(), keep.end());
+        rehash_refs.reserve(rehash.size());
+        slabs->reserve(arena.slab_count());
+        pinned_instances.reserve(pinned_instances.size() + escaped_count);
+    }
+    catch (...) {
+        for (plan& p : plans) {
+            free_storage(p);
+        }
+        throw;
+    }
+
+    // Nothing below allocates. Initialize the copies before any references to them are
+    // counted.
+    for (const plan& p : plans) {
+        if (p.dst == p.src) {
+            continue;
+        }
+        PyTypeObject* tp = Py_TYPE(p.src);
+        std::memcpy(static_cast<void*>(p.dst), p.src, tp->tp_basicsize);
+        Py_SET_REFCNT(p.dst, 0);
+        new (&p.dst->owning_arena) std::shared_ptr<qb::arena>{};
+        p.dst->rooted = false;
+        p.dst->collectable = true;
+        // the copy's values are always a separate array
+        p.dst->inline_capacity = 0;
+        if (tp->tp_weaklistoffset) {
+            *reinterpret_cast<PyObject**>(reinterpret_cast<std::byte*>(p.dst) +
+                                          tp->tp_weaklistoffset) = nullptr;
+        }
+    }
+    auto evacuated = [&](PyObject* ob) {
+        auto it = moved.find(ob);
+        PyObject* out = (it == moved.end()) ? ob : it->second;
+        Py_INCREF(out);
+        return out;
+    };
+    for (const plan& p : plans) {
+        install_storage(p, evacuated);
+    }
+
+    // the copies have been made, so the rest of the slabs can be released
+    arena.pin(keep, *slabs);
+    for (const plan& p : plans) {
+        if (p.dst != p.src) {
+            PyObject_GC_Track(p.dst);
+        }
+        else {
+            p.src->owning_arena.reset();
+            p.src->pinned = true;
+            pinned_instances.emplace(p.src, slabs);
+        }
+    }
+    for (PyObject* dict : rehash) {
+        rehash_refs.push_back(owned_ref<>::new_reference(dict));
+    }
+    return {plans.size() - escaped_count,
+            pages.size() * page_size,
+            std::move(slabs),
+            std::move(keep),
+            std::move(rehash_refs)};
+}
+
+bool rehash(const result& evacuated) {
+    try {
+        for (const owned_ref<>& ob : evacuated.rehash) {
+            auto* dict = static_cast<arena_dict_object*>(ob.get());
+            std::vector<Py_hash_t> hashes;
+            std::uint32_t version;
+            std::uint32_t used;
+            do {
+                // hashing may change the dict, in which case the hashes are stale
+                version = dict->version;
+                used = dict->used;
+                hashes.assign(used, -1);
+                for (std::uint32_t ix = 0; ix < used; ++ix) {
+                    owned_ref key = owned_ref<>::xnew_reference(dict->entries[ix].key);
+                    if (key && (hashes[ix] = PyObject_Hash(key.get())) == -1) {
+                        return false;
+                    }
+                }
+            } while (dict->version != version || dict->used != used);
+
+            std::fill_n(dict->indices, dict->table_size, arena_dict_methods::empty_index);
+            for (std::uint32_t ix = 0; ix < used; ++ix) {
+                arena_dict_object::entry& e = dict->entries[ix];
+                if (e.key) {
+                    e.hash = hashes[ix];
+                    dict->indices[arena_dict_methods::free_index_slot(dict, e.hash)] = ix;
+                }
+            }
+        }
+    }
+    catch (const std::bad_alloc&) {
+        PyErr_NoMemory();
+        return false;
+    }
+    return true;
+}
+}  // namespace evacuation
+
+namespace snapshot {
+/** The layout of a snapshot file, written by `Arena.save` and read by `Arena.load`.
+
+   A snapshot holds the objects reachable from a root object in an arena. The objects are
+   laid out in an image exactly as they are once the file is mapped into memory, except
+   that the fields which point outside of the image hold indices, and the fields which
+   point into the image hold offsets from its start:
+
+   - `ob_type` is an index into the type table, which names each type so that it can be
+     imported again.
+   - `layout` is an index into the shape table, which lists the attribute names of each
+     shape.
+   - A reference to another object in the image is the object's offset. A reference to
+     an object outside of the arena is `(index << 1) | 1`, where `index` is in the table
+     of external values. Objects are pointer aligned, so the low bit tells them apart.
+   - Value arrays, list items, and dict tables are stored in the image right after the
+     object which owns them.
+
+   The first object in the image is the root. Objects start without any references, and
+   dict entries are hashed again when they are loaded, because `str` hashes are salted
+   per process.
+ */
+constexpr char magic[8] = {'Q', 'B', 'A', 'R', 'E', 'N', 'A', '\0'};
+constexpr std::uint32_t format_version = 1;
+
+/** A `[offset, offset + count)` range of records in the file.
+ */
+struct section {
+    std::uint64_t offset;
+    std::uint64_t count;
+};
+
+struct header {
+    char magic[8];
+    std::uint32_t format_version;
+    // `PY_VERSION_HEX` for the major and minor version, which fix the object layout
+    std::uint32_t python_version;
+    // `sizeof(arena_allocatable_object)`, which depends on how the module was built
+    std::uint64_t object_header_size;
+    // bytes
+    section image;
+    // the offset of each object in the image, as `std::uint64_t`
+    section objects;
+    // `type_record`
+    section types;
+    // `shape_record`
+    section shapes;
+    // indices into `externals` of each shape's attribute names, as `std::uint32_t`
+    section shape_keys;
+    // `external_record`
+    section externals;
+    // bytes, the text of the strings in the other tables
+    section strings;
+};
+
+/** A string stored in the `strings` section.
+ */
+struct string_ref {
+    std::uint64_t offset;
+    std::uint64_t size;
+};
+
+struct type_record {
+    string_ref module;
+    string_ref qualname;
+    // checked against the imported type to catch types which have changed
+    std::uint64_t basicsize;
+};
+
+struct shape_record {
+    std::uint32_t type;
+    // the attribute names are `shape_keys[first_key:first_key + size]`, in slot order
+    std::uint32_t size;
+    std::uint64_t first_key;
+};
+
+struct external_record {
+    enum class kind : std::uint32_t {
+        none,
+        false_value,
+        true_value,
+        // `value` is the integer
+        small_int,
+        // `text` is the integer in hex
+        big_int,
+        // `value` is the bits of the double
+        float_value,
+        // `text` is the UTF-8 encoding, with surrogates passed through
+        str,
+    };
+
+    kind type;
+    std::uint32_t padding;
+    std::uint64_t value;
+    string_ref text;
+};
+
+constexpr std::uint64_t external_tag = 1;
+
+using evacuation::is_dict;
+using evacuation::is_list;
+
+/** The number of bytes an object and its arrays take up when they are laid out
+    together, with each array sized to fit, like in a snapshot image or a frozen arena.
+ */
+std::uint64_t compact_size(arena_allocatable_object* ob) {
+    std::uint64_t size = Py_TYPE(ob)->tp_basicsize +
+                         ob->layout->size() * sizeof(PyObject*);
+    if (is_list(ob)) {
+        size += static_cast<arena_list_object*>(ob)->size * sizeof(PyObject*);
+    }
+    else if (is_dict(ob)) {
+        std::uint32_t count = static_cast<arena_dict_object*>(ob)->size;
+        if (count) {
+            std::uint32_t table_size = arena_dict_methods::table_size_for(count);
+            size += arena_dict_methods::usable(table_size) *
+                        sizeof(arena_dict_object::entry) +
+                    table_size * sizeof(std::int32_t);
+        }
+    }
+    return slab_memory::round_up(size, alignof(arena_allocatable_object));
+}
+
+/** Collect the objects reachable from a root in an arena and lay them out in an image.
+ */
+class writer {
+private:
+    qb::arena& m_arena;
+    // the objects in the order they are laid out, the root first
+    std::vector<arena_allocatable_object*> m_objects;
+    absl::flat_hash_map<PyObject*, std::uint64_t> m_offsets;
+    std::uint64_t m_image_size = 0;
+    std::vector<type_record> m_types;
+    absl::flat_hash_map<PyTypeObject*, std::uint32_t> m_type_index;
+    std::vector<shape_record> m_shapes;
+    absl::flat_hash_map<const shape*, std::uint32_t> m_shape_index;
+    std::vector<std::uint32_t> m_shape_keys;
+    std::vector<external_record> m_externals;
+    absl::flat_hash_map<PyObject*, std::uint32_t> m_external_index;
+    // the kind and encoded value of each external -> its index
+    absl::flat_hash_map<std::string, std::uint32_t> m_external_values;
+    std::string m_strings;
+
+    string_ref add_string(const char* text, std::size_t size) {
+        string_ref out{m_strings.size(), size};
+        m_strings.append(text, size);
+        return out;
+    }
+
+    /** Encode `str` as UTF-8, passing surrogates through.
+
+        @return True on success, false with a Python exception raised.
+     */
+    static bool encode_string(borrowed_ref<> str, std::string& out) {
+        owned_ref bytes{PyUnicode_AsEncodedString(str.get(), "utf-8", "surrogatepass")};
+        if (!bytes) {
+            return false;
+        }
+        out.assign(PyBytes_AS_STRING(bytes.get()), PyBytes_GET_SIZE(bytes.get()));
+        return true;
+    }
+
+    /** @return True on success, false with a Python exception raised.
+     */
+    bool add_string(borrowed_ref<> str, string_ref& out) {
+        std::string text;
+        if (!encode_string(str, text)) {
+            return false;
+        }
+        out = add_string(text.data(), text.size());
+        return true;
+    }
+
+    /** @return The index of `ob` in the external values, or -1 with a Python exception
+                raised.
+     */
+    std::int64_t add_external(PyObject* ob) {
+        if (auto it = m_external_index.find(ob); it != m_external_index.end()) {
+            return it->second;
+        }
+        external_record record{};
+        std::string text;
+        if (ob == Py_None) {
+            record.type = external_record::kind::none;
+        }
+        else if (ob == Py_False) {
+            record.type = external_record::kind::false_value;
+        }
+        else if (ob == Py_True) {
+            record.type = external_record::kind::true_value;
+        }
+        else if (PyLong_CheckExact(ob)) {
+            int overflow;
+            long long value = PyLong_AsLongLongAndOverflow(ob, &overflow);
+            if (value == -1 && PyErr_Occurred()) {
+                return -1;
+            }
+            if (overflow) {
+                record.type = external_record::kind::big_int;
+                owned_ref digits{PyNumber_ToBase(ob, 16)};
+                if (!digits || !encode_string(digits, text)) {
+                    return -1;
+                }
+            }
+            else {
+                record.type = external_record::kind::small_int;
+                record.value = static_cast<std::uint64_t>(value);
+            }
+        }
+        else if (PyFloat_CheckExact(ob)) {
+            record.type = external_record::kind::float_value;
+            double value = PyFloat_AS_DOUBLE(ob);
+            std::memcpy(&record.value, &value, sizeof(value));
+        }
+        else if (PyUnicode_CheckExact(ob)) {
+            record.type = external_record::kind::str;
+            if (!encode_string(ob, text)) {
+                return -1;
+            }
+        }
+        else {
+            PyErr_Format(PyExc_TypeError,
+                         "cannot save a reference to %R, only str, int, float, bool, "
+                         "None, and objects in the same arena can be saved",
+                         ob);
+            return -1;
+        }
+
+        // Equal values are saved once, which matters for values that are built again
+        // for each object, like formatted strings. Only the value is kept, not the
+        // identity of the original objects. Floats are compared by their bits so that
+        // 0.0 and -0.0 stay distinct.
+        std::string key(reinterpret_cast<const char*>(&record.type), sizeof(record.type));
+        key.append(reinterpret_cast<const char*>(&record.value), sizeof(record.value));
+        key.append(text);
+        auto [it, inserted] =
+            m_external_values.try_emplace(std::move(key),
+                                          static_cast<std::uint32_t>(m_externals.size()));
+        if (inserted) {
+            record.text = add_string(text.data(), text.size());
+            m_externals.push_back(record);
+        }
+        m_external_index.emplace(ob, it->second);
+        return it->second;
+    }
+
+    /** @return The index of `cls` in the type table, or -1 with a Python exception
+                raised.
+     */
+    std::int64_t add_type(PyTypeObject* cls) {
+        if (auto it = m_type_index.find(cls); it != m_type_index.end()) {
+            return it->second;
+        }
+        type_record record{};
+        record.basicsize = cls->tp_basicsize;
+        owned_ref module{PyObject_GetAttrString(reinterpret_cast<PyObject*>(cls),
+                                                "__module__")};
+        if (!module) {
+            return -1;
+        }
+        owned_ref qualname{PyObject_GetAttrString(reinterpret_cast<PyObject*>(cls),
+                                                  "__qualname__")};
+        if (!qualname) {
+            return -1;
+        }
+        if (!PyUnicode_Check(module.get()) || !PyUnicode_Check(qualname.get()) ||
+            PyUnicode_FindChar(qualname.get(), '<', 0, PY_SSIZE_T_MAX, 1) != -1) {
+            if (!PyErr_Occurred()) {
+                PyErr_Format(PyExc_TypeError,
+                             "cannot save instances of %R, it can't be imported by name",
+                             cls);
+            }
+            return -1;
+        }
+        if (!add_string(module, record.module) ||
+            !add_string(qualname, record.qualname)) {
+            return -1;
+        }
+        auto index = static_cast<std::uint32_t>(m_types.size());
+        m_types.push_back(record);
+        m_type_index.emplace(cls, index);
+        return index;
+    }
+
+    /** @return The index of `layout` in the shape table, or -1 with a Python exception
+                raised.
+     */
+    std::int64_t add_shape(PyTypeObject* cls, const shape* layout) {
+        if (auto it = m_shape_index.find(layout); it != m_shape_index.end()) {
+            return it->second;
+        }
+        std::int64_t type = add_type(cls);
+        if (type < 0) {
+            return -1;
+        }
+        shape_record record{static_cast<std::uint32_t>(type),
+                            layout->size(),
+                            m_shape_keys.size()};
+        for (std::uint32_t slot = 0; slot < layout->size(); ++slot) {
+            std::int64_t key = add_external(layout->key(slot));
+            if (key < 0) {
+                return -1;
+            }
+            m_shape_keys.push_back(key);
+        }
+        auto index = static_cast<std::uint32_t>(m_shapes.size());
+        m_shapes.push_back(record);
+        m_shape_index.emplace(layout, index);
+        return index;
+    }
+
+    void add_object(PyObject* ob) {
+        auto [it, inserted] = m_offsets.try_emplace(ob, m_image_size);
+        if (inserted) {
+            auto* instance = static_cast<arena_allocatable_object*>(ob);
+            m_objects.push_back(instance);
+            m_image_size += compact_size(instance);
+        }
+    }
+
+    PyObject* encode(PyObject* ob) const {
+        std::uint64_t out;
+        if (auto it = m_offsets.find(ob); it != m_offsets.end()) {
+            out = it->second;
+        }
+        else {
+            out = (std::uint64_t{m_external_index.find(ob)->second} << 1) | external_tag;
+        }
+        return reinterpret_cast<PyObject*>(static_cast<std::uintptr_t>(out));
+    }
+
+    template<typename T>
+    static T* encode_offset(std::uint64_t offset) {
+        return reinterpret_cast<T*>(static_cast<std::uintptr_t>(offset));
+    }
+
+    /** Lay out `ob`, whose references have all been added, at `offset` in `image`.
+     */
+    void write_object(arena_allocatable_object* ob,
+                      std::uint64_t offset,
+                      std::vector<std::byte>& image) const {
+        PyTypeObject* cls = Py_TYPE(ob);
+        std::byte* p = image.data() + offset;
+        // the image starts zeroed, which is a valid state for every other field: no
+        // references, no owning arena, and no weak references
+        auto* out = reinterpret_cast<arena_allocatable_object*>(p);
+        out->ob_type = encode_offset<PyTypeObject>(m_type_index.find(cls)->second);
+        out->layout = encode_offset<shape>(m_shape_index.find(ob->layout)->second);
+        std::uint32_t size = ob->layout->size();
+        std::uint64_t next = offset + cls->tp_basicsize;
+        if (size) {
+            out->values = encode_offset<PyObject*>(next);
+            out->capacity = size;
+            if (size <= std::numeric_limits<std::uint8_t>::max()) {
+                out->inline_capacity = size;
+            }
+            auto* values = reinterpret_cast<PyObject**>(image.data() + next);
+            for (std::uint32_t ix = 0; ix < size; ++ix) {
+                values[ix] = encode(ob->values[ix]);
+            }
+            next += size * sizeof(PyObject*);
+        }
+
+        if (is_list(ob)) {
+            auto* list = static_cast<arena_list_object*>(ob);
+            auto* out_list = static_cast<arena_list_object*>(out);
+            if (list->size) {
+                out_list->items = encode_offset<PyObject*>(next);
+                auto* items = reinterpret_cast<PyObject**>(image.data() + next);
+                for (Py_ssize_t ix = 0; ix < list->size; ++ix) {
+                    items[ix] = encode(list->items[ix]);
+                }
+            }
+            out_list->size = list->size;
+            out_list->item_capacity = list->size;
+        }
+        else if (is_dict(ob)) {
+            auto* dict = static_cast<arena_dict_object*>(ob);
+            auto* out_dict = static_cast<arena_dict_object*>(out);
+            if (dict->size) {
+                std::uint32_t table_size = arena_dict_methods::table_size_for(dict->size);
+                out_dict->entries = encode_offset<arena_dict_object::entry>(next);
+                auto* entries =
+                    reinterpret_cast<arena_dict_object::entry*>(image.data() + next);
+                std::uint32_t used = 0;
+                for (std::uint32_t ix = 0; ix < dict->used; ++ix) {
+                    if (dict->entries[ix].key) {
+                        // the hash is computed again when the dict is loaded
+                        entries[used++] = {0,
+                                           encode(dict->entries[ix].key),
+                                           encode(dict->entries[ix].value)};
+                    }
+                }
+                next += arena_dict_methods::usable(table_size) *
+                        sizeof(arena_dict_object::entry);
+                out_dict->indices = encode_offset<std::int32_t>(next);
+                out_dict->table_size = table_size;
+            }
+            out_dict->used = dict->size;
+            out_dict->size = dict->size;
+        }
+    }
+
+public:
+    explicit writer(qb::arena& arena) : m_arena(arena) {}
+
+    /** Collect the objects reachable from `root`, which must be allocated in the arena.
+
+        @return True on success, false with a Python exception raised.
+     */
+    bool collect(PyObject* root) {
+        add_object(root);
+        for (std::size_t ix = 0; ix < m_objects.size(); ++ix) {
+            arena_allocatable_object* ob = m_objects[ix];
+            if (add_shape(Py_TYPE(ob), ob->layout) < 0) {
+                return false;
+            }
+            bool ok = true;
+            evacuation::for_each_reference(ob, [&](PyObject* ref) {
+                if (!ok) {
+                    return;
+                }
+                if (m_arena.contains(reinterpret_cast<std::byte*>(ref))) {
+                    add_object(ref);
+                }
+                else {
+                    ok = add_external(ref) >= 0;
+                }
+            });
+            if (!ok) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /** Write the collected objects to `fd`.
+
+        @return True on success, false with `errno` set.
+     */
+    bool write(int fd) const {
+        std::vector<std::byte> image(m_image_size);
+        std::vector<std::uint64_t> offsets;
+        offsets.reserve(m_objects.size());
+        for (arena_allocatable_object* ob : m_objects) {
+            std::uint64_t offset = m_offsets.find(ob)->second;
+            write_object(ob, offset, image);
+            offsets.push_back(offset);
+        }
+
+        header h{};
+        std::memcpy(h.magic, magic, sizeof(magic));
+        h.format_version = format_version;
+        h.python_version = PY_VERSION_HEX & 0xffff0000;
+        h.object_header_size = sizeof(arena_allocatable_object);
+
+        // the image is page aligned in the file so that it is page aligned when mapped
+        std::uint64_t end =
+            slab_memory::round_up(sizeof(header), slab_memory::page_size());
+        auto place = [&](section& s, std::uint64_t count, std::uint64_t item_size) {
+            s = {end, count};
+            end = slab_memory::round_up(end + count * item_size, alignof(std::uint64_t));
+        };
+        place(h.image, image.size(), 1);
+        place(h.objects, offsets.size(), sizeof(std::uint64_t));
+        place(h.types, m_types.size(), sizeof(type_record));
+        place(h.shapes, m_shapes.size(), sizeof(shape_record));
+        place(h.shape_keys, m_shape_keys.size(), sizeof(std::uint32_t));
+        place(h.externals, m_externals.size(), sizeof(external_record));
+        place(h.strings, m_strings.size(), 1);
+
+        std::uint64_t position = 0;
+        auto write_at = [&](std::uint64_t offset, const void* data, std::size_t size) {
+            // fill the padding between sections
+            static constexpr std::byte zeros[64]{};
+            while (position < offset) {
+                std::size_t n = std::min<std::uint64_t>(offset - position, sizeof(zeros));
+                if (!write_all(fd, zeros, n)) {
+                    return false;
+                }
+                position += n;
+            }
+            position += size;
+            return write_all(fd, data, size);
+        };
+        return write_at(0, &h, sizeof(h)) &&
+               write_at(h.image.offset, image.data(), image.size()) &&
+               write_at(h.objects.offset,
+                        offsets.data(),
+                        offsets.size() * sizeof(std::uint64_t)) &&
+               write_at(h.types.offset,
+                        m_types.data(),
+                        m_types.size() * sizeof(type_record)) &&
+               write_at(h.shapes.offset,
+                        m_shapes.data(),
+                        m_shapes.size() * sizeof(shape_record)) &&
+               write_at(h.shape_keys.offset,
+                        m_shape_keys.data(),
+                        m_shape_keys.size() * sizeof(std::uint32_t)) &&
+               write_at(h.externals.offset,
+                        m_externals.data(),
+                        m_externals.size() * sizeof(external_record)) &&
+               write_at(h.strings.offset, m_strings.data(), m_strings.size());
+    }
+
+    /** Write all of `size` bytes, retrying short writes.
+
+        @return True on success, false with `errno` set.
+     */
+    static bool write_all(int fd, const void* data, std::size_t size) {
+        auto* p = static_cast<const std::byte*>(data);
+        while (size) {
+            ssize_t written = ::write(fd, p, size);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            p += written;
+            size -= written;
+        }
+        return true;
+    }
+};
+
+bool save(qb::arena& arena, borrowed_ref<> path, borrowed_ref<> root) {
+    writer w{arena};
+    if (!w.collect(root.get())) {
+        return false;
+    }
+
+    // write to a temporary file and move it into place, so that a process loading the
+    // snapshot never sees a partial file
+    const char* target = PyBytes_AS_STRING(path.get());
+    std::string temporary = std::string{target} + ".tmp" + std::to_string(::getpid());
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        PyErr_SetFromErrnoWithFilename(PyExc_OSError, temporary.c_str());
+        return false;
+    }
+    bool written = w.write(fd);
+    int error = errno;
+    if (::close(fd) && written) {
+        written = false;
+        error = errno;
+    }
+    if (written) {
+        if (!::rename(temporary.c_str(), target)) {
+            return true;
+        }
+        error = errno;
+    }
+    ::unlink(temporary.c_str());
+    errno = error;
+    PyErr_SetFromErrnoWithFilename(PyExc_OSError, target);
+    return false;
+}
+
+/** Fix up the objects of a mapped snapshot in place.
+ */
+class reader {
+private:
+    const std::shared_ptr<qb::arena>& m_arena;
+    std::byte* m_base;
+    std::size_t m_size;
+    const header& m_header;
+    std::byte* m_image;
+    std::vector<owned_ref<arena_allocatable_meta_object>> m_types;
+    std::vector<shape*> m_shapes;
+    // borrowed, the arena's external references own these
+    std::vector<PyObject*> m_externals;
+    std::vector<arena_dict_object*> m_dicts;
+
+    bool corrupt() const {
+        PyErr_SetString(PyExc_ValueError, "snapshot is corrupt");
+        return false;
+    }
+
+    /** Does `[offset, offset + count * item_size)` fit in `[0, limit)`?
+     */
+    static bool in_bounds(std::uint64_t offset,
+                          std::uint64_t count,
+                          std::uint64_t item_size,
+                          std::uint64_t limit) {
+        return offset <= limit && count <= (limit - offset) / item_size;
+    }
+
+    template<typename T>
+    const T* records(const section& s) const {
+        return reinterpret_cast<const T*>(m_base + s.offset);
+    }
+
+    bool check(const section& s, std::uint64_t item_size) const {
+        return in_bounds(s.offset, s.count, item_size, m_size) &&
+               s.offset % alignof(std::uint64_t) == 0;
+    }
+
+    /** @return The text of `ref`, or null with a Python exception raised.
+     */
+    const char* text(const string_ref& ref) const {
+        if (!in_bounds(ref.offset, ref.size, 1, m_header.strings.count)) {
+            corrupt();
+            return nullptr;
+        }
+        return reinterpret_cast<const char*>(m_base + m_header.strings.offset +
+                                             ref.offset);
+    }
+
+    owned_ref<> decode_string(const string_ref& ref) const {
+        const char* data = text(ref);
+        if (!data) {
+            return nullptr;
+        }
+        return owned_ref{PyUnicode_DecodeUTF8(data, ref.size, "surrogatepass")};
+    }
+
+    bool load_types() {
+        for (std::uint64_t ix = 0; ix < m_header.types.count; ++ix) {
+            const type_record& record = records<type_record>(m_header.types)[ix];
+            owned_ref module_name = decode_string(record.module);
+            if (!module_name) {
+                return false;
+            }
+            owned_ref qualname = decode_string(record.qualname);
+            if (!qualname) {
+                return false;
+            }
+            owned_ref ob{PyImport_Import(module_name.get())};
+            if (!ob) {
+                return false;
+            }
+            // nested classes are found by walking their qualified name
+            owned_ref dot{PyUnicode_FromString(".")};
+            if (!dot) {
+                return false;
+            }
+            owned_ref parts{PyUnicode_Split(qualname.get(), dot.get(), -1)};
+            if (!parts) {
+                return false;
+            }
+            for (Py_ssize_t part = 0; part < PyList_GET_SIZE(parts.get()); ++part) {
+                ob = owned_ref{
+                    PyObject_GetAttr(ob.get(), PyList_GET_ITEM(parts.get(), part))};
+                if (!ob) {
+                    return false;
+                }
+            }
+            int res = PyObject_IsInstance(ob.get(),
+                                          reinterpret_cast<PyObject*>(
+                                              &arena_allocatable_meta_type));
+            if (res < 0) {
+                return false;
+            }
+            if (!res) {
+                PyErr_Format(PyExc_TypeError,
+                             "%R is not a subclass of ArenaAllocatable",
+                             ob.get());
+                return false;
+            }
+            auto* cls = reinterpret_cast<PyTypeObject*>(ob.get());
+            if (static_cast<std::uint64_t>(cls->tp_basicsize) != record.basicsize) {
+                PyErr_Format(PyExc_TypeError,
+                             "the layout of %R has changed since the snapshot was saved",
+                             ob.get());
+                return false;
+            }
+            // instances share the type's shapes, so the type must outlive the arena
+            m_arena->add_external_reference(ob.get());
+            m_types.emplace_back(reinterpret_cast<arena_allocatable_meta_object*>(
+                std::move(ob).escape()));
+        }
+        return true;
+    }
+
+    owned_ref<> load_external(const external_record& record) const {
+        switch (record.type) {
+        case external_record::kind::none:
+            return owned_ref<>::new_reference(Py_None);
+        case external_record::kind::false_value:
+            return owned_ref<>::new_reference(Py_False);
+        case external_record::kind::true_value:
+            return owned_ref<>::new_reference(Py_True);
+        case external_record::kind::small_int:
+            return owned_ref{PyLong_FromLongLong(static_cast<long long>(record.value))};
+        case external_record::kind::big_int: {
+            const char* data = text(record.text);
+            if (!data) {
+                return nullptr;
+            }
+            std::string digits{data, record.text.size};
+            return owned_ref{PyLong_FromString(digits.c_str(), nullptr, 0)};
+        }
+        case external_record::kind::float_value: {
+            double value;
+            std::memcpy(&value, &record.value, sizeof(value));
+            return owned_ref{PyFloat_FromDouble(value)};
+        }
+        case external_record::kind::str:
+            return decode_string(record.text);
+        }
+        corrupt();
+        return nullptr;
+    }
+
+    bool load_externals() {
+        const auto* keys = records<std::uint32_t>(m_header.shape_keys);
+        // attribute names are interned, like the names added by `setattr`
+        std::vector<bool> is_key(m_header.externals.count);
+        for (std::uint64_t ix = 0; ix < m_header.shape_keys.count; ++ix) {
+            if (keys[ix] >= is_key.size()) {
+                return corrupt();
+            }
+            is_key[keys[ix]] = true;
+        }
+        m_externals.reserve(m_header.externals.count);
+        for (std::uint64_t ix = 0; ix < m_header.externals.count; ++ix) {
+            owned_ref ob =
+                load_external(records<external_record>(m_header.externals)[ix]);
+            if (!ob) {
+                return false;
+            }
+            if (is_key[ix]) {
+                if (!PyUnicode_CheckExact(ob.get())) {
+                    return corrupt();
+                }
+                PyObject* name = std::move(ob).escape();
+                PyUnicode_InternInPlace(&name);
+                ob = owned_ref{name};
+            }
+            m_arena->add_external_reference(ob.get());
+            m_externals.push_back(ob.get());
+        }
+        return true;
+    }
+
+    bool load_shapes() {
+        const auto* keys = records<std::uint32_t>(m_header.shape_keys);
+        m_shapes.reserve(m_header.shapes.count);
+        for (std::uint64_t ix = 0; ix < m_header.shapes.count; ++ix) {
+            const shape_record& record = records<shape_record>(m_header.shapes)[ix];
+            if (record.type >= m_types.size() ||
+                !in_bounds(record.first_key, record.size, 1, m_header.shape_keys.count)) {
+                return corrupt();
+            }
+            shape* layout = m_types[record.type]->root_shape.get();
+            for (std::uint32_t slot = 0; slot < record.size; ++slot) {
+                layout = layout->add(m_externals[keys[record.first_key + slot]]);
+            }
+            m_shapes.push_back(layout);
+        }
+        return true;
+    }
+
+    /** Replace an offset or index stored in a pointer field with the pointer.
+     */
+    template<typename T>
+    bool relocate(T*& field, std::uint64_t count) const {
+        auto offset = reinterpret_cast<std::uintptr_t>(field);
+        if (!in_bounds(offset, count, sizeof(T), m_header.image.count) ||
+            offset % alignof(T)) {
+            return corrupt();
+        }
+        field = reinterpret_cast<T*>(m_image + offset);
+        return true;
+    }
+
+    bool decode(PyObject*& ref) const {
+        auto value = reinterpret_cast<std::uintptr_t>(ref);
+        if (value & external_tag) {
+            std::uint64_t index = value >> 1;
+            if (index >= m_externals.size()) {
+                return corrupt();
+            }
+            ref = m_externals[index];
+            return true;
+        }
+        return relocate(ref, 1);
+    }
+
+    bool load_object(std::uint64_t offset) {
+        std::uint64_t image_size = m_header.image.count;
+        if (!in_bounds(offset, sizeof(arena_allocatable_object), 1, image_size) ||
+            offset % alignof(arena_allocatable_object)) {
+            return corrupt();
+        }
+        auto* ob = reinterpret_cast<arena_allocatable_object*>(m_image + offset);
+        auto type = reinterpret_cast<std::uintptr_t>(ob->ob_type);
+        auto layout = reinterpret_cast<std::uintptr_t>(ob->layout);
+        if (type >= m_types.size() || layout >= m_shapes.size() ||
+            !in_bounds(offset, m_types[type]->ht_type.tp_basicsize, 1, image_size)) {
+            return corrupt();
+        }
+        Py_SET_TYPE(ob, &m_types[type]->ht_type);
+        new (&ob->owning_arena) std::shared_ptr<qb::arena>{};
+        ob->layout = m_shapes[layout];
+        if (ob->capacity != ob->layout->size()) {
+            return corrupt();
+        }
+        if (ob->capacity) {
+            if (!relocate(ob->values, ob->capacity)) {
+                return false;
+            }
+            for (std::uint32_t ix = 0; ix < ob->capacity; ++ix) {
+                if (!decode(ob->values[ix])) {
+                    return false;
+                }
+            }
+        }
+
+        if (is_list(ob)) {
+            auto* list = static_cast<arena_list_object*>(ob);
+            if (list->size < 0 || list->item_capacity != list->size) {
+                return corrupt();
+            }
+            if (list->size) {
+                if (!relocate(list->items, list->size)) {
+                    return false;
+                }
+                for (Py_ssize_t ix = 0; ix < list->size; ++ix) {
+                    if (!decode(list->items[ix])) {
+                        return false;
+                    }
+                }
+            }
+        }
+        else if (is_dict(ob)) {
+            auto* dict = static_cast<arena_dict_object*>(ob);
+            if (dict->table_size) {
+                if (dict->table_size & (dict->table_size - 1) ||
+                    dict->used > arena_dict_methods::usable(dict->table_size) ||
+                    dict->size != dict->used) {
+                    return corrupt();
+                }
+                if (!relocate(dict->entries,
+                              arena_dict_methods::usable(dict->table_size)) ||
+                    !relocate(dict->indices, dict->table_size)) {
+                    return false;
+                }
+                for (std::uint32_t ix = 0; ix < dict->used; ++ix) {
+                    if (!decode(dict->entries[ix].key) ||
+                        !decode(dict->entries[ix].value)) {
+                        return false;
+                    }
+                }
+                m_dicts.push_back(dict);
+            }
+        }
+        return true;
+    }
+
+    /** Hash the keys of a dict and fill in its index table. This may run arbitrary code,
+        so it must wait until every object is loaded.
+     */
+    bool index_dict(arena_dict_object* dict) const {
+        std::fill_n(dict->indices, dict->table_size, arena_dict_methods::empty_index);
+        for (std::uint32_t ix = 0; ix < dict->used; ++ix) {
+            arena_dict_object::entry& e = dict->entries[ix];
+            owned_ref key{load_reference(m_arena, e.key)};
+            e.hash = PyObject_Hash(key.get());
+            if (e.hash == -1) {
+                return false;
+            }
+            dict->indices[arena_dict_methods::free_index_slot(dict, e.hash)] = ix;
+        }
+        return true;
+    }
+
+public:
+    reader(const std::shared_ptr<qb::arena>& arena,
+           std::byte* base,
+           std::size_t size)
+        : m_arena(arena),
+          m_base(base),
+          m_size(size),
+          m_header(*reinterpret_cast<const header*>(base)),
+          m_image(nullptr) {}
+
+    /** @return A new reference to the root, or null with a Python exception raised.
+     */
+    owned_ref<> load() {
+        if (m_size < sizeof(header) ||
+            std::memcmp(m_header.magic, magic, sizeof(magic))) {
+            PyErr_SetString(PyExc_ValueError, "not an arena snapshot");
+            return nullptr;
+        }
+        if (m_header.format_version != format_version ||
+            m_header.python_version != (PY_VERSION_HEX & 0xffff0000) ||
+            m_header.object_header_size != sizeof(arena_allocatable_object)) {
+            PyErr_SetString(PyExc_ValueError,
+                            "the snapshot was saved by an incompatible version of "
+                            "quelling_blade or Python");
+            return nullptr;
+        }
+        if (!check(m_header.image, 1) ||
+            !check(m_header.objects, sizeof(std::uint64_t)) ||
+            !check(m_header.types, sizeof(type_record)) ||
+            !check(m_header.shapes, sizeof(shape_record)) ||
+            !check(m_header.shape_keys, sizeof(std::uint32_t)) ||
+            !check(m_header.externals, sizeof(external_record)) ||
+            !check(m_header.strings, 1) || !m_header.objects.count) {
+            corrupt();
+            return nullptr;
+        }
+        m_image = m_base + m_header.image.offset;
+        if (!load_types() || !load_externals() || !load_shapes()) {
+            return nullptr;
+        }
+        const auto* offsets = records<std::uint64_t>(m_header.objects);
+        for (std::uint64_t ix = 0; ix < m_header.objects.count; ++ix) {
+            if (!load_object(offsets[ix])) {
+                return nullptr;
+            }
+        }
+        m_arena->count_objects(m_header.objects.count);
+        for (arena_dict_object* dict : m_dicts) {
+            if (!index_dict(dict)) {
+                return nullptr;
+            }
+        }
+        return owned_ref{load_reference(m_arena, reinterpret_cast<PyObject*>(
+                                                     m_image + offsets[0]))};
+    }
+};
+
+owned_ref<> load(borrowed_ref<> path) {
+    const char* name = PyBytes_AS_STRING(path.get());
+    int fd = ::open(name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        PyErr_SetFromErrnoWithFilename(PyExc_OSError, name);
+        return nullptr;
+    }
+    struct stat info;
+    std::byte* base = nullptr;
+    if (::fstat(fd, &info) == 0) {
+        if (info.st_size < static_cast<off_t>(sizeof(header))) {
+            ::close(fd);
+            PyErr_SetString(PyExc_ValueError, "not an arena snapshot");
+            return nullptr;
+        }
+        base = slab_memory::map_file(fd, info.st_size);
+    }
+    if (!base) {
+        PyErr_SetFromErrnoWithFilename(PyExc_OSError, name);
+        ::close(fd);
+        return nullptr;
+    }
+    // the mapping keeps the file open
+    ::close(fd);
+
+    // The objects live in the mapping, which is adopted by a new arena. The arena is
+    // only kept alive by the objects which escape from it, starting with the root.
+    auto size = static_cast<std::size_t>(info.st_size);
+    slab mapped{slab_backing::file, base, size};
+    auto arena = std::make_shared<qb::arena>(slab_backing::malloc, 1 << 16, 2.0, 1 << 26);
+    arena->adopt(std::move(mapped));
+    return reader{arena, base, size}.load();
+}
+}  // namespace snapshot
+
+namespace sealing {
+#if defined(_Py_IMMORTAL_REFCNT)
+// Python 3.12 and later never write the reference count of an immortal object, so
+// reading a permanent object doesn't dirty the page it is on
+constexpr Py_ssize_t permanent_refcount = _Py_IMMORTAL_REFCNT;
+#elif defined(_Py_IMMORTAL_INITIAL_REFCNT)
+constexpr Py_ssize_t permanent_refcount = _Py_IMMORTAL_INITIAL_REFCNT;
+#else
+// large enough that the references taken by Python code never bring it to zero
+constexpr Py_ssize_t permanent_refcount = PY_SSIZE_T_MAX / 2;
+#endif
+
+bool is_permanent(PyObject* ob) {
+    // before Python 3.12, references taken and released since sealing move the count
+    return Py_REFCNT(ob) >= permanent_refcount / 2;
+}
+
+std::size_t make_permanent(const std::shared_ptr<qb::arena>& arena, PyObject* root) {
+    std::vector<arena_allocatable_object*> objects;
+    auto add = [&](PyObject* ob) {
+        if (!is_permanent(ob)) {
+            auto* instance = static_cast<arena_allocatable_object*>(ob);
+            if (!instance->owning_arena) {
+                // an object with no references from outside of the arena
+                instance->owning_arena = arena;
+            }
+            ob->ob_refcnt = permanent_refcount;
+            objects.push_back(instance);
+        }
+    };
+    add(root);
+    for (std::size_t ix = 0; ix < objects.size(); ++ix) {
+        evacuation::for_each_reference(objects[ix], [&](PyObject* ref) {
+            if (arena->contains(reinterpret_cast<std::byte*>(ref))) {
+                add(ref);
+            }
+        });
+    }
+    return objects.size();
+}
+}  // namespace sealing
+
+namespace freezing {
+using evacuation::is_dict;
+using evacuation::is_list;
+
+/** Copies objects into a block of memory in a new arena, in the same layout as a
+    snapshot image: each object is followed by its values, stored inline, and by its
+    list items or dict tables, all sized to fit.
+ */
+class copier {
+private:
+    qb::arena& m_src;
+    std::shared_ptr<qb::arena> m_dst;
+    // the objects being copied, in breadth-first order from the root
+    std::vector<arena_allocatable_object*> m_objects;
+    // object -> offset of its copy in `m_block`
+    absl::flat_hash_map<PyObject*, std::uint64_t> m_offsets;
+    std::uint64_t m_size = 0;
+    std::byte* m_block = nullptr;
+    // the copied dicts whose keys were copied too, which must be hashed again
+    std::vector<arena_dict_object*> m_rehash;
+
+    void add_object(PyObject* ob) {
+        auto [it, inserted] = m_offsets.try_emplace(ob, m_size);
+        if (inserted) {
+            auto* instance = static_cast<arena_allocatable_object*>(ob);
+            m_objects.push_back(instance);
+            m_size += snapshot::compact_size(instance);
+        }
+    }
+
+    /** The copy of `ob`, or `ob` itself if it is outside of the source arena, in which
+        case the new arena takes a reference to it.
+     */
+    PyObject* translate(PyObject* ob) {
+        if (auto it = m_offsets.find(ob); it != m_offsets.end()) {
+            return reinterpret_cast<PyObject*>(m_block + it->second);
+        }
+        m_dst->add_external_reference(ob);
+        return ob;
+    }
+
+    void copy_object(arena_allocatable_object* ob, std::uint64_t offset) {
+        PyTypeObject* cls = Py_TYPE(ob);
+        std::byte* p = m_block + offset;
+        std::memcpy(p, static_cast<void*>(ob), cls->tp_basicsize);
+        auto* out = reinterpret_cast<arena_allocatable_object*>(p);
+        Py_SET_REFCNT(out, 0);
+        new (&out->owning_arena) std::shared_ptr<qb::arena>{};
+        out->rooted = false;
+        out->pinned = false;
+        out->collectable = false;
+        if (cls->tp_weaklistoffset) {
+            *reinterpret_cast<PyObject**>(p + cls->tp_weaklistoffset) = nullptr;
+        }
+        m_dst->add_external_reference(reinterpret_cast<PyObject*>(cls));
+
+        std::uint32_t size = ob->layout->size();
+        std::byte* next = p + cls->tp_basicsize;
+        out->values = nullptr;
+        out->capacity = size;
+        out->inline_capacity = 0;
+        if (size) {
+            out->values = reinterpret_cast<PyObject**>(next);
+            if (size <= std::numeric_limits<std::uint8_t>::max()) {
+                out->inline_capacity = size;
+            }
+            for (std::uint32_t ix = 0; ix < size; ++ix) {
+                out->values[ix] = translate(ob->values[ix]);
+            }
+            next += size * sizeof(PyObject*);
+        }
+
+        if (is_list(ob)) {
+            auto* list = static_cast<arena_list_object*>(ob);
+            auto* out_list = static_cast<arena_list_object*>(out);
+            out_list->items = nullptr;
+            if (list->size) {
+                out_list->items = reinterpret_cast<PyObject**>(next);
+                for (Py_ssize_t ix = 0; ix < list->size; ++ix) {
+                    out_list->items[ix] = translate(list->items[ix]);
+                }
+            }
+            out_list->item_capacity = list->size;
+        }
+        else if (is_dict(ob)) {
+            auto* dict = static_cast<arena_dict_object*>(ob);
+            auto* out_dict = static_cast<arena_dict_object*>(out);
+            out_dict->entries = nullptr;
+            out_dict->indices = nullptr;
+            out_dict->table_size = 0;
+            out_dict->used = 0;
+            out_dict->version = 0;
+            if (!dict->size) {
+                return;
+            }
+            std::uint32_t table_size = arena_dict_methods::table_size_for(dict->size);
+            out_dict->entries = reinterpret_cast<arena_dict_object::entry*>(next);
+            next += arena_dict_methods::usable(table_size) *
+                    sizeof(arena_dict_object::entry);
+            out_dict->indices = reinterpret_cast<std::int32_t*>(next);
+            out_dict->table_size = table_size;
+            std::fill_n(out_dict->indices, table_size, arena_dict_methods::empty_index);
+            bool rehash = false;
+            for (std::uint32_t ix = 0; ix < dict->used; ++ix) {
+                const arena_dict_object::entry& e = dict->entries[ix];
+                if (!e.key) {
+                    continue;
+                }
+                rehash |= m_offsets.contains(e.key);
+                out_dict->entries[out_dict->used] = {e.hash,
+                                                     translate(e.key),
+                                                     translate(e.value)};
+                out_dict->indices[arena_dict_methods::free_index_slot(out_dict,
+                                                                      e.hash)] =
+                    out_dict->used++;
+            }
+            if (rehash) {
+                m_rehash.push_back(out_dict);
+            }
+        }
+    }
+
+    /** Hash the keys of a copied dict again, for keys which were copied as well and may
+        hash by identity. This may run arbitrary code, so it must wait until every
+        object is copied.
+     */
+    bool rehash(arena_dict_object* dict) const {
+        std::fill_n(dict->indices, dict->table_size, arena_dict_methods::empty_index);
+        for (std::uint32_t ix = 0; ix < dict->used; ++ix) {
+            arena_dict_object::entry& e = dict->entries[ix];
+            if (m_dst->contains(reinterpret_cast<std::byte*>(e.key))) {
+                owned_ref key{load_reference(m_dst, e.key)};
+                e.hash = PyObject_Hash(key.get());
+                if (e.hash == -1) {
+                    return false;
+                }
+            }
+            dict->indices[arena_dict_methods::free_index_slot(dict, e.hash)] = ix;
+        }
+        return true;
+    }
+
+public:
+    explicit copier(qb::arena& src) : m_src(src) {}
+
+    owned_ref<> copy(PyObject* root) {
+        add_object(root);
+        for (std::size_t ix = 0; ix < m_objects.size(); ++ix) {
+            evacuation::for_each_reference(m_objects[ix], [&](PyObject* ref) {
+                if (m_src.contains(reinterpret_cast<std::byte*>(ref))) {
+                    add_object(ref);
+                }
+            });
+        }
+
+        // the new arena is one slab which holds exactly the copies
+        m_dst = std::make_shared<qb::arena>(m_src.backing(),
+                                            m_size,
+                                            2.0,
+                                            std::max<std::size_t>(m_size, 1 << 26));
+        m_block = m_dst->allocate(m_size, alignof(arena_allocatable_object));
+        for (arena_allocatable_object* ob : m_objects) {
+            copy_object(ob, m_offsets.find(ob)->second);
+        }
+        m_dst->count_objects(m_objects.size());
+        for (arena_dict_object* dict : m_rehash) {
+            if (!rehash(dict)) {
+                return nullptr;
+            }
+        }
+        m_dst->freeze();
+        return owned_ref{load_reference(m_dst, reinterpret_cast<PyObject*>(m_block))};
+    }
+};
+
+owned_ref<> freeze(qb::arena& arena, PyObject* root) {
+    return copier{arena}.copy(root);
+}
+}  // namespace freezing
+
+namespace arena_allocatable_methods {
+PyObject* allocate_many(PyObject* untyped_cls, PyObject* args, PyObject* kwargs) {
+    Py_ssize_t count;
+    if (!PyArg_ParseTuple(args, "n:allocate_many", &count)) {
+        return nullptr;
+    }
+    if (count < 0) {
+        PyErr_Format(PyExc_ValueError, "count must be non-negative, got %zd", count);
+        return nullptr;
+    }
+
+    auto* cls = reinterpret_cast<PyTypeObject*>(untyped_cls);
+    auto* typed_cls = reinterpret_cast<arena_allocatable_meta_object*>(cls);
+    try {
+        // all of the new instances share the shape with the columns as attributes
+        std::vector<owned_ref<>> columns;
+        shape* layout = typed_cls->root_shape.get();
+        if (kwargs) {
+            PyObject* name;
+            PyObject* iterable;
+            Py_ssize_t pos = 0;
+            while (PyDict_Next(kwargs, &pos, &name, &iterable)) {
+                auto [descr, descr_kind] = typed_cls->descriptors.lookup(cls, name);
+                if (descr_kind == descriptor_cache::kind::data) {
+                    PyErr_Format(PyExc_TypeError,
+                                 "cannot fill %R with allocate_many, it is a data "
+                                 "descriptor on %R",
+                                 name,
+                                 untyped_cls);
+                    return nullptr;
+                }
+                owned_ref column{
+                    PySequence_Fast(iterable, "allocate_many columns must be iterable")};
+                if (!column) {
+                    return nullptr;
+                }
+                if (PySequence_Fast_GET_SIZE(column.get()) != count) {
+                    PyErr_Format(PyExc_ValueError,
+                                 "column %R has length %zd, expected %zd",
+                                 name,
+                                 PySequence_Fast_GET_SIZE(column.get()),
+                                 count);
+                    return nullptr;
+                }
+                columns.emplace_back(std::move(column));
+
+                Py_INCREF(name);
+                PyUnicode_InternInPlace(&name);
+                owned_ref interned{name};
+                layout = layout->add(interned);
+            }
+        }
+        auto width = static_cast<std::uint32_t>(columns.size());
+        // the values are stored inline unless there are too many of them
+        std::uint32_t inline_width = (width <= max_inline_values) ? width : 0;
+        typed_cls->attribute_count_hint =
+            std::min(std::max(typed_cls->attribute_count_hint, width),
+                     max_attribute_count_hint);
+
+        std::shared_ptr<arena> arena;
+        owned_ref<arena_context_object> context;
+        if (typed_cls->active_arena_count) {
+            if (arena_context_methods::find_arena_context(typed_cls, context)) {
+                return nullptr;
+            }
+            if (context) {
+                arena = context->arena;
+            }
+        }
+        owned_ref out{reinterpret_cast<arena_list_object*>(
+            allocate_instance(&arena_list_type.ht_type, arena))};
+        if (!out) {
+            return nullptr;
+        }
+        arena_list_methods::reserve(out, count);
+
+        if (!arena) {
+            for (Py_ssize_t ix = 0; ix < count; ++ix) {
+                owned_ref instance{allocate_instance(cls, arena, inline_width)};
+                if (!instance) {
+                    return nullptr;
+                }
+                if (width) {
+                    if (!inline_width) {
+                        instance->values =
+                            arena::allocator<PyObject*>{nullptr}.allocate(width);
+                        instance->capacity = width;
+                    }
+                    for (std::uint32_t column = 0; column < width; ++column) {
+                        PyObject* value =
+                            PySequence_Fast_ITEMS(columns[column].get())[ix];
+                        Py_INCREF(value);
+                        instance->values[column] = value;
+                    }
+                    instance->layout = layout;
+                }
+                out->items[out->size++] = std::move(instance).escape();
+            }
+            return std::move(out).escape();
+        }
+
+        // the instances are only referenced by the list, which is in the same arena, so
+        // they start without references and are laid out in one block, each followed by
+        // its values, or with the values after all of the instances if there are too
+        // many to store inline
+        std::size_t instance_size = cls->tp_basicsize + inline_width * sizeof(PyObject*);
+        std::size_t total_size = cls->tp_basicsize + width * sizeof(PyObject*);
+        if (static_cast<std::size_t>(count) > PY_SSIZE_T_MAX / total_size) {
+            PyErr_NoMemory();
+            return nullptr;
+        }
+        arena->add_external_reference(untyped_cls);
+        for (const owned_ref<>& column : columns) {
+            for (Py_ssize_t ix = 0; ix < count; ++ix) {
+                store_reference(arena, PySequence_Fast_ITEMS(column.get())[ix]);
+            }
+        }
+        std::byte* block =
+            arena->allocate(count * total_size, alignof(arena_allocatable_object));
+        arena->count_objects(count);
+        auto* values_block = reinterpret_cast<PyObject**>(block + count * instance_size);
+        for (Py_ssize_t ix = 0; ix < count; ++ix) {
+            std::byte* allocation = block + ix * instance_size;
+            zero_subtype_fields(cls, allocation);
+            auto* instance = new (allocation) arena_allocatable_object(typed_cls);
+            if (width) {
+                if (inline_width) {
+                    instance->use_inline_values(inline_width);
+                }
+                else {
+                    instance->values = values_block + ix * width;
+                    instance->capacity = width;
+                }
+                for (std::uint32_t column = 0; column < width; ++column) {
+                    instance->values[column] =
+                        PySequence_Fast_ITEMS(columns[column].get())[ix];
+                }
+                instance->layout = layout;
+            }
+            out->items[ix] = instance;
+        }
+        out->size = count;
+        if (context->sites) {
+            context->sites->record(reinterpret_cast<PyObject*>(out.get()));
+            for (Py_ssize_t ix = 0; ix < count; ++ix) {
+                context->sites->record(out->items[ix]);
+            }
+        }
+        return std::move(out).escape();
+    }
+    catch (const std::exception& e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+}
+}  // namespace arena_allocatable_methods
+
+namespace module_methods {
+PyObject* set_slab_pool_limit(PyObject*, PyObject* arg) {
+    Py_ssize_t limit = PyNumber_AsSsize_t(arg, PyExc_OverflowError);
+    if (limit == -1 && PyErr_Occurred()) {
+        return nullptr;
+    }
+    if (limit < 0) {
+        PyErr_Format(PyExc_ValueError, "limit must be non-negative, got %zd", limit);
+        return nullptr;
+    }
+    slab_pool::instance().set_limit(limit);
+    Py_RETURN_NONE;
+}
+
+PyObject* get_slab_pool_limit(PyObject*, PyObject*) {
+    return PyLong_FromSize_t(slab_pool::instance().limit());
+}
+
+PyObject* trim_slab_pool(PyObject*, PyObject*) {
+    slab_pool::instance().trim();
+    arena_allocatable_methods::free_instances.clear();
+    Py_RETURN_NONE;
+}
+
+PyObject* get_counters(PyObject*, PyObject*) {
+    owned_ref out{arena_context_methods::stats_dict(counters.slabs,
+                                                    counters.oversize_slabs,
+                                                    counters.capacity,
+                                                    counters.used,
+                                                    counters.padding,
+                                                    counters.allocations,
+                                                    counters.objects,
+                                                    counters.external_references,
+                                                    counters.escaped)};
+    if (!out) {
+        return nullptr;
+    }
+    owned_ref arenas{PyLong_FromSize_t(counters.arenas)};
+    if (!arenas || PyDict_SetItemString(out.get(), "arenas", arenas.get())) {
+        return nullptr;
+    }
+    return std::move(out).escape();
+}
+
+PyObject* reset_counters(PyObject*, PyObject*) {
+    counters = cumulative_counters{};
+    Py_RETURN_NONE;
+}
+
+PyMethodDef methods[] = {
+    {"set_slab_pool_limit",
+     set_slab_pool_limit,
+     METH_O,
+     "Set the maximum number of bytes of released slabs to keep for reuse by new "
+     "arenas."},
+    {"get_slab_pool_limit",
+     get_slab_pool_limit,
+     METH_NOARGS,
+     "Get the maximum number of bytes of released slabs to keep for reuse by new "
+     "arenas."},
+    {"trim_slab_pool",
+     trim_slab_pool,
+     METH_NOARGS,
+     "Return the memory of the pooled slabs to the OS while keeping them available "
+     "for reuse, and free the memory kept for new global instances."},
+    {"counters",
+     get_counters,
+     METH_NOARGS,
+     "Return a dict of totals over every arena which has been closed since the module "
+     "was imported or the counters were last reset."},
+    {"reset_counters", reset_counters, METH_NOARGS, "Set all of the counters to zero."},
+    {nullptr},
+};
+void free(void*) {
+    arena_allocatable_methods::free_instances.clear();
+}
+}  // namespace module_methods
+
+PyModuleDef module = {PyModuleDef_HEAD_INIT,
+                      "quelling_blade.arena_allocatable",
+                      nullptr,
+                      -1,
+                      module_methods::methods,
                       nullptr,
                       nullptr,
                       nullptr,
-                      nullptr};
+                      module_methods::free};
 
 PyMODINIT_FUNC PyInit_arena_allocatable() {
     for (PyTypeObject* tp : {&arena_allocatable_meta_type,
                              &arena_allocatable_type.ht_type,
-                             &arena_context_type}) {
+                             &arena_list_type.ht_type,
+                             &arena_dict_type.ht_type,
+                             &arena_context_type,
+                             &arena_allocatable_methods::collectable_storage_type}) {
         if (PyType_Ready(tp) < 0) {
             return nullptr;
         }
     }
+    try {
+        for (arena_allocatable_meta_object* tp :
+             {&arena_allocatable_type, &arena_list_type, &arena_dict_type}) {
+            tp->root_shape = std::make_unique<shape>();
+            tp->ht_type.tp_vectorcall = arena_allocatable_methods::vectorcall;
+        }
+    }
+    catch (const std::exception& e) {
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return nullptr;
+    }
+
+    arena_allocatable_methods::init_name = PyUnicode_InternFromString("__init__");
+    if (!arena_allocatable_methods::init_name) {
+        return nullptr;
+    }
+    current_arena_context = PyContextVar_New("quelling_blade.current_arena", nullptr);
+    if (!current_arena_context) {
+        return nullptr;
+    }
 
     owned_ref mod{PyModule_Create(&module)};
     if (!mod) {
@@ -947,6 +5295,16 @@ PyMODINIT_FUNC PyInit_arena_allocatable() {
                                reinterpret_cast<PyObject*>(&arena_allocatable_type))) {
         return nullptr;
     }
+    if (PyObject_SetAttrString(mod.get(),
+                               "ArenaList",
+                               reinterpret_cast<PyObject*>(&arena_list_type))) {
+        return nullptr;
+    }
+    if (PyObject_SetAttrString(mod.get(),
+                               "ArenaDict",
+                               reinterpret_cast<PyObject*>(&arena_dict_type))) {
+        return nullptr;
+    }
     if (PyObject_SetAttrString(mod.get(),
                                "Arena",
                                reinterpret_cast<PyObject*>(&arena_context_type))) {
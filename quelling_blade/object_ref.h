@@ -0,0 +1,311 @@
+#pragma once
+
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include <Python.h>
+
+namespace qb {
+template<typename T>
+class owned_ref;
+
+/** A type that explicitly indicates that a Python object is a borrowed
+    reference. This is implicitly convertible from a regular `PyObject*` or a
+    `owned_ref`. This type may be used as a Python object parameter like:
+
+    \code
+    int f(borrowed_ref a, borrowed_ref b);
+    \endcode
+
+    This allows calling this function with either `owned_ref` or
+    `PyObject*`.
+
+    @note A `borrowed_ref` may still hold a value of `nullptr`.
+ */
+template<typename T = PyObject>
+class borrowed_ref {
+private:
+    T* m_ref;
+
+public:
+    constexpr borrowed_ref() : m_ref(nullptr) {}
+    constexpr borrowed_ref(std::nullptr_t) : m_ref(nullptr) {}
+    constexpr borrowed_ref(T* ref) : m_ref(ref) {}
+    constexpr borrowed_ref(const owned_ref<T>& ref) : m_ref(ref.get()) {}
+
+    constexpr T* get() const {
+        return m_ref;
+    }
+
+    explicit constexpr operator T*() const {
+        return m_ref;
+    }
+
+    // use an enable_if to resolve the ambiguous dispatch when T is PyObject
+    template<typename U = T,
+             typename = std::enable_if_t<!std::is_same<U, PyObject>::value>>
+    explicit operator PyObject*() const {
+        return reinterpret_cast<PyObject*>(m_ref);
+    }
+
+    T& operator*() const {
+        return *m_ref;
+    }
+
+    T* operator->() const {
+        return m_ref;
+    }
+
+    explicit operator bool() const {
+        return m_ref;
+    }
+
+    bool operator==(borrowed_ref<> other) const {
+        return m_ref == other.get();
+    }
+
+    bool operator!=(borrowed_ref<> other) const {
+        return m_ref != other.get();
+    }
+};
+
+/** An RAII wrapper for ensuring an object is cleaned up in a given scope.
+ */
+template<typename T = PyObject>
+class owned_ref {
+private:
+    T* m_ref;
+
+public:
+    /** The type of the underlying pointer.
+     */
+    using element_type = T;
+
+    /** Default construct a scoped ref to a `nullptr`.
+     */
+    constexpr owned_ref() : m_ref(nullptr) {}
+
+    constexpr owned_ref(std::nullptr_t) : m_ref(nullptr) {}
+
+    /** Manage a new reference. `ref` should not be used outside of the
+        `owned_ref`.
+
+        @param ref The reference to manage
+     */
+    constexpr explicit owned_ref(T* ref) : m_ref(ref) {}
+
+    constexpr owned_ref(const owned_ref& cpfrom) : m_ref(cpfrom.m_ref) {
+        Py_XINCREF(m_ref);
+    }
+
+    constexpr owned_ref(owned_ref&& mvfrom) noexcept : m_ref(mvfrom.m_ref) {
+        mvfrom.m_ref = nullptr;
+    }
+
+    constexpr owned_ref& operator=(const owned_ref& cpfrom) {
+        // we need to incref before we decref to support self assignment
+        Py_XINCREF(cpfrom.m_ref);
+        Py_XDECREF(m_ref);
+        m_ref = cpfrom.m_ref;
+        return *this;
+    }
+
+    constexpr owned_ref& operator=(owned_ref&& mvfrom) noexcept {
+        std::swap(m_ref, mvfrom.m_ref);
+        return *this;
+    }
+
+    /** Create a scoped ref that is a new reference to `ref`.
+
+        @param ref The Python object to create a new managed reference to.
+     */
+    constexpr static owned_ref new_reference(borrowed_ref<T> ref) {
+        Py_INCREF(ref.get());
+        return owned_ref{ref.get()};
+    }
+
+    /** Create a scoped ref that is a new reference to `ref` if `ref` is non-null.
+
+        @param ref The Python object to create a new managed reference to. If `ref`
+               is `nullptr`, then the resulting object just holds `nullptr` also.
+     */
+    constexpr static owned_ref xnew_reference(borrowed_ref<T> ref) {
+        Py_XINCREF(ref.get());
+        return owned_ref{ref.get()};
+    }
+
+    /** Decref the managed pointer if it is not `nullptr`.
+     */
+    ~owned_ref() {
+        Py_XDECREF(m_ref);
+    }
+
+    /** Return the underlying pointer and invalidate the `owned_ref`.
+
+        This allows the reference to "escape" the current scope.
+
+        @return The underlying pointer.
+        @see get
+     */
+    T* escape() && {
+        T* ret = m_ref;
+        m_ref = nullptr;
+        return ret;
+    }
+
+    /** Get the underlying managed pointer.
+
+        @return The pointer managed by this `owned_ref`.
+        @see escape
+     */
+    constexpr T* get() const {
+        return m_ref;
+    }
+
+    explicit operator T*() const {
+        return m_ref;
+    }
+
+    // use an enable_if to resolve the ambiguous dispatch when T is PyObject
+    template<typename U = T,
+             typename = std::enable_if_t<!std::is_same<U, PyObject>::value>>
+    explicit operator PyObject*() const {
+        return reinterpret_cast<PyObject*>(m_ref);
+    }
+
+    T& operator*() const {
+        return *m_ref;
+    }
+
+    T* operator->() const {
+        return m_ref;
+    }
+
+    explicit operator bool() const {
+        return m_ref;
+    }
+
+    bool operator==(borrowed_ref<> other) const {
+        return m_ref == other.get();
+    }
+
+    bool operator!=(borrowed_ref<> other) const {
+        return m_ref != other.get();
+    }
+};
+
+class object_map_key {
+private:
+    borrowed_ref<> m_ob;
+
+public:
+    object_map_key(borrowed_ref<> ob) : m_ob(owned_ref<>::new_reference(ob)) {}
+    object_map_key(const owned_ref<>& ob) : m_ob(ob) {}
+
+    object_map_key() = default;
+    object_map_key(const object_map_key&) = default;
+    object_map_key(object_map_key&&) = default;
+
+    object_map_key& operator=(const object_map_key&) = default;
+    object_map_key& operator=(object_map_key&&) = default;
+
+    PyObject* get() const {
+        return m_ob.get();
+    }
+
+    explicit operator bool() const noexcept {
+        return static_cast<bool>(m_ob);
+    }
+
+    operator const borrowed_ref<>&() const noexcept {
+        return m_ob;
+    }
+
+    /** Is `ob` an exact, interned `str`? Two interned strings are equal if and only if
+        they are the same object.
+     */
+    static bool is_interned(borrowed_ref<> ob) {
+        return PyUnicode_CheckExact(ob.get()) && PyUnicode_CHECK_INTERNED(ob.get());
+    }
+
+    bool operator==(const object_map_key& other) const {
+        if (m_ob == other.m_ob) {
+            return true;
+        }
+        if (!m_ob) {
+            return !static_cast<bool>(other.m_ob);
+        }
+        if (!other.m_ob) {
+            return false;
+        }
+
+        // attribute names are almost always `str`, don't go through the generic
+        // comparison which may raise
+        if (PyUnicode_CheckExact(m_ob.get()) && PyUnicode_CheckExact(other.get())) {
+            if (PyUnicode_CHECK_INTERNED(m_ob.get()) &&
+                PyUnicode_CHECK_INTERNED(other.get())) {
+                return false;
+            }
+            return PyUnicode_Compare(m_ob.get(), other.get()) == 0;
+        }
+
+        int r = PyObject_RichCompareBool(m_ob.get(), other.get(), Py_EQ);
+        if (r < 0) {
+            throw std::runtime_error{"failed to compare"};
+        }
+
+        return r;
+    }
+
+    bool operator!=(const object_map_key& other) const {
+        if (m_ob == other.m_ob) {
+            return false;
+        }
+        if (!m_ob || !other.m_ob) {
+            return true;
+        }
+
+        if (PyUnicode_CheckExact(m_ob.get()) && PyUnicode_CheckExact(other.get())) {
+            return !(*this == other);
+        }
+
+        int r = PyObject_RichCompareBool(m_ob.get(), other.get(), Py_NE);
+        if (r < 0) {
+            throw std::runtime_error{"failed to compare"};
+        }
+
+        return r;
+    }
+};
+}  // namespace qb
+
+namespace std {
+template<>
+struct hash<qb::object_map_key> {
+    auto operator()(const qb::object_map_key& ob) const {
+        // this returns a different type in Python 2 and Python 3
+        using out_type = decltype(PyObject_Hash(ob.get()));
+
+        if (!ob.get()) {
+            return out_type{0};
+        }
+
+        if (PyUnicode_CheckExact(ob.get())) {
+            // use the hash cached on the string object
+            out_type r = reinterpret_cast<PyASCIIObject*>(ob.get())->hash;
+            if (r != -1) {
+                return r;
+            }
+        }
+
+        out_type r = PyObject_Hash(ob.get());
+        if (r == -1) {
+            throw std::runtime_error{"python hash failed"};
+        }
+
+        return r;
+    }
+};
+}  // namespace std
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <Python.h>
+#include <absl/container/flat_hash_map.h>
+
+#include "quelling_blade/object_ref.h"
+
+namespace qb {
+/** A hidden class which describes the attribute layout of instances of an
+    `ArenaAllocatable` type.
+
+    Shapes form a transition tree rooted at an empty shape owned by the type. Adding an
+    attribute to an instance moves it to the child shape for that attribute name, so
+    every instance which had the same attributes added in the same order shares a single
+    shape. Instances only need to store a pointer to their shape and an array of values,
+    where the value for an attribute is at the attribute's slot in the shape.
+ */
+class shape {
+private:
+    /** The attribute names for a chain of shapes, in slot order.
+
+        A shape and its first child share a table: the child's key is appended to the
+        end. This means that a chain of `n` transitions uses `O(n)` memory instead of
+        `O(n^2)`. A shape only looks at the first `size()` keys of its table.
+     */
+    struct key_table {
+        // borrowed references, each key is owned by the shape which added it
+        std::vector<PyObject*> keys;
+        // attribute name -> slot, only populated once the table is too large to scan
+        absl::flat_hash_map<object_map_key, std::uint32_t> index;
+        // are all of the keys exact, interned `str` objects?
+        bool all_interned = true;
+    };
+
+    // shapes with at most this many attributes are searched linearly
+    static constexpr std::uint32_t linear_search_limit = 8;
+
+    shape* m_parent;
+    owned_ref<> m_key;
+    std::uint32_t m_size;
+    std::shared_ptr<key_table> m_keys;
+    absl::flat_hash_map<object_map_key, std::unique_ptr<shape>> m_transitions;
+
+    shape(shape* parent, borrowed_ref<> key)
+        : m_parent(parent),
+          m_key(owned_ref<>::new_reference(key)),
+          m_size(parent->m_size + 1) {
+        if (parent->m_keys->keys.size() == parent->m_size) {
+            // we are the first child of `parent`, extend its table
+            m_keys = parent->m_keys;
+        }
+        else {
+            m_keys = std::make_shared<key_table>();
+            m_keys->keys.assign(parent->m_keys->keys.begin(),
+                                parent->m_keys->keys.begin() + parent->m_size);
+            m_keys->all_interned = parent->m_keys->all_interned;
+            if (parent->m_size > linear_search_limit) {
+                for (std::uint32_t ix = 0; ix < parent->m_size; ++ix) {
+                    m_keys->index.emplace(borrowed_ref{m_keys->keys[ix]}, ix);
+                }
+            }
+        }
+        m_keys->keys.emplace_back(key.get());
+        m_keys->all_interned &= object_map_key::is_interned(key);
+        if (m_size > linear_search_limit) {
+            if (m_size == linear_search_limit + 1) {
+                for (std::uint32_t ix = 0; ix < linear_search_limit; ++ix) {
+                    m_keys->index.emplace(borrowed_ref{m_keys->keys[ix]}, ix);
+                }
+            }
+            m_keys->index.emplace(key, m_size - 1);
+        }
+    }
+
+public:
+    /** Construct an empty root shape.
+     */
+    shape() : m_parent(nullptr), m_size(0), m_keys(std::make_shared<key_table>()) {}
+
+    shape(const shape&) = delete;
+
+    /** The number of attributes in this shape.
+     */
+    std::uint32_t size() const {
+        return m_size;
+    }
+
+    /** The attribute name at the given slot.
+     */
+    PyObject* key(std::uint32_t slot) const {
+        return m_keys->keys[slot];
+    }
+
+    /** Look up the slot for an attribute.
+
+        @param key The attribute name.
+        @return The slot of `key`, or -1 if this shape doesn't have `key`.
+     */
+    std::int64_t lookup(borrowed_ref<> key) const {
+        const std::vector<PyObject*>& keys = m_keys->keys;
+        if (m_size <= linear_search_limit) {
+            // attribute names are almost always interned, check identity first
+            for (std::uint32_t ix = 0; ix < m_size; ++ix) {
+                if (keys[ix] == key.get()) {
+                    return ix;
+                }
+            }
+            if (m_keys->all_interned && object_map_key::is_interned(key)) {
+                // an interned string can only be equal to itself
+                return -1;
+            }
+            object_map_key k{key};
+            for (std::uint32_t ix = 0; ix < m_size; ++ix) {
+                if (object_map_key{borrowed_ref{keys[ix]}} == k) {
+                    return ix;
+                }
+            }
+            return -1;
+        }
+
+        auto it = m_keys->index.find(key);
+        if (it == m_keys->index.end() || it->second >= m_size) {
+            return -1;
+        }
+        return it->second;
+    }
+
+    /** Get the shape with `key` added as a new attribute.
+
+        @param key The attribute name, which must not already be in this shape.
+        @return The child shape.
+     */
+    shape* add(borrowed_ref<> key) {
+        auto [it, inserted] = m_transitions.try_emplace(key);
+        if (inserted) {
+            try {
+                it->second.reset(new shape(this, key));
+            }
+            catch (...) {
+                m_transitions.erase(it);
+                throw;
+            }
+        }
+        return it->second.get();
+    }
+
+    /** Get the shape with the attribute at `slot` removed. The remaining attributes keep
+        their order, so the slots after `slot` are moved down by one.
+     */
+    shape* remove(std::uint32_t slot) {
+        shape* out = this;
+        while (out->m_parent) {
+            out = out->m_parent;
+        }
+        for (std::uint32_t ix = 0; ix < m_size; ++ix) {
+            if (ix != slot) {
+                out = out->add(borrowed_ref{key(ix)});
+            }
+        }
+        return out;
+    }
+};
+}  // namespace qb
@@ -0,0 +1,133 @@
+import contextvars
+import threading
+import unittest
+
+import quelling_blade as qb
+
+
+class Node(qb.ArenaAllocatable):
+    pass
+
+
+class ArenaCreationTestCase(unittest.TestCase):
+    def assert_not_open(self):
+        # a failed arena must not keep allocating instances of its types
+        with qb.Arena(Node) as arena:
+            pass
+        self.assertEqual(arena.stats()['objects'], 0)
+        ob = Node()
+        ob.value = 1
+        self.assertEqual(ob.value, 1)
+
+    def test_slab_too_large(self):
+        for backing in ['malloc', 'mmap', 'hugepage', 'shared']:
+            with self.subTest(backing=backing):
+                with self.assertRaises(RuntimeError):
+                    qb.Arena(Node, slab_size=1 << 60, backing=backing)
+                self.assert_not_open()
+
+    def test_types_iterator_raises(self):
+        def types():
+            yield Node
+            raise KeyError('types')
+
+        with self.assertRaises(KeyError):
+            qb.Arena(types())
+        self.assert_not_open()
+
+    def test_not_arena_allocatable(self):
+        with self.assertRaisesRegex(TypeError, 'not a subclass of ArenaAllocatable'):
+            qb.Arena([Node, object])
+        self.assert_not_open()
+
+    def test_invalid_arguments(self):
+        with self.assertRaises(ValueError):
+            qb.Arena(Node, backing='disk')
+        with self.assertRaises(ValueError):
+            qb.Arena(Node, slab_size=0)
+        with self.assertRaises(ValueError):
+            qb.Arena(Node, slab_size=1 << 16, max_slab_size=1 << 12)
+        self.assert_not_open()
+
+
+class ArenaResetTestCase(unittest.TestCase):
+    def fill(self):
+        return qb.ArenaList([Node() for _ in range(200)])
+
+    def test_live_objects(self):
+        with qb.Arena([Node, qb.ArenaList]) as arena:
+            objects = self.fill()
+            with self.assertRaisesRegex(RuntimeError, '1 object is still alive'):
+                arena.reset()
+            # the failed reset leaves the objects usable
+            objects[0].value = 1
+            self.assertEqual(objects[0].value, 1)
+            self.assertEqual(len(objects), 200)
+            del objects
+            arena.reset()
+
+    def test_reuses_slabs(self):
+        with qb.Arena([Node, qb.ArenaList], slab_size=4096) as arena:
+            objects = self.fill()
+            full = arena.stats()
+            self.assertGreater(full['slabs'], 1)
+            del objects
+
+            arena.reset()
+            empty = arena.stats()
+            self.assertEqual(empty['slabs'], full['slabs'])
+            self.assertEqual(empty['capacity'], full['capacity'])
+            for key in ['used', 'allocations', 'objects', 'external_references']:
+                self.assertEqual(empty[key], 0, key)
+
+            # the same objects fit in the slabs which were kept
+            objects = self.fill()
+            self.assertEqual(arena.stats(), full)
+            del objects
+
+    def test_counters(self):
+        qb.reset_counters()
+        with qb.Arena([Node, qb.ArenaList]) as arena:
+            self.fill()
+            arena.reset()
+            self.fill()
+        counters = qb.counters()
+        self.assertEqual(counters['arenas'], 1)
+        # the work undone by the reset is counted as well
+        self.assertEqual(counters['objects'], 2 * 201)
+        self.assertEqual(counters['slabs'], arena.stats()['slabs'])
+
+    def test_closed(self):
+        with qb.Arena(Node) as arena:
+            pass
+        with self.assertRaisesRegex(RuntimeError, 'already closed'):
+            arena.reset()
+
+
+class ConcurrentStatsTestCase(unittest.TestCase):
+    def test_objects(self):
+        thread_count = 4
+        with qb.Arena(Node, concurrent=True) as arena:
+            # threads running in copies of this context allocate in the same arena
+            def work():
+                nodes = [Node() for _ in range(1000)]
+                del nodes
+
+            threads = [
+                threading.Thread(target=contextvars.copy_context().run, args=(work,))
+                for _ in range(thread_count)
+            ]
+            for thread in threads:
+                thread.start()
+            for thread in threads:
+                thread.join()
+            stats = arena.stats()
+
+        self.assertEqual(stats['objects'], thread_count * 1000)
+        self.assertIsNone(stats['allocations'])
+        self.assertIsNone(stats['padding'])
+        self.assertEqual(arena.stats(), stats)
+
+
+if __name__ == '__main__':
+    unittest.main()
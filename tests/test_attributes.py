@@ -0,0 +1,41 @@
+import unittest
+
+import quelling_blade as qb
+
+
+class Node(qb.ArenaAllocatable):
+    pass
+
+
+class AttributeTestCase(unittest.TestCase):
+    def check_no_dict(self, ob):
+        ob.value = 1
+        with self.assertRaises(AttributeError):
+            ob.__dict__
+        names = dir(ob)
+        self.assertNotIn('__dict__', names)
+        self.assertIn('__class__', names)
+        with self.assertRaisesRegex(AttributeError, 'missing'):
+            ob.missing
+        self.assertEqual(ob.value, 1)
+
+    def test_no_dict(self):
+        # `type.__new__` adds a `__dict__` stored in front of the instance, which arena
+        # allocatable instances don't have
+        self.assertNotIn('__dict__', vars(Node))
+        self.check_no_dict(Node())
+        with qb.Arena(Node):
+            ob = Node()
+            self.check_no_dict(ob)
+            del ob
+
+    def test_subclass(self):
+        class Child(Node):
+            pass
+
+        self.assertNotIn('__dict__', vars(Child))
+        self.check_no_dict(Child())
+
+
+if __name__ == '__main__':
+    unittest.main()
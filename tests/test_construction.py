@@ -0,0 +1,237 @@
+import functools
+import gc
+import unittest
+import weakref
+
+import quelling_blade as qb
+
+
+class Row(qb.ArenaAllocatable):
+    inits = 0
+
+    def __init__(self, *args, **kwargs):
+        type(self).inits += 1
+        self.args = args
+        self.kwargs = kwargs
+
+    @property
+    def computed(self):
+        return 'computed'
+
+    def method(self):
+        return 'method'
+
+
+class Point(qb.ArenaAllocatable):
+    def __init__(self, x, y=0, *, z=0):
+        self.x = x
+        self.y = y
+        self.z = z
+
+
+class Plain(qb.ArenaAllocatable):
+    pass
+
+
+class Payload:
+    pass
+
+
+class AllocateManyTestCase(unittest.TestCase):
+    def setUp(self):
+        Row.inits = 0
+
+    def check_rows(self, rows, names, ages):
+        self.assertIs(type(rows), qb.ArenaList)
+        self.assertEqual(len(rows), len(names))
+        for row, name, age in zip(rows, names, ages):
+            self.assertIs(type(row), Row)
+            self.assertEqual(row.name, name)
+            self.assertEqual(row.age, age)
+        # `__init__` is not called
+        self.assertEqual(Row.inits, 0)
+
+    def test_global(self):
+        names = [f'name-{ix}' for ix in range(100)]
+        ages = list(range(100))
+        rows = Row.allocate_many(100, name=names, age=(age for age in ages))
+        self.check_rows(rows, names, ages)
+        self.assertTrue(gc.is_tracked(rows[0]))
+
+        # the instances are regular instances which can grow new attributes
+        rows[0].extra = 'extra'
+        rows[0].age = -1
+        self.assertEqual((rows[0].extra, rows[0].age, rows[1].age), ('extra', -1, 1))
+
+    def test_in_arena(self):
+        names = [f'name-{ix}' for ix in range(100)]
+        ages = list(range(100))
+        with qb.Arena([Row, qb.ArenaList]) as arena:
+            rows = Row.allocate_many(100, name=names, age=ages)
+            self.check_rows(rows, names, ages)
+            # the instances and the list
+            self.assertEqual(arena.stats()['objects'], 101)
+            self.assertFalse(gc.is_tracked(rows[0]))
+
+            for row in rows:
+                row.extra = row.age * 2
+                row.name = None
+            self.assertEqual(
+                [(row.name, row.extra) for row in rows],
+                [(None, age * 2) for age in ages],
+            )
+            del rows, row
+
+    def test_wide(self):
+        # the values don't fit inline
+        columns = {f'column_{ix}': list(range(ix, ix + 10)) for ix in range(12)}
+        for in_arena in [False, True]:
+            with self.subTest(in_arena=in_arena):
+                arena = qb.Arena([Row, qb.ArenaList]) if in_arena else None
+                rows = Row.allocate_many(10, **columns)
+                for ix, row in enumerate(rows):
+                    for name, column in columns.items():
+                        self.assertEqual(getattr(row, name), column[ix])
+                rows[3].column_11 = 'changed'
+                rows[3].column_12 = 'new'
+                self.assertEqual((rows[3].column_11, rows[3].column_12),
+                                 ('changed', 'new'))
+                del rows, row
+                if arena is not None:
+                    arena.close()
+
+    def test_no_columns(self):
+        rows = Row.allocate_many(3)
+        self.assertEqual(len(rows), 3)
+        self.assertEqual(len(Row.allocate_many(0, name=[])), 0)
+        with self.assertRaises(AttributeError):
+            rows[0].name
+
+    def test_external_references(self):
+        payloads = [Payload() for _ in range(3)]
+        refs = [weakref.ref(payload) for payload in payloads]
+        with qb.Arena([Row, qb.ArenaList]):
+            rows = Row.allocate_many(3, payload=payloads)
+            del payloads
+            self.assertIs(rows[1].payload, refs[1]())
+            del rows
+            # the arena holds the column values until it is closed
+            self.assertIsNotNone(refs[0]())
+        for ref in refs:
+            self.assertIsNone(ref())
+
+    def test_length_mismatch(self):
+        with self.assertRaisesRegex(ValueError, "column 'age' has length 2, expected 3"):
+            Row.allocate_many(3, name=['a', 'b', 'c'], age=[1, 2])
+        with self.assertRaisesRegex(TypeError, 'columns must be iterable'):
+            Row.allocate_many(3, name=3)
+        with self.assertRaisesRegex(ValueError, 'non-negative'):
+            Row.allocate_many(-1)
+
+    def test_descriptors(self):
+        with self.assertRaisesRegex(TypeError, "'computed' .* data descriptor"):
+            Row.allocate_many(1, computed=['value'])
+        with self.assertRaisesRegex(TypeError, "'__class__' .* data descriptor"):
+            Row.allocate_many(1, __class__=[Plain])
+        # instance attributes shadow non-data descriptors, like methods
+        rows = Row.allocate_many(1, method=['attribute'])
+        self.assertEqual(rows[0].method, 'attribute')
+        self.assertEqual(Row(1).method(), 'method')
+
+
+class VectorcallTestCase(unittest.TestCase):
+    def assert_same_call(self, cls, *args, **kwargs):
+        """Check that calling ``cls`` matches the regular ``type.__call__`` path.
+        """
+        try:
+            expected = type.__call__(cls, *args, **kwargs)
+        except Exception as e:
+            with self.assertRaises(type(e)) as caught:
+                cls(*args, **kwargs)
+            self.assertEqual(str(caught.exception), str(e))
+            return None
+        out = cls(*args, **kwargs)
+        self.assertIs(type(out), type(expected))
+        return out
+
+    def test_arguments(self):
+        for args, kwargs in [((), {}), ((1, 2), {}), ((), {'a': 1}), ((1,), {'b': 2})]:
+            with self.subTest(args=args, kwargs=kwargs):
+                row = self.assert_same_call(Row, *args, **kwargs)
+                self.assertEqual((row.args, row.kwargs), (args, kwargs))
+
+        point = Point(1, z=3)
+        self.assertEqual((point.x, point.y, point.z), (1, 0, 3))
+        for args, kwargs in [((), {}), ((1, 2, 3), {}), ((1,), {'w': 1}),
+                             ((1,), {'x': 1})]:
+            with self.subTest(args=args, kwargs=kwargs):
+                self.assert_same_call(Point, *args, **kwargs)
+
+    def test_call_sites(self):
+        # calls with and without room for `self` before the arguments
+        points = list(map(Point, range(3)))
+        self.assertEqual([point.x for point in points], [0, 1, 2])
+        self.assertEqual(functools.partial(Point, y=2)(1).y, 2)
+        self.assertEqual(Point(*[1, 2], **{'z': 3}).z, 3)
+
+    def test_without_init(self):
+        self.assertIs(type(Plain()), Plain)
+        self.assert_same_call(Plain, 1)
+        self.assert_same_call(Plain, a=1)
+
+    def test_init_errors(self):
+        class BadReturn(qb.ArenaAllocatable):
+            def __init__(self):
+                return 1
+
+        class Raises(qb.ArenaAllocatable):
+            def __init__(self):
+                raise KeyError('init')
+
+        with self.assertRaisesRegex(TypeError, "should return None, not 'int'"):
+            BadReturn()
+        with self.assertRaises(KeyError):
+            Raises()
+        with qb.Arena(Raises) as arena:
+            with self.assertRaises(KeyError):
+                Raises()
+        self.assertEqual(arena.stats()['objects'], 1)
+
+    def test_custom_new(self):
+        calls = []
+
+        class CustomNew(qb.ArenaAllocatable):
+            def __new__(cls, value):
+                calls.append('new')
+                return super().__new__(cls)
+
+            def __init__(self, value):
+                calls.append('init')
+                self.value = value
+
+        self.assertEqual(CustomNew(1).value, 1)
+        self.assertEqual(calls, ['new', 'init'])
+
+    def test_inherited_init(self):
+        class Child(Point):
+            pass
+
+        child = Child(1, 2)
+        self.assertIs(type(child), Child)
+        self.assertEqual((child.x, child.y), (1, 2))
+
+    def test_c_init(self):
+        self.assertEqual(qb.ArenaList((1, 2)), [1, 2])
+        self.assertEqual(qb.ArenaDict([('a', 1)], b=2), {'a': 1, 'b': 2})
+
+    def test_in_arena(self):
+        with qb.Arena([Point]) as arena:
+            points = [Point(ix, y=ix) for ix in range(10)]
+            self.assertFalse(gc.is_tracked(points[0]))
+            self.assertEqual([point.y for point in points], list(range(10)))
+            del points
+        self.assertEqual(arena.stats()['objects'], 10)
+
+
+if __name__ == '__main__':
+    unittest.main()
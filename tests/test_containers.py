@@ -0,0 +1,296 @@
+import gc
+import unittest
+import weakref
+
+import quelling_blade as qb
+
+
+class Node(qb.ArenaAllocatable):
+    pass
+
+
+class Payload:
+    pass
+
+
+class Collides:
+    """A key whose instances all have the same hash.
+    """
+    def __init__(self, value):
+        self.value = value
+
+    def __hash__(self):
+        return 7
+
+    def __eq__(self, other):
+        return isinstance(other, Collides) and self.value == other.value
+
+
+class ContainerTestCase(unittest.TestCase):
+    """Run each test with global containers and with containers in an arena.
+    """
+    in_arena = False
+
+    def setUp(self):
+        if self.in_arena:
+            self.arena = qb.Arena([Node, qb.ArenaList, qb.ArenaDict])
+            self.arena.__enter__()
+            self.addCleanup(self.arena.__exit__, None, None, None)
+
+    def test_allocation(self):
+        items = qb.ArenaList()
+        table = qb.ArenaDict()
+        items.append(table)
+        if self.in_arena:
+            self.assertEqual(self.arena.stats()['objects'], 2)
+            self.assertFalse(gc.is_tracked(items))
+        else:
+            self.assertTrue(gc.is_tracked(items))
+            self.assertTrue(gc.is_tracked(table))
+        self.assertIs(items[0], table)
+
+
+class ArenaListTestCase(ContainerTestCase):
+    def test_append_insert_pop(self):
+        items = qb.ArenaList()
+        for ix in range(100):
+            items.append(ix)
+        self.assertEqual(len(items), 100)
+        items.insert(0, 'first')
+        items.insert(-1, 'before last')
+        items.insert(1000, 'last')
+        self.assertEqual(items[0], 'first')
+        self.assertEqual(items[-3:], qb.ArenaList(['before last', 99, 'last']))
+        self.assertEqual(items.pop(), 'last')
+        self.assertEqual(items.pop(0), 'first')
+        self.assertEqual(items, list(range(99)) + ['before last', 99])
+        with self.assertRaises(IndexError):
+            items.pop(200)
+        with self.assertRaises(IndexError):
+            qb.ArenaList().pop()
+
+    def test_remove(self):
+        items = qb.ArenaList([1, 2, 3, 2])
+        items.remove(2)
+        self.assertEqual(items, [1, 3, 2])
+        with self.assertRaisesRegex(ValueError, 'not in list'):
+            items.remove(4)
+        del items[0]
+        del items[-1]
+        self.assertEqual(items, [3])
+        with self.assertRaises(IndexError):
+            del items[1]
+        items.clear()
+        self.assertEqual(len(items), 0)
+
+    def test_resize(self):
+        items = qb.ArenaList()
+        items.extend(range(1000))
+        self.assertEqual(list(items), list(range(1000)))
+        items.extend(items)
+        self.assertEqual(len(items), 2000)
+        del items[10:]
+        items[2:5] = ['a'] * 100
+        self.assertEqual(len(items), 107)
+        self.assertEqual(items[:3], [0, 1, 'a'])
+        self.assertEqual(items[-5:], [5, 6, 7, 8, 9])
+
+    def test_indexing(self):
+        items = qb.ArenaList(range(10))
+        self.assertEqual(items[-1], 9)
+        items[-1] = 'nine'
+        self.assertEqual(items[9], 'nine')
+        with self.assertRaises(IndexError):
+            items[10]
+        with self.assertRaises(IndexError):
+            items[-11] = 0
+        with self.assertRaisesRegex(TypeError, 'integers or slices'):
+            items['0']
+
+    def test_slices(self):
+        reference = list(range(10))
+        items = qb.ArenaList(reference)
+        for sl in [slice(None), slice(2, 5), slice(-3, None), slice(None, None, -1),
+                   slice(1, 8, 3), slice(8, 1, -2), slice(5, 2)]:
+            with self.subTest(sl=sl):
+                part = items[sl]
+                self.assertIs(type(part), qb.ArenaList)
+                self.assertEqual(part, reference[sl])
+
+        items[::2] = 'abcde'
+        reference[::2] = 'abcde'
+        self.assertEqual(items, reference)
+        with self.assertRaisesRegex(ValueError, 'extended slice'):
+            items[::2] = [1]
+        del items[1::3]
+        del reference[1::3]
+        self.assertEqual(items, reference)
+        items[:] = items
+        self.assertEqual(items, reference)
+        items[1:1] = [Node()]
+        self.assertIsInstance(items[1], Node)
+
+    def test_compare(self):
+        self.assertEqual(qb.ArenaList([1, 2, 3]), qb.ArenaList([1, 2, 3]))
+        self.assertEqual(qb.ArenaList([1, 2, 3]), [1, 2, 3])
+        self.assertNotEqual(qb.ArenaList([1, 2, 3]), [1, 2])
+        self.assertNotEqual(qb.ArenaList([1, 2]), (1, 2))
+        self.assertLess(qb.ArenaList([1, 2]), qb.ArenaList([1, 3]))
+        self.assertLess(qb.ArenaList([1, 2]), [1, 2, 0])
+        self.assertGreaterEqual(qb.ArenaList([2]), [1, 5])
+        with self.assertRaises(TypeError):
+            qb.ArenaList([1]) < qb.ArenaList(['a'])
+
+        node = Node()
+        self.assertIn(node, qb.ArenaList([1, node]))
+        self.assertNotIn(Node(), qb.ArenaList([1, node]))
+
+    def test_nested(self):
+        root = qb.ArenaList()
+        child = qb.ArenaList([Node()])
+        root.append(child)
+        root.append(root)
+        self.assertIs(root[0], child)
+        self.assertIs(root[1], root)
+        self.assertEqual(
+            repr(root),
+            f'ArenaList([ArenaList([{child[0]!r}]), ArenaList([...])])',
+        )
+
+    def test_teardown(self):
+        payload = Payload()
+        ref = weakref.ref(payload)
+        items = qb.ArenaList([payload, Node()])
+        del payload
+        self.assertIsNotNone(ref())
+        items[0] = None
+        if not self.in_arena:
+            # global lists release their items like a list
+            self.assertIsNone(ref())
+
+
+class ArenaListInArenaTestCase(ArenaListTestCase):
+    in_arena = True
+
+
+class ArenaDictTestCase(ContainerTestCase):
+    def test_set_get_delete(self):
+        table = qb.ArenaDict()
+        for ix in range(1000):
+            table[f'key-{ix}'] = ix
+        self.assertEqual(len(table), 1000)
+        for ix in range(0, 1000, 2):
+            del table[f'key-{ix}']
+        self.assertEqual(len(table), 500)
+        self.assertEqual(table['key-1'], 1)
+        self.assertNotIn('key-0', table)
+        with self.assertRaises(KeyError):
+            table['key-0']
+        with self.assertRaises(KeyError):
+            del table['key-0']
+        # removed entries are reused after the table is compacted
+        for ix in range(0, 1000, 2):
+            table[f'key-{ix}'] = -ix
+        self.assertEqual(len(table), 1000)
+        self.assertEqual(table['key-2'], -2)
+        self.assertEqual(list(table)[:2], ['key-1', 'key-3'])
+
+    def test_collisions(self):
+        table = qb.ArenaDict()
+        keys = [Collides(ix) for ix in range(50)]
+        for ix, key in enumerate(keys):
+            table[key] = ix
+        for ix in range(50):
+            self.assertEqual(table[Collides(ix)], ix)
+        for key in keys[::3]:
+            del table[key]
+        for ix in range(50):
+            if ix % 3:
+                self.assertEqual(table[Collides(ix)], ix)
+            else:
+                self.assertNotIn(Collides(ix), table)
+        # the probe sequence still finds the keys after the entries they skipped are gone
+        table[Collides(0)] = 'again'
+        self.assertEqual(table[Collides(0)], 'again')
+        self.assertEqual(table.keys()[-1], Collides(0))
+
+    def test_unhashable(self):
+        with self.assertRaises(TypeError):
+            qb.ArenaDict()[[]] = 1
+        with self.assertRaises(TypeError):
+            hash(qb.ArenaDict())
+
+    def test_methods(self):
+        table = qb.ArenaDict({'a': 1}, b=2)
+        self.assertEqual(table.keys(), ['a', 'b'])
+        self.assertEqual(table.values(), [1, 2])
+        self.assertEqual(table.items(), [('a', 1), ('b', 2)])
+        self.assertEqual(table.get('c'), None)
+        self.assertEqual(table.get('c', 3), 3)
+        self.assertEqual(table.setdefault('c', 3), 3)
+        self.assertEqual(table.setdefault('c', 4), 3)
+        self.assertEqual(table.pop('a'), 1)
+        self.assertEqual(table.pop('a', 'missing'), 'missing')
+        with self.assertRaises(KeyError):
+            table.pop('a')
+        table.update([('d', 4)], e=5)
+        self.assertEqual(dict(table.items()), {'b': 2, 'c': 3, 'd': 4, 'e': 5})
+        table.clear()
+        self.assertEqual(len(table), 0)
+
+    def test_compare(self):
+        self.assertEqual(qb.ArenaDict(a=1, b=2), qb.ArenaDict(b=2, a=1))
+        self.assertEqual(qb.ArenaDict(a=1, b=2), {'b': 2, 'a': 1})
+        self.assertNotEqual(qb.ArenaDict(a=1), {'a': 2})
+        self.assertNotEqual(qb.ArenaDict(a=1), {'b': 1})
+        self.assertNotEqual(qb.ArenaDict(a=1), [('a', 1)])
+        with self.assertRaises(TypeError):
+            qb.ArenaDict() < qb.ArenaDict()
+
+    def test_arena_keys(self):
+        node = Node()
+        table = qb.ArenaDict({node: 'node'})
+        self.assertEqual(table[node], 'node')
+        self.assertIs(table.keys()[0], node)
+
+    def test_teardown(self):
+        payload = Payload()
+        ref = weakref.ref(payload)
+        table = qb.ArenaDict(payload=payload, node=Node())
+        del payload
+        self.assertIsNotNone(ref())
+        del table['payload']
+        if not self.in_arena:
+            self.assertIsNone(ref())
+
+
+class ArenaDictInArenaTestCase(ArenaDictTestCase):
+    in_arena = True
+
+
+class TeardownTestCase(unittest.TestCase):
+    def test_arena_releases_items(self):
+        payload = Payload()
+        ref = weakref.ref(payload)
+        with qb.Arena([Node, qb.ArenaList, qb.ArenaDict]):
+            items = qb.ArenaList([payload])
+            items.append(qb.ArenaDict({'payload': payload, 'node': Node()}))
+            items[1]['node'].payload = payload
+            del payload, items
+            # the arena holds a reference to each object outside of it
+            self.assertIsNotNone(ref())
+        self.assertIsNone(ref())
+
+    def test_global_cycle(self):
+        payload = Payload()
+        ref = weakref.ref(payload)
+        items = qb.ArenaList([payload])
+        table = qb.ArenaDict(items=items)
+        items.append(table)
+        del payload, items, table
+        gc.collect()
+        self.assertIsNone(ref())
+
+
+if __name__ == '__main__':
+    unittest.main()
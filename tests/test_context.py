@@ -0,0 +1,188 @@
+import asyncio
+import gc
+import threading
+import unittest
+import weakref
+
+import quelling_blade as qb
+
+
+class Node(qb.ArenaAllocatable):
+    pass
+
+
+class Other(qb.ArenaAllocatable):
+    pass
+
+
+def allocate(count):
+    """Allocate and drop ``count`` nodes, and return whether they were all global.
+    """
+    nodes = [Node() for _ in range(count)]
+    return all(gc.is_tracked(node) for node in nodes)
+
+
+class ArenaStackTestCase(unittest.TestCase):
+    def test_nested(self):
+        with qb.Arena(Node) as outer:
+            allocate(1)
+            with qb.Arena(Node) as inner:
+                allocate(2)
+                # the innermost arena which lists the type is used
+                with qb.Arena(Other) as other:
+                    allocate(3)
+                    Other()
+            allocate(4)
+        self.assertTrue(allocate(1))
+        self.assertEqual(outer.stats()['objects'], 5)
+        self.assertEqual(inner.stats()['objects'], 5)
+        self.assertEqual(other.stats()['objects'], 1)
+
+    def test_closed_out_of_order(self):
+        outer = qb.Arena(Node)
+        inner = qb.Arena([Node, Other])
+        outer.close()
+        self.assertFalse(allocate(1))
+        # the closed arena is skipped until the arena above it is closed
+        inner.close()
+        self.assertTrue(allocate(1))
+        self.assertEqual(outer.stats()['objects'], 0)
+        self.assertEqual(inner.stats()['objects'], 1)
+
+        first = qb.Arena(Node)
+        second = qb.Arena(Other)
+        first.close()
+        # `first` was the only open arena for `Node`
+        self.assertTrue(allocate(1))
+        Other()
+        second.close()
+        self.assertEqual(first.stats()['objects'], 0)
+        self.assertEqual(second.stats()['objects'], 1)
+
+    def test_dropped_without_close(self):
+        arena = qb.Arena(Node)
+        self.assertFalse(allocate(1))
+        ref = weakref.ref(arena)
+        # the stack only holds weak references, so dropping the arena closes it
+        del arena
+        self.assertIsNone(ref())
+        self.assertTrue(allocate(1))
+
+        with qb.Arena(Node) as outer:
+            inner = qb.Arena(Node)
+            allocate(2)
+            del inner
+            allocate(3)
+        self.assertTrue(allocate(1))
+        self.assertEqual(outer.stats()['objects'], 3)
+
+    def test_threads(self):
+        thread_count = 4
+        barrier = threading.Barrier(thread_count + 1)
+        results = {}
+
+        def work(ix):
+            with qb.Arena(Node) as arena:
+                # all of the threads have an arena open for `Node` at once
+                barrier.wait()
+                allocate(ix + 1)
+                barrier.wait()
+            results[ix] = arena.stats()['objects']
+
+        threads = [
+            threading.Thread(target=work, args=(ix,)) for ix in range(thread_count)
+        ]
+        for thread in threads:
+            thread.start()
+        barrier.wait()
+        # the other threads' arenas are not used here
+        main_global = allocate(10)
+        barrier.wait()
+        for thread in threads:
+            thread.join()
+
+        self.assertTrue(main_global)
+        self.assertEqual(results, {ix: ix + 1 for ix in range(thread_count)})
+
+    def test_threads_closing_out_of_order(self):
+        opened = threading.Event()
+        closed = threading.Event()
+        results = {}
+
+        def other_thread():
+            with qb.Arena(Node):
+                opened.set()
+                closed.wait()
+                results['other'] = allocate(1)
+
+        thread = threading.Thread(target=other_thread)
+        with qb.Arena(Node) as arena:
+            thread.start()
+            opened.wait()
+        # the other thread's arena is still open, but not in this thread
+        results['main'] = allocate(1)
+        closed.set()
+        thread.join()
+        self.assertEqual(results, {'main': True, 'other': False})
+        self.assertEqual(arena.stats()['objects'], 0)
+
+    def test_asyncio_tasks(self):
+        counts = {}
+
+        async def work(name, count):
+            with qb.Arena(Node) as arena:
+                for _ in range(count):
+                    # the other tasks run and open their arenas between allocations
+                    await asyncio.sleep(0)
+                    allocate(1)
+            counts[name] = arena.stats()['objects']
+
+        async def main():
+            await asyncio.gather(*(work(ix, ix + 1) for ix in range(4)))
+            return allocate(1)
+
+        self.assertTrue(asyncio.run(main()))
+        self.assertEqual(counts, {ix: ix + 1 for ix in range(4)})
+
+    def test_asyncio_inherited(self):
+        async def child():
+            await asyncio.sleep(0)
+            return allocate(1)
+
+        async def main():
+            with qb.Arena(Node) as arena:
+                # tasks start with a copy of the context, including its open arenas
+                task = asyncio.create_task(child())
+                self.assertFalse(await task)
+            # a task created after the arena is closed allocates globally
+            self.assertTrue(await asyncio.create_task(child()))
+            return arena
+
+        arena = asyncio.run(main())
+        self.assertEqual(arena.stats()['objects'], 1)
+
+    def test_asyncio_closed_out_of_order(self):
+        async def main():
+            outer = qb.Arena(Node)
+            entered = asyncio.Event()
+            release = asyncio.Event()
+
+            async def child():
+                # the task's copy of the context still lists `outer`
+                entered.set()
+                await release.wait()
+                return allocate(1)
+
+            task = asyncio.create_task(child())
+            await entered.wait()
+            outer.close()
+            release.set()
+            return outer, await task
+
+        outer, child_global = asyncio.run(main())
+        self.assertTrue(child_global)
+        self.assertEqual(outer.stats()['objects'], 0)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,206 @@
+import gc
+import unittest
+import warnings
+import weakref
+
+import quelling_blade as qb
+
+
+class Node(qb.ArenaAllocatable):
+    pass
+
+
+class WeakNode(qb.ArenaAllocatable, weakref=True):
+    pass
+
+
+class Payload:
+    pass
+
+
+class EvacuateTestCase(unittest.TestCase):
+    types = [Node, WeakNode, qb.ArenaList, qb.ArenaDict]
+
+    def close(self, build):
+        """Run ``build`` in an evacuating arena and close it.
+
+        Returns
+        -------
+        out : any
+            The result of ``build``.
+        messages : list[str]
+            The warnings issued when the arena was closed.
+        stats : dict
+            The arena's stats.
+        """
+        with warnings.catch_warnings(record=True) as caught:
+            warnings.simplefilter('always')
+            with qb.Arena(self.types, evacuate=True) as arena:
+                out = build()
+                # garbage which is not reachable from the escaped objects
+                junk = [Node() for _ in range(100)]
+                del junk
+        return out, [str(w.message) for w in caught], arena.stats()
+
+    def test_children(self):
+        def build():
+            root = Node()
+            root.name = 'root'
+            root.left = Node()
+            root.left.value = 1
+            root.left.payload = [1, 2]
+            root.right = Node()
+            root.right.left = Node()
+            root.right.left.value = 2
+            return root
+
+        root, messages, stats = self.close(build)
+        self.assertEqual(
+            messages,
+            ['1 object is still alive at arena exit; evacuated them and 3 reachable '
+             'objects'],
+        )
+        self.assertEqual(stats['escaped'], 1)
+        self.assertEqual(stats['objects'], 104)
+
+        self.assertEqual(root.name, 'root')
+        self.assertEqual(root.left.value, 1)
+        self.assertEqual(root.left.payload, [1, 2])
+        self.assertEqual(root.right.left.value, 2)
+
+        # the copies are regular global objects
+        self.assertTrue(gc.is_tracked(root.left))
+        root.left.value = 3
+        root.extra = Node()
+        root.extra.value = 4
+        self.assertEqual(root.left.value, 3)
+        self.assertEqual(root.extra.value, 4)
+
+    def test_cycle_to_root(self):
+        def build():
+            root = Node()
+            root.me = root
+            root.child = Node()
+            root.child.parent = root
+            root.child.child = Node()
+            root.child.child.root = root
+            root.child.child.payload = Payload()
+            return root
+
+        root, messages, _ = self.close(build)
+        self.assertIn('evacuated them and 2 reachable objects', messages[0])
+        self.assertIs(root.me, root)
+        self.assertIs(root.child.parent, root)
+        self.assertIs(root.child.child.root, root)
+
+        # The escaped root has no GC header, so a cycle through it is not collected,
+        # like any escaped instance. Once the cycle is broken, the copies are released.
+        ref = weakref.ref(root.child.child.payload)
+        del root.me
+        child = root.child
+        del root
+        gc.collect()
+        self.assertIsNotNone(ref())
+        del child.parent, child.child.root
+        del child
+        self.assertIsNone(ref())
+
+    def test_shared_child(self):
+        def build():
+            shared = Node()
+            shared.value = 'shared'
+            first = Node()
+            first.child = shared
+            second = Node()
+            second.child = shared
+            return first, second
+
+        (first, second), messages, stats = self.close(build)
+        self.assertIn('2 objects are still alive', messages[0])
+        self.assertIn('evacuated them and 1 reachable object', messages[0])
+        self.assertEqual(stats['escaped'], 2)
+        # the shared object is copied once
+        self.assertIs(first.child, second.child)
+        self.assertEqual(first.child.value, 'shared')
+
+    def test_containers(self):
+        def build():
+            items = qb.ArenaList([Node(), 'text', Node()])
+            items[0].value = 0
+            items.append(items)
+            table = qb.ArenaDict({'a': Node(), 'b': items})
+            table['a'].value = 'a'
+            table[items[2]] = 'node key'
+            del table['b']
+            return items, table
+
+        (items, table), messages, stats = self.close(build)
+        self.assertIn('2 objects are still alive', messages[0])
+        self.assertIn('evacuated them and 3 reachable objects', messages[0])
+        self.assertEqual(stats['escaped'], 2)
+
+        self.assertEqual(len(items), 4)
+        self.assertEqual(items[0].value, 0)
+        self.assertEqual(items[1], 'text')
+        self.assertIs(items[3], items)
+        self.assertEqual(len(table), 2)
+        self.assertEqual(table['a'].value, 'a')
+        self.assertEqual(table[items[2]], 'node key')
+        self.assertNotIn('b', table)
+
+        items.append(Node())
+        table['c'] = items[-1]
+        self.assertIs(table['c'], items[4])
+
+    def test_weak_references(self):
+        refs = {}
+        calls = []
+
+        def build():
+            root = WeakNode()
+            root.child = WeakNode()
+            refs['root'] = weakref.ref(root)
+            refs['child'] = weakref.ref(root.child, lambda ref: calls.append(ref))
+            return root
+
+        root, messages, _ = self.close(build)
+        self.assertIn('evacuated them and 1 reachable object', messages[0])
+        # the root is not moved, so its weak references still resolve
+        self.assertIs(refs['root'](), root)
+        # the weak references to the copied child are cleared with the arena
+        self.assertIsNone(refs['child']())
+        self.assertEqual(calls, [refs['child']])
+        self.assertIsInstance(root.child, WeakNode)
+
+        # the copy supports new weak references
+        child_ref = weakref.ref(root.child)
+        self.assertIs(child_ref(), root.child)
+        del root
+        gc.collect()
+        self.assertIsNone(refs['root']())
+        self.assertIsNone(child_ref())
+
+    def test_nothing_escaped(self):
+        def build():
+            root = Node()
+            root.child = Node()
+
+        _, messages, stats = self.close(build)
+        self.assertEqual(messages, [])
+        self.assertEqual(stats['escaped'], 0)
+
+    def test_without_evacuate(self):
+        with warnings.catch_warnings(record=True) as caught:
+            warnings.simplefilter('always')
+            with qb.Arena(Node):
+                root = Node()
+                root.child = Node()
+        self.assertEqual(
+            [str(w.message) for w in caught],
+            ['1 object is still alive at arena exit'],
+        )
+        self.assertFalse(gc.is_tracked(root.child))
+
+
+if __name__ == '__main__':
+    unittest.main()
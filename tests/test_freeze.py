@@ -0,0 +1,206 @@
+import gc
+import unittest
+import weakref
+
+import quelling_blade as qb
+
+
+class Node(qb.ArenaAllocatable):
+    pass
+
+
+class Payload:
+    pass
+
+
+class Collides:
+    """A key whose instances all have the same hash.
+    """
+    def __init__(self, value):
+        self.value = value
+
+    def __hash__(self):
+        return 7
+
+    def __eq__(self, other):
+        return isinstance(other, Collides) and self.value == other.value
+
+
+class FreezeTestCase(unittest.TestCase):
+    types = [Node, qb.ArenaList, qb.ArenaDict]
+
+    def freeze(self, build):
+        """Freeze the result of ``build`` and close its arena.
+        """
+        with qb.Arena(self.types) as arena:
+            return arena.freeze(build())
+
+    def test_copies(self):
+        def build():
+            root = Node()
+            root.name = 'root'
+            root.children = qb.ArenaList([Node(), Node()])
+            root.children[0].value = 0
+            root.children[1].value = 1
+            root.table = qb.ArenaDict(a=1)
+            return root
+
+        root = self.freeze(build)
+        self.assertIsInstance(root, Node)
+        self.assertEqual(root.name, 'root')
+        self.assertEqual([child.value for child in root.children], [0, 1])
+        self.assertEqual(root.table, {'a': 1})
+        self.assertFalse(gc.is_tracked(root.children[0]))
+
+    def test_immutable(self):
+        def build():
+            root = Node()
+            root.value = 1
+            root.items = qb.ArenaList([1, 2, 3])
+            root.table = qb.ArenaDict(a=1)
+            return root
+
+        root = self.freeze(build)
+        message = 'frozen .* cannot be modified'
+        with self.assertRaisesRegex(TypeError, message):
+            root.value = 2
+        with self.assertRaisesRegex(TypeError, message):
+            root.other = 2
+        with self.assertRaisesRegex(TypeError, message):
+            del root.value
+
+        items = root.items
+        mutations = [
+            lambda: items.append(4),
+            lambda: items.extend([4]),
+            lambda: items.insert(0, 4),
+            lambda: items.pop(),
+            lambda: items.remove(1),
+            lambda: items.clear(),
+            lambda: items.__setitem__(0, 4),
+            lambda: items.__setitem__(slice(None), []),
+            lambda: items.__delitem__(0),
+        ]
+        for mutation in mutations:
+            with self.subTest(mutation=mutation):
+                with self.assertRaisesRegex(TypeError, message):
+                    mutation()
+        self.assertEqual(items, [1, 2, 3])
+
+        table = root.table
+        mutations = [
+            lambda: table.__setitem__('a', 2),
+            lambda: table.__setitem__('b', 2),
+            lambda: table.__delitem__('a'),
+            lambda: table.pop('a'),
+            lambda: table.setdefault('b', 2),
+            lambda: table.update(b=2),
+            lambda: table.clear(),
+        ]
+        for mutation in mutations:
+            with self.subTest(mutation=mutation):
+                with self.assertRaisesRegex(TypeError, message):
+                    mutation()
+        self.assertEqual(table, {'a': 1})
+
+    def test_shared_and_cycles(self):
+        def build():
+            root = Node()
+            root.me = root
+            shared = Node()
+            shared.parent = root
+            root.left = Node()
+            root.right = Node()
+            root.left.child = root.right.child = shared
+            root.items = qb.ArenaList([shared, root])
+            root.items.append(root.items)
+            root.table = qb.ArenaDict(shared=shared)
+            root.table['table'] = root.table
+            return root
+
+        root = self.freeze(build)
+        shared = root.left.child
+        self.assertIs(root.me, root)
+        self.assertIs(root.right.child, shared)
+        self.assertIs(shared.parent, root)
+        self.assertIs(root.items[0], shared)
+        self.assertIs(root.items[1], root)
+        self.assertIs(root.items[2], root.items)
+        self.assertIs(root.table['shared'], shared)
+        self.assertIs(root.table['table'], root.table)
+
+    def test_external_references(self):
+        refs = []
+
+        def build():
+            root = Node()
+            root.payload = Payload()
+            root.values = [1, 2]
+            root.items = qb.ArenaList([Payload()])
+            root.table = qb.ArenaDict(payload=Payload())
+            refs.extend(
+                weakref.ref(ob)
+                for ob in [root.payload, root.items[0], root.table['payload']]
+            )
+            return root
+
+        root = self.freeze(build)
+        # the source arena is closed, the frozen arena holds its own references
+        for ref in refs:
+            self.assertIsNotNone(ref())
+        self.assertIs(root.payload, refs[0]())
+        self.assertIs(root.items[0], refs[1]())
+        self.assertIs(root.table['payload'], refs[2]())
+        # values are shared, not copied, so mutable values can still change
+        root.values.append(3)
+        self.assertEqual(root.values, [1, 2, 3])
+
+        # the frozen arena releases them when its objects are gone
+        del root
+        gc.collect()
+        for ref in refs:
+            self.assertIsNone(ref())
+
+    def test_dict_lookups(self):
+        keys = []
+
+        def build():
+            table = qb.ArenaDict()
+            keys.extend(f'key-{ix}' for ix in range(200))
+            keys.extend(range(100))
+            keys.extend((ix, 'tuple') for ix in range(50))
+            keys.extend(Collides(ix) for ix in range(20))
+            for ix, key in enumerate(keys):
+                table[key] = ix
+            # objects which hash by identity are copied, so their hashes change
+            for ix in range(20):
+                node = Node()
+                node.ix = ix
+                table[node] = node
+            # removed entries are left behind
+            for key in keys[::4]:
+                del table[key]
+            return table
+
+        table = self.freeze(build)
+        expected = {key: ix for ix, key in enumerate(keys) if ix % 4}
+        self.assertEqual(len(table), len(expected) + 20)
+        for key, value in expected.items():
+            self.assertEqual(table[key], value)
+        for key in keys[::4]:
+            self.assertNotIn(key, table)
+        nodes = [key for key in table.keys() if isinstance(key, Node)]
+        self.assertEqual([node.ix for node in nodes], list(range(20)))
+        for node in nodes:
+            self.assertIs(table[node], node)
+        self.assertEqual(table.keys()[:len(expected)], list(expected))
+
+    def test_not_in_arena(self):
+        node = Node()
+        with qb.Arena(self.types) as arena:
+            with self.assertRaisesRegex(ValueError, 'not allocated in this arena'):
+                arena.freeze(node)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,110 @@
+import gc
+import unittest
+import warnings
+import weakref
+
+import quelling_blade as qb
+
+
+class Node(qb.ArenaAllocatable):
+    pass
+
+
+class Payload:
+    pass
+
+
+class CycleCollectionTestCase(unittest.TestCase):
+    def finalizer_calls(self, payload):
+        """Return a list which has ``'finalized'`` appended when ``payload`` is freed.
+        """
+        calls = []
+        weakref.finalize(payload, calls.append, 'finalized')
+        return calls
+
+    def test_global_cycle(self):
+        first = Node()
+        second = Node()
+        first.other = second
+        second.other = first
+        first.payload = Payload()
+        calls = self.finalizer_calls(first.payload)
+        self.assertTrue(gc.is_tracked(first))
+
+        del first, second
+        self.assertEqual(calls, [])
+        gc.collect()
+        self.assertEqual(calls, ['finalized'])
+
+    def test_global_self_reference(self):
+        node = Node()
+        node.me = node
+        node.items = qb.ArenaList([node])
+        node.table = qb.ArenaDict(node=node)
+        node.items.append(Payload())
+        calls = self.finalizer_calls(node.items[1])
+
+        del node
+        gc.collect()
+        self.assertEqual(calls, ['finalized'])
+
+    def test_evacuated_cycle(self):
+        with warnings.catch_warnings():
+            warnings.simplefilter('ignore')
+            with qb.Arena(Node, evacuate=True):
+                root = Node()
+                root.child = Node()
+                root.child.me = root.child
+                root.child.child = Node()
+                root.child.child.parent = root.child
+                root.child.payload = Payload()
+
+        # the copies of the escaped instance's children are global, tracked objects
+        self.assertTrue(gc.is_tracked(root.child))
+        calls = self.finalizer_calls(root.child.payload)
+        del root.child
+        self.assertEqual(calls, [])
+        gc.collect()
+        self.assertEqual(calls, ['finalized'])
+
+    def test_arena_cycle(self):
+        # an open `Arena` stored on an object which its arena references
+        holder = Payload()
+        arena = qb.Arena(Node)
+        node = Node()
+        node.holder = holder
+        holder.arena = arena
+        ref = weakref.ref(arena)
+        calls = self.finalizer_calls(holder)
+
+        del node, arena, holder
+        self.assertIsNotNone(ref())
+        gc.collect()
+        self.assertEqual(calls, ['finalized'])
+        self.assertIsNone(ref())
+        # clearing the `Arena` closed it
+        self.assertTrue(gc.is_tracked(Node()))
+
+    def test_escaped_cycle(self):
+        # An escaped instance has no GC header, so a cycle through it is not collected
+        # (see the README's To Do); it is released once the cycle is broken.
+        holder = Payload()
+        with warnings.catch_warnings():
+            warnings.simplefilter('ignore')
+            with qb.Arena(Node):
+                node = Node()
+                node.holder = holder
+                holder.node = node
+        ref = weakref.ref(holder)
+        calls = self.finalizer_calls(holder)
+        del node, holder
+        gc.collect()
+        self.assertEqual(calls, [])
+
+        holder = ref()
+        del holder.node, holder
+        self.assertEqual(calls, ['finalized'])
+
+
+if __name__ == '__main__':
+    unittest.main()
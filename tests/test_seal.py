@@ -0,0 +1,83 @@
+import os
+import unittest
+import weakref
+
+import quelling_blade as qb
+
+
+class Node(qb.ArenaAllocatable, weakref=True):
+    pass
+
+
+class SealTestCase(unittest.TestCase):
+    def build(self):
+        root = Node()
+        root.name = 'root'
+        root.children = qb.ArenaList()
+        for ix in range(100):
+            child = Node()
+            child.value = ix
+            root.children.append(child)
+        return root
+
+    def run_child(self, check):
+        """Run ``check`` in a forked process and return its exit status.
+        """
+        pid = os.fork()
+        if not pid:
+            try:
+                ok = check()
+            except BaseException:
+                ok = False
+            os._exit(0 if ok else 1)
+        _, status = os.waitpid(pid, 0)
+        return os.waitstatus_to_exitcode(status)
+
+    def test_fork(self):
+        with qb.Arena([Node, qb.ArenaList], backing='shared') as arena:
+            root = self.build()
+            arena.seal(root)
+
+            def check():
+                return (
+                    root.name == 'root' and
+                    [child.value for child in root.children] == list(range(100))
+                )
+
+            self.assertEqual(self.run_child(check), 0)
+            # writes in the child are not seen by the parent
+            self.assertEqual(self.run_child(lambda: setattr(root, 'name', 'x')), 1)
+            self.assertEqual(root.name, 'root')
+
+    def test_reset_rejected(self):
+        with qb.Arena([Node, qb.ArenaList], backing='shared') as arena:
+            root = self.build()
+            refs = [weakref.ref(root), weakref.ref(root.children[0])]
+            arena.seal(root)
+            self.assertEqual(self.run_child(lambda: root.children[0].value == 0), 0)
+            # the sealed objects are only reachable through the weak references
+            del root
+            # and so is an object allocated after sealing, which the arena holds
+            calls = []
+            refs.append(weakref.ref(Node(), calls.append))
+
+            with self.assertRaisesRegex(RuntimeError, 'cannot reset a sealed arena'):
+                arena.reset()
+            # the rejected reset leaves the sealed objects and their weak references alone
+            root = refs[0]()
+            self.assertIsInstance(root, Node)
+            self.assertIs(refs[1](), root.children[0])
+            self.assertEqual(root.children[99].value, 99)
+            self.assertIsInstance(refs[2](), Node)
+            self.assertEqual(calls, [])
+
+    def test_not_shared(self):
+        with qb.Arena(Node) as arena:
+            root = Node()
+            with self.assertRaisesRegex(ValueError, "backing='shared'"):
+                arena.seal(root)
+            del root
+
+
+if __name__ == '__main__':
+    unittest.main()
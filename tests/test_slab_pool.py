@@ -0,0 +1,89 @@
+import subprocess
+import sys
+import tracemalloc
+import unittest
+
+import quelling_blade as qb
+
+
+class Node(qb.ArenaAllocatable):
+    pass
+
+
+class SlabPoolTestCase(unittest.TestCase):
+    def setUp(self):
+        self.addCleanup(qb.set_slab_pool_limit, qb.get_slab_pool_limit())
+
+    def fill_pool(self):
+        for backing in ['malloc', 'mmap', 'hugepage']:
+            for slab_size in [1 << 12, 1 << 16, 1 << 20]:
+                with qb.Arena(Node, slab_size=slab_size, backing=backing):
+                    nodes = [Node() for _ in range(100)]
+                    del nodes
+
+    def test_limit(self):
+        qb.set_slab_pool_limit(1 << 22)
+        self.assertEqual(qb.get_slab_pool_limit(), 1 << 22)
+        with self.assertRaises(ValueError):
+            qb.set_slab_pool_limit(-1)
+
+    def test_evict(self):
+        qb.set_slab_pool_limit(1 << 26)
+        self.fill_pool()
+        # evicts pooled slabs of every backing, largest first
+        for limit in [1 << 21, 1 << 16, 0]:
+            qb.set_slab_pool_limit(limit)
+            self.assertEqual(qb.get_slab_pool_limit(), limit)
+        # an empty pool still gives out new slabs, and a full pool frees released slabs
+        self.fill_pool()
+
+    def test_trim(self):
+        self.fill_pool()
+        qb.trim_slab_pool()
+        # trimmed slabs are reused, and page fault back in as they are filled
+        with qb.Arena(Node, slab_size=1 << 20, backing='mmap'):
+            nodes = [Node() for _ in range(10000)]
+            for ix, node in enumerate(nodes):
+                node.value = ix
+            self.assertEqual(sum(node.value for node in nodes), sum(range(10000)))
+            del nodes, node
+
+
+class InstanceFreeListTestCase(unittest.TestCase):
+    def test_reuse(self):
+        node = Node()
+        address = id(node)
+        del node
+        # the memory of the last global instance freed is the next one used
+        node = Node()
+        self.assertEqual(id(node), address)
+        node.value = 1
+        self.assertEqual(node.value, 1)
+
+    def test_trim(self):
+        tracemalloc.start()
+        self.addCleanup(tracemalloc.stop)
+        qb.trim_slab_pool()
+        before, _ = tracemalloc.get_traced_memory()
+        nodes = [Node() for _ in range(500)]
+        del nodes
+        kept, _ = tracemalloc.get_traced_memory()
+        # the free lists keep the memory of the deallocated instances
+        self.assertGreater(kept - before, 500 * Node.__basicsize__)
+        qb.trim_slab_pool()
+        trimmed, _ = tracemalloc.get_traced_memory()
+        self.assertLess(trimmed - before, (kept - before) // 10)
+
+    def test_module_free(self):
+        # the free lists are freed with the module at interpreter shutdown
+        code = (
+            'import quelling_blade as qb\n'
+            'class Node(qb.ArenaAllocatable): pass\n'
+            'nodes = [Node() for _ in range(500)]\n'
+            'del nodes\n'
+        )
+        subprocess.run([sys.executable, '-X', 'dev', '-c', code], check=True)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,99 @@
+import os
+import tempfile
+import unittest
+
+import quelling_blade as qb
+
+
+class Node(qb.ArenaAllocatable):
+    def __init__(self, name):
+        self.name = name
+        self.children = qb.ArenaList()
+        self.by_name = qb.ArenaDict()
+
+    def add(self, child):
+        self.children.append(child)
+        self.by_name[child.name] = child
+        return child
+
+
+class SnapshotTestCase(unittest.TestCase):
+    def setUp(self):
+        self.dir = tempfile.TemporaryDirectory()
+        self.path = os.path.join(self.dir.name, 'graph.qb')
+
+    def tearDown(self):
+        self.dir.cleanup()
+
+    def save(self):
+        with qb.Arena([Node, qb.ArenaList, qb.ArenaDict]) as arena:
+            root = Node('root')
+            left = root.add(Node('left'))
+            right = root.add(Node('right'))
+            left.add(Node('leaf')).values = qb.ArenaList(
+                [1, -2, 2 ** 80, 1.5, 'text', None, True, False],
+            )
+            right.sibling = left
+            right.back = root
+            arena.save(self.path, root)
+            del root, left, right
+
+    def test_round_trip(self):
+        self.save()
+        root = qb.Arena.load(self.path)
+
+        self.assertIsInstance(root, Node)
+        self.assertEqual(root.name, 'root')
+        self.assertEqual([child.name for child in root.children], ['left', 'right'])
+        left, right = root.children
+        self.assertIs(root.by_name['left'], left)
+        self.assertIs(root.by_name['right'], right)
+        self.assertIs(right.sibling, left)
+        self.assertIs(right.back, root)
+
+        leaf = left.by_name['leaf']
+        self.assertEqual(
+            list(leaf.values),
+            [1, -2, 2 ** 80, 1.5, 'text', None, True, False],
+        )
+
+        # the loaded objects can be changed like any other arena objects
+        leaf.values.append(3)
+        right.name = 'changed'
+        self.assertEqual(leaf.values[-1], 3)
+        self.assertIs(root.by_name['right'].name, right.name)
+
+    def test_load_twice(self):
+        self.save()
+        first = qb.Arena.load(self.path)
+        second = qb.Arena.load(self.path)
+        self.assertIsNot(first, second)
+        first.name = 'first'
+        self.assertEqual(second.name, 'root')
+
+    def test_truncated(self):
+        self.save()
+        with open(self.path, 'rb') as f:
+            data = f.read()
+
+        truncated = os.path.join(self.dir.name, 'truncated.qb')
+        for size in [0, 8, len(data) // 2, len(data) - 1]:
+            with self.subTest(size=size):
+                with open(truncated, 'wb') as f:
+                    f.write(data[:size])
+                with self.assertRaises(ValueError):
+                    qb.Arena.load(truncated)
+
+    def test_not_a_snapshot(self):
+        with open(self.path, 'wb') as f:
+            f.write(b'\0' * 4096)
+        with self.assertRaisesRegex(ValueError, 'not an arena snapshot'):
+            qb.Arena.load(self.path)
+
+    def test_missing(self):
+        with self.assertRaises(FileNotFoundError):
+            qb.Arena.load(os.path.join(self.dir.name, 'missing.qb'))
+
+
+if __name__ == '__main__':
+    unittest.main()
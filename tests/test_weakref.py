@@ -0,0 +1,61 @@
+import unittest
+import warnings
+import weakref
+
+import quelling_blade as qb
+
+
+class Node(qb.ArenaAllocatable, weakref=True):
+    pass
+
+
+class WeakReferenceTestCase(unittest.TestCase):
+    def test_resolves_while_arena_is_open(self):
+        calls = []
+        cache = weakref.WeakValueDictionary()
+        # the arena holds the child, which doesn't count as escaped
+        with warnings.catch_warnings(), qb.Arena(Node):
+            warnings.simplefilter('error')
+            parent = Node()
+            child = parent.child = Node()
+            ref = weakref.ref(child, lambda ref: calls.append(ref))
+            cache['child'] = child
+            del child
+
+            # the child is only reachable through the arena
+            self.assertIs(ref(), parent.child)
+            self.assertEqual(len(cache), 1)
+            self.assertIs(cache['child'], parent.child)
+
+            del parent
+            self.assertIsNotNone(ref())
+            self.assertEqual(calls, [])
+
+        self.assertIsNone(ref())
+        self.assertEqual(len(cache), 0)
+        self.assertEqual(calls, [ref])
+
+    def test_reset_clears_held_objects(self):
+        with qb.Arena(Node) as arena:
+            ref = weakref.ref(Node())
+            self.assertIsNotNone(ref())
+            arena.reset()
+            self.assertIsNone(ref())
+
+    def test_escaped_after_close(self):
+        with warnings.catch_warnings(), qb.Arena(Node):
+            warnings.simplefilter('ignore')
+            ob = Node()
+            ref = weakref.ref(ob)
+            del ob
+            ob = ref()
+
+        # referenced from Python when the arena closed, so it escaped like any other
+        # instance and keeps its weak references until it is released
+        self.assertIs(ref(), ob)
+        del ob
+        self.assertIsNone(ref())
+
+
+if __name__ == '__main__':
+    unittest.main()